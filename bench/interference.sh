@@ -0,0 +1,195 @@
+#!/usr/bin/env bash
+#
+# Interference benchmark of pg_check - runs a pgbench OLTP workload, and
+# measures how much the checks running concurrently on the same tables affect
+# the foreground transactions (throughput, latency percentiles, lock waits).
+#
+# Needs a running server with pg_check installed (make install), and pgbench
+# in PATH. Connection is determined by the usual libpq variables (PGHOST,
+# PGDATABASE, ...). The pgbench tables are (re)initialized at the beginning.
+#
+# For each mode, pgbench runs for BENCH_DURATION seconds, and the check runs
+# on pgbench_accounts in a loop (from another connection) the whole time. The
+# first mode is always "none" (no check), used as a baseline. The results are
+# written as CSV, one row per mode and run:
+#
+#   git, server, scale, clients, duration, mode, run, checks, tps, tps_drop,
+#   latency_avg, latency_p50, latency_p95, latency_p99, latency_max,
+#   p99_increase, lock_waits, lock_waiters_max
+#
+# Latencies are in milliseconds, tps_drop and p99_increase are percentages
+# relative to the baseline. lock_waits is the number of samples (taken every
+# BENCH_SAMPLE seconds) with at least one pgbench backend waiting on a lock,
+# lock_waiters_max is the maximum number of such backends in a sample. The
+# index cross-check (bitmap, fingerprint) holds ShareRowExclusiveLock on the
+# table, which blocks the UPDATEs - that's where the waits come from.
+#
+# Options (environment variables):
+#
+#   BENCH_SCALE     pgbench scale (default 10)
+#   BENCH_CLIENTS   pgbench clients (default 8)
+#   BENCH_DURATION  duration of each run in seconds (default 60)
+#   BENCH_MODES     check modes (default all of them, see below)
+#   BENCH_RUNS      runs of each mode (default 1)
+#   BENCH_SAMPLE    interval of lock wait sampling in seconds (default 0.5)
+#   BENCH_OUTPUT    output file (default bench-interference.csv)
+#   BENCH_KEEP      keep the pgbench tables after the benchmark (default 0)
+#
+# Check modes:
+#
+#   table       pg_check_table(t, false, false)
+#   indexes     pg_check_table(t, true, false)
+#   bitmap      pg_check_table(t, true, true)
+#   fingerprint pg_check_table(t, true, true), cross_check_method = fingerprint
+#   online      pg_check_table(t, true, true, online := true)
+#   quick       pg_check_table(t, false, false, quick := true)
+#   sample      pg_check_table(t, false, false, sample_fraction := 0.01)
+#   index       pg_check_index(pgbench_accounts_pkey)
+
+set -e
+
+SCALE=${BENCH_SCALE:-10}
+CLIENTS=${BENCH_CLIENTS:-8}
+DURATION=${BENCH_DURATION:-60}
+MODES=${BENCH_MODES:-"table indexes bitmap fingerprint online quick sample index"}
+RUNS=${BENCH_RUNS:-1}
+SAMPLE=${BENCH_SAMPLE:-0.5}
+OUTPUT=${BENCH_OUTPUT:-bench-interference.csv}
+KEEP=${BENCH_KEEP:-0}
+
+PSQL="psql -X -q -A -t -v ON_ERROR_STOP=1"
+
+GIT=$(git -C "$(dirname "$0")" rev-parse --short HEAD 2>/dev/null || echo "unknown")
+SERVER=$($PSQL -c "SHOW server_version_num")
+
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+$PSQL -c "CREATE EXTENSION IF NOT EXISTS pg_check"
+
+pgbench -i -q -s "$SCALE" > /dev/null 2>&1
+$PSQL -c "VACUUM ANALYZE"
+
+echo "git,server,scale,clients,duration,mode,run,checks,tps,tps_drop,latency_avg,latency_p50,latency_p95,latency_p99,latency_max,p99_increase,lock_waits,lock_waiters_max" > "$OUTPUT"
+
+# the check to run in a loop, for the mode (empty for the baseline)
+check_query() {
+	case $1 in
+		none)        echo "" ;;
+		table)       echo "SELECT pg_check_table('pgbench_accounts', false, false)" ;;
+		indexes)     echo "SELECT pg_check_table('pgbench_accounts', true, false)" ;;
+		bitmap)      echo "SET pg_check.cross_check_method = bitmap; SELECT pg_check_table('pgbench_accounts', true, true)" ;;
+		fingerprint) echo "SET pg_check.cross_check_method = fingerprint; SELECT pg_check_table('pgbench_accounts', true, true)" ;;
+		online)      echo "SELECT pg_check_table('pgbench_accounts', true, true, online := true)" ;;
+		quick)       echo "SELECT pg_check_table('pgbench_accounts', false, false, quick := true)" ;;
+		sample)      echo "SELECT pg_check_table('pgbench_accounts', false, false, sample_fraction := 0.01)" ;;
+		index)       echo "SELECT pg_check_index('pgbench_accounts_pkey')" ;;
+		*)
+			echo "unknown mode: $1" >&2
+			exit 1 ;;
+	esac
+}
+
+# sample lock waits of the pgbench backends until the file disappears,
+# print "samples max" (samples with at least one waiter, max waiters)
+sample_locks() {
+	local running=$1
+	local samples=0 max=0 n
+
+	while [ -f "$running" ]; do
+		n=$($PSQL -c "SELECT count(*) FROM pg_stat_activity WHERE application_name = 'pgbench' AND wait_event_type = 'Lock'" 2>/dev/null || echo 0)
+		if [ "$n" -gt 0 ]; then
+			samples=$((samples + 1))
+			[ "$n" -gt "$max" ] && max=$n
+		fi
+		sleep "$SAMPLE"
+	done
+
+	echo "$samples $max"
+}
+
+# run the check in a loop until the file disappears, print number of checks
+run_checks() {
+	local running=$1 query=$2
+	local checks=0
+
+	while [ -f "$running" ]; do
+		PGAPPNAME=pg_check $PSQL -c "SET client_min_messages = error; $query" > /dev/null
+		checks=$((checks + 1))
+	done
+
+	echo "$checks"
+}
+
+# latency percentiles from the pgbench transaction logs (third column is the
+# latency in microseconds), print "avg p50 p95 p99 max" in milliseconds
+latencies() {
+	cat "$1"/pgbench_log.* | awk '{ print $3 }' | sort -n | awk '
+		{ lat[NR] = $1; sum += $1 }
+		END {
+			if (NR == 0) { print "0 0 0 0 0"; exit }
+			printf "%.3f %.3f %.3f %.3f %.3f\n", sum / NR / 1000,
+				lat[int(NR * 0.50) > 0 ? int(NR * 0.50) : 1] / 1000,
+				lat[int(NR * 0.95) > 0 ? int(NR * 0.95) : 1] / 1000,
+				lat[int(NR * 0.99) > 0 ? int(NR * 0.99) : 1] / 1000,
+				lat[NR] / 1000
+		}'
+}
+
+BASE_TPS=""
+BASE_P99=""
+
+for mode in none $MODES; do
+for run in $(seq 1 "$RUNS"); do
+
+	query=$(check_query "$mode")
+	logdir="$WORKDIR/$mode-$run"
+	running="$WORKDIR/running"
+
+	mkdir -p "$logdir"
+	touch "$running"
+
+	sample_locks "$running" > "$logdir/locks" &
+	sampler=$!
+
+	checker=""
+	if [ -n "$query" ]; then
+		run_checks "$running" "$query" > "$logdir/checks" &
+		checker=$!
+	fi
+
+	tps=$(cd "$logdir" && PGAPPNAME=pgbench pgbench -n -c "$CLIENTS" -j "$CLIENTS" -T "$DURATION" -l 2>/dev/null | awk '/^tps/ { print $3; exit }')
+
+	# stop the sampler and the checks (waits for the running check)
+	rm -f "$running"
+	wait "$sampler"
+	checks=0
+	if [ -n "$checker" ]; then
+		wait "$checker"
+		checks=$(cat "$logdir/checks")
+	fi
+
+	set -- $(latencies "$logdir") $(cat "$logdir/locks")
+	avg=$1 p50=$2 p95=$3 p99=$4 max=$5 lock_waits=$6 lock_waiters=$7
+
+	# the first baseline run is the reference
+	if [ -z "$BASE_TPS" ]; then
+		BASE_TPS=$tps
+		BASE_P99=$p99
+	fi
+
+	tps_drop=$(awk "BEGIN { printf \"%.1f\", ($BASE_TPS > 0) ? 100 * ($BASE_TPS - $tps) / $BASE_TPS : 0 }")
+	p99_increase=$(awk "BEGIN { printf \"%.1f\", ($BASE_P99 > 0) ? 100 * ($p99 - $BASE_P99) / $BASE_P99 : 0 }")
+
+	echo "$GIT,$SERVER,$SCALE,$CLIENTS,$DURATION,$mode,$run,$checks,$tps,$tps_drop,$avg,$p50,$p95,$p99,$max,$p99_increase,$lock_waits,$lock_waiters" >> "$OUTPUT"
+
+	echo "$mode run $run: $tps tps ($tps_drop% drop), p99 $p99 ms ($p99_increase% increase), $lock_waits lock waits, $checks checks"
+
+done
+done
+
+if [ "$KEEP" = "0" ]; then
+	$PSQL -c "DROP TABLE pgbench_accounts, pgbench_branches, pgbench_history, pgbench_tellers"
+fi
+
+echo "results written to $OUTPUT"
@@ -0,0 +1,353 @@
+/*
+ * Microbenchmark of the page checks, running outside the server.
+ *
+ * Loads page images from files (raw BLCKSZ pages, e.g. copies of relation
+ * segment files or pages dumped with pageinspect, possibly corrupted on
+ * purpose), and runs a single check on them in a tight loop, measuring the
+ * duration of each check in CPU cycles (TSC on x86, nanoseconds elsewhere).
+ * There's no buffer manager involved, and the messages are not formatted at
+ * all (see stubs.c), so the numbers are for the checks alone.
+ *
+ * Usage:
+ *
+ *   pg_check_micro -t header|heap|btree [-a types] [-l loops] [-p] [-v] file...
+ *
+ *   -t  check to run (page header, heap page, b-tree page)
+ *   -a  comma-separated attribute types of the table/index, e.g. int4,text
+ *       (int2, int4, int8, float4, float8, bool, text, bytea, numeric, name,
+ *       timestamp, uuid)
+ *   -l  number of loops over all the pages (default 1000)
+ *   -p  print results for each page, not just for the whole file
+ *   -v  print warnings about issues found (on the first loop)
+ *
+ * For each file, it prints number of pages, tuples (line pointers) and issues
+ * found, and the average number of cycles per page and per tuple.
+ */
+#include "postgres.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "access/tupdesc.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_attribute.h"
+#include "catalog/pg_class.h"
+#include "utils/rel.h"
+
+#include "btree.h"
+#include "common.h"
+#include "heap.h"
+
+extern bool micro_verbose;
+
+typedef enum
+{
+	MICRO_HEADER,
+	MICRO_HEAP,
+	MICRO_BTREE
+}			MicroCheck;
+
+/* attribute types we know how to describe */
+typedef struct micro_type
+{
+	const char *name;
+	int16		attlen;
+	bool		attbyval;
+	char		attalign;
+}			micro_type;
+
+static const micro_type types[] = {
+	{"int2", 2, true, 's'},
+	{"int4", 4, true, 'i'},
+	{"int8", 8, FLOAT8PASSBYVAL, 'd'},
+	{"float4", 4, true, 'i'},
+	{"float8", 8, FLOAT8PASSBYVAL, 'd'},
+	{"bool", 1, true, 'c'},
+	{"text", -1, false, 'i'},
+	{"bytea", -1, false, 'i'},
+	{"numeric", -1, false, 'i'},
+	{"name", NAMEDATALEN, false, 'c'},
+	{"timestamp", 8, FLOAT8PASSBYVAL, 'd'},
+	{"uuid", 16, false, 'c'},
+	{NULL, 0, false, 0}
+};
+
+/* current time in cycles (or nanoseconds) */
+static inline uint64
+micro_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* build a relation with the attributes (just enough for the checks) */
+static Relation
+micro_relation(MicroCheck check, char *spec)
+{
+	Relation	rel = calloc(1, sizeof(RelationData));
+	TupleDesc	desc;
+	char	   *name;
+	int			natts = 0;
+	Form_pg_attribute attrs[MaxHeapAttributeNumber];
+
+	for (name = strtok(spec, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		const micro_type *type;
+		Form_pg_attribute attr;
+
+		for (type = types; type->name != NULL; type++)
+		{
+			if (strcmp(type->name, name) == 0)
+				break;
+		}
+
+		if (type->name == NULL)
+		{
+			fprintf(stderr, "unknown type \"%s\"\n", name);
+			exit(1);
+		}
+
+		attr = calloc(1, sizeof(FormData_pg_attribute));
+
+		snprintf(NameStr(attr->attname), NAMEDATALEN, "a%d", natts + 1);
+		attr->attnum = natts + 1;
+		attr->attlen = type->attlen;
+		attr->attbyval = type->attbyval;
+		attr->attalign = type->attalign;
+		attr->attstorage = (type->attlen == -1) ? 'x' : 'p';
+
+		attrs[natts++] = attr;
+	}
+
+	/* the attributes are an array of pointers before 11 */
+#if (PG_VERSION_NUM >= 110000)
+	desc = calloc(1, offsetof(struct tupleDesc, attrs) +
+				  natts * sizeof(FormData_pg_attribute));
+	for (int i = 0; i < natts; i++)
+		memcpy(TupleDescAttr(desc, i), attrs[i], sizeof(FormData_pg_attribute));
+#else
+	desc = calloc(1, sizeof(struct tupleDesc));
+	desc->attrs = calloc(natts, sizeof(Form_pg_attribute));
+	memcpy(desc->attrs, attrs, natts * sizeof(Form_pg_attribute));
+#endif
+	desc->natts = natts;
+
+	rel->rd_att = desc;
+	rel->rd_rel = calloc(1, sizeof(FormData_pg_class));
+	rel->rd_rel->relnatts = natts;
+	rel->rd_rel->relam = (check == MICRO_BTREE) ? BTREE_AM_OID : InvalidOid;
+	snprintf(NameStr(rel->rd_rel->relname), NAMEDATALEN, "micro");
+
+	return rel;
+}
+
+/* load the whole file (has to be a multiple of BLCKSZ) */
+static char *
+micro_load(const char *path, int *npages)
+{
+	FILE	   *f = fopen(path, "rb");
+	char	   *data;
+	long		size;
+
+	if (f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if ((size == 0) || (size % BLCKSZ != 0))
+	{
+		fprintf(stderr, "%s: size %ld is not a multiple of %d\n",
+				path, size, BLCKSZ);
+		exit(1);
+	}
+
+	/* the checks expect MAXALIGN-ed pages, just like buffers */
+	if (posix_memalign((void **) &data, BLCKSZ, size) != 0 ||
+		fread(data, 1, size, f) != (size_t) size)
+	{
+		fprintf(stderr, "%s: could not read the file\n", path);
+		exit(1);
+	}
+
+	fclose(f);
+
+	*npages = size / BLCKSZ;
+
+	return data;
+}
+
+/* run the check on a single page */
+static inline uint32
+micro_check(MicroCheck check, Relation rel, char *page, BlockNumber block)
+{
+	heap_check_state state;
+
+	switch (check)
+	{
+		case MICRO_HEADER:
+			return check_page_header((PageHeader) page, block);
+
+		case MICRO_HEAP:
+			/* no TOAST and XID checks (need a server) */
+			memset(&state, 0, sizeof(heap_check_state));
+			return check_page_header((PageHeader) page, block) +
+				check_heap_tuples(rel, (PageHeader) page, page, block, &state);
+
+		case MICRO_BTREE:
+			return btree_check_page(rel, (PageHeader) page, block, page,
+									NULL, NULL);
+	}
+
+	return 0;
+}
+
+static void
+micro_usage(void)
+{
+	fprintf(stderr, "usage: pg_check_micro -t header|heap|btree [-a types] [-l loops] [-p] [-v] file...\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	MicroCheck	check = MICRO_HEADER;
+	char	   *spec = NULL;
+	long		loops = 1000;
+	bool		per_page = false;
+	bool		check_given = false;
+	Relation	rel;
+	int			c;
+
+	while ((c = getopt(argc, argv, "t:a:l:pv")) != -1)
+	{
+		switch (c)
+		{
+			case 't':
+				check_given = true;
+				if (strcmp(optarg, "header") == 0)
+					check = MICRO_HEADER;
+				else if (strcmp(optarg, "heap") == 0)
+					check = MICRO_HEAP;
+				else if (strcmp(optarg, "btree") == 0)
+					check = MICRO_BTREE;
+				else
+					micro_usage();
+				break;
+			case 'a':
+				spec = strdup(optarg);
+				break;
+			case 'l':
+				loops = atol(optarg);
+				break;
+			case 'p':
+				per_page = true;
+				break;
+			case 'v':
+				micro_verbose = true;
+				break;
+			default:
+				micro_usage();
+		}
+	}
+
+	if (!check_given || (optind >= argc) || (loops <= 0))
+		micro_usage();
+
+	/* heap and b-tree checks need to know the attributes */
+	if ((check != MICRO_HEADER) && (spec == NULL))
+	{
+		fprintf(stderr, "attribute types (-a) required for the %s check\n",
+				(check == MICRO_HEAP) ? "heap" : "btree");
+		exit(1);
+	}
+
+	rel = micro_relation(check, (spec) ? spec : "");
+
+	printf("%-40s %8s %10s %8s %14s %14s\n",
+		   "file", "pages", "tuples", "errors", "cycles/page", "cycles/tuple");
+
+	for (; optind < argc; optind++)
+	{
+		const char *path = argv[optind];
+		int			npages;
+		char	   *data = micro_load(path, &npages);
+		uint64	   *ticks = calloc(npages, sizeof(uint64));
+		uint64	   *mins = calloc(npages, sizeof(uint64));
+		uint32	   *nerrs = calloc(npages, sizeof(uint32));
+		uint64		total_ticks = 0;
+		uint64		total_tuples = 0;
+		uint64		total_errs = 0;
+		long		l;
+		int			i;
+
+		/* the first loop also counts the issues (and prints warnings) */
+		for (i = 0; i < npages; i++)
+			nerrs[i] = micro_check(check, rel, data + (Size) i * BLCKSZ, i);
+
+		micro_verbose = false;
+
+		for (l = 0; l < loops; l++)
+		{
+			for (i = 0; i < npages; i++)
+			{
+				uint64		start = micro_ticks();
+				uint64		t;
+
+				(void) micro_check(check, rel, data + (Size) i * BLCKSZ, i);
+
+				t = micro_ticks() - start;
+
+				ticks[i] += t;
+				if ((l == 0) || (t < mins[i]))
+					mins[i] = t;
+			}
+		}
+
+		for (i = 0; i < npages; i++)
+		{
+			int			ntuples = PageGetMaxOffsetNumber(data + (Size) i * BLCKSZ);
+
+			if (per_page)
+				printf("  %-38d %8s %10d %8u %14.1f %14.1f (min %lu)\n",
+					   i, "", ntuples, nerrs[i],
+					   (double) ticks[i] / loops,
+					   (ntuples > 0) ? (double) ticks[i] / loops / ntuples : 0.0,
+					   (unsigned long) mins[i]);
+
+			total_ticks += ticks[i];
+			total_tuples += ntuples;
+			total_errs += nerrs[i];
+		}
+
+		printf("%-40s %8d %10lu %8lu %14.1f %14.1f\n",
+			   path, npages, (unsigned long) total_tuples,
+			   (unsigned long) total_errs,
+			   (double) total_ticks / loops / npages,
+			   (total_tuples > 0) ? (double) total_ticks / loops / total_tuples : 0.0);
+
+		free(ticks);
+		free(mins);
+		free(nerrs);
+		free(data);
+	}
+
+	return 0;
+}
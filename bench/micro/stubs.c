@@ -0,0 +1,220 @@
+/*
+ * Replacements of the server functions used by the page checks, so that the
+ * checks can be linked into a standalone program (see micro.c).
+ *
+ * The messages are not formatted at all (errstart returns false), unless the
+ * verbose mode is requested - then the warnings are printed to stderr. The
+ * XID, TOAST, compression, encoding and datum checks are disabled in the
+ * microbenchmark, so the functions they need only fail loudly.
+ */
+#include "postgres.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "access/transam.h"
+#include "access/xact.h"
+#include "storage/itemptr.h"
+
+#include "compress.h"
+#include "datum.h"
+#include "encoding.h"
+#include "item-bitmap.h"
+#include "toast.h"
+#include "xid.h"
+
+/* print warnings (set by micro.c) */
+bool		micro_verbose = false;
+
+static void
+unsupported(const char *name)
+{
+	fprintf(stderr, "%s is not supported in the microbenchmark\n", name);
+	abort();
+}
+
+#if (PG_VERSION_NUM >= 130000)
+bool
+errstart(int elevel, const char *domain)
+{
+	return micro_verbose && (elevel >= WARNING);
+}
+
+bool
+errstart_cold(int elevel, const char *domain)
+{
+	return errstart(elevel, domain);
+}
+
+void
+errfinish(const char *filename, int lineno, const char *funcname)
+{
+	fputc('\n', stderr);
+}
+#else
+bool
+errstart(int elevel, const char *filename, int lineno,
+		 const char *funcname, const char *domain)
+{
+	return micro_verbose && (elevel >= WARNING);
+}
+
+void
+errfinish(int dummy,...)
+{
+	fputc('\n', stderr);
+}
+#endif
+
+int
+errmsg(const char *fmt,...)
+{
+	va_list		args;
+
+	fprintf(stderr, "WARNING:  ");
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+
+	return 0;
+}
+
+#if (PG_VERSION_NUM < 120000)
+void
+elog_start(const char *filename, int lineno, const char *funcname)
+{
+}
+
+void
+elog_finish(int elevel, const char *fmt,...)
+{
+}
+#endif
+
+#ifdef USE_ASSERT_CHECKING
+#if (PG_VERSION_NUM >= 160000)
+void
+ExceptionalCondition(const char *conditionName, const char *fileName,
+					 int lineNumber)
+#else
+void
+ExceptionalCondition(const char *conditionName, const char *errorType,
+					 const char *fileName, int lineNumber)
+#endif
+{
+	fprintf(stderr, "TRAP: %s (%s:%d)\n", conditionName, fileName, lineNumber);
+	abort();
+}
+#endif
+
+/* same as in transam.c */
+bool
+TransactionIdPrecedes(TransactionId id1, TransactionId id2)
+{
+	int32		diff;
+
+	if (!TransactionIdIsNormal(id1) || !TransactionIdIsNormal(id2))
+		return (id1 < id2);
+
+	diff = (int32) (id1 - id2);
+	return (diff < 0);
+}
+
+/* there is no current transaction */
+bool
+TransactionIdIsCurrentTransactionId(TransactionId xid)
+{
+	return false;
+}
+
+#if (PG_VERSION_NUM >= 130000)
+/* same as in itemptr.c */
+int32
+ItemPointerCompare(ItemPointer arg1, ItemPointer arg2)
+{
+	BlockNumber b1 = ItemPointerGetBlockNumberNoCheck(arg1);
+	BlockNumber b2 = ItemPointerGetBlockNumberNoCheck(arg2);
+
+	if (b1 < b2)
+		return -1;
+	else if (b1 > b2)
+		return 1;
+	else if (ItemPointerGetOffsetNumberNoCheck(arg1) <
+			 ItemPointerGetOffsetNumberNoCheck(arg2))
+		return -1;
+	else if (ItemPointerGetOffsetNumberNoCheck(arg1) >
+			 ItemPointerGetOffsetNumberNoCheck(arg2))
+		return 1;
+	else
+		return 0;
+}
+#endif
+
+/* the checks are called without a bitmap */
+void
+bitmap_set(item_bitmap * bitmap, BlockNumber page, int item)
+{
+	unsupported("bitmap_set");
+}
+
+bool
+bitmap_get(item_bitmap * bitmap, BlockNumber page, int item)
+{
+	unsupported("bitmap_get");
+	return false;
+}
+
+/* XID, TOAST, compression, encoding and datum checks are disabled */
+uint32
+check_tuple_xids(xid_check * xids, HeapTupleHeader tupheader,
+				 BlockNumber block, int offnum)
+{
+	unsupported("check_tuple_xids");
+	return 0;
+}
+
+CheckXidStatus
+xid_get_status(xid_check * xids, TransactionId xid)
+{
+	unsupported("xid_get_status");
+	return CHECK_XID_ABORTED;
+}
+
+uint32
+toast_check_add(toast_check * toast, struct varatt_external *pointer,
+				BlockNumber block, OffsetNumber offnum)
+{
+	unsupported("toast_check_add");
+	return 0;
+}
+
+int32
+compress_check_decompress(compress_check * compress, const char *data,
+						  int32 size, int32 rawsize)
+{
+	unsupported("compress_check_decompress");
+	return -1;
+}
+
+bool
+encoding_check_value(encoding_check * encoding, const char *data, int len)
+{
+	unsupported("encoding_check_value");
+	return false;
+}
+
+const char *
+GetDatabaseEncodingName(void)
+{
+	unsupported("GetDatabaseEncodingName");
+	return NULL;
+}
+
+const char *
+datum_check_value(datum_check * datums, int attnum, const char *data, int len)
+{
+	unsupported("datum_check_value");
+	return NULL;
+}
@@ -0,0 +1,184 @@
+#!/usr/bin/env bash
+#
+# Throughput benchmark of pg_check - builds tables of various sizes, tuple
+# widths, HOT densities and numbers of indexes, and measures duration of
+# pg_check_table / pg_check_index in each mode.
+#
+# Needs a running server with pg_check installed (make install). Connection
+# is determined by the usual libpq variables (PGHOST, PGDATABASE, ...). The
+# peak memory is only measured when the server runs on the same machine (and
+# /proc/<pid>/status of the backends is readable).
+#
+# The results are written as CSV, one row per run:
+#
+#   git, server, table, rows, width, hot, indexes, relation, function, mode,
+#   run, pages, tuples, errors, seconds, pages_per_sec, tuples_per_sec,
+#   peak_rss_kb
+#
+# peak_rss_kb is the increase of the backend's peak RSS during the check (each
+# run uses a new connection). It includes shared buffers touched by the check,
+# but those are limited by the bulk-read ring buffer.
+#
+# Options (environment variables):
+#
+#   BENCH_ROWS      numbers of rows (default "100000 1000000")
+#   BENCH_WIDTHS    bytes of padding in each row (default "16 256")
+#   BENCH_HOT       fractions of rows with HOT updates (default "0 0.5")
+#   BENCH_INDEXES   numbers of indexes (1-4, default "1 4")
+#   BENCH_MODES     table check modes (default all of them, see below)
+#   BENCH_RUNS      runs of each check (default 3)
+#   BENCH_OUTPUT    output file (default bench-results.csv)
+#   BENCH_KEEP      keep the tables after the benchmark (default 0)
+#
+# Table check modes:
+#
+#   table       pg_check_table(t, false, false)
+#   indexes     pg_check_table(t, true, false)
+#   bitmap      pg_check_table(t, true, true)
+#   fingerprint pg_check_table(t, true, true), cross_check_method = fingerprint
+#   online      pg_check_table(t, true, true, online := true)
+#   quick       pg_check_table(t, false, false, quick := true)
+#   sample      pg_check_table(t, false, false, sample_fraction := 0.01)
+#   index       pg_check_index(i) for each index of the table
+
+set -e
+
+ROWS=${BENCH_ROWS:-"100000 1000000"}
+WIDTHS=${BENCH_WIDTHS:-"16 256"}
+HOT=${BENCH_HOT:-"0 0.5"}
+INDEXES=${BENCH_INDEXES:-"1 4"}
+MODES=${BENCH_MODES:-"table indexes bitmap fingerprint online quick sample index"}
+RUNS=${BENCH_RUNS:-3}
+OUTPUT=${BENCH_OUTPUT:-bench-results.csv}
+KEEP=${BENCH_KEEP:-0}
+
+PSQL="psql -X -q -A -t -v ON_ERROR_STOP=1"
+
+GIT=$(git -C "$(dirname "$0")" rev-parse --short HEAD 2>/dev/null || echo "unknown")
+SERVER=$($PSQL -c "SHOW server_version_num")
+
+$PSQL -c "CREATE EXTENSION IF NOT EXISTS pg_check"
+
+echo "git,server,table,rows,width,hot,indexes,relation,function,mode,run,pages,tuples,errors,seconds,pages_per_sec,tuples_per_sec,peak_rss_kb" > "$OUTPUT"
+
+# build the table (and indexes), print the name
+create_table() {
+	local rows=$1 width=$2 hot=$3 nindexes=$4
+	local table="bench_${rows}_${width}_${hot/./_}_${nindexes}"
+	local columns=("id" "a" "b" "md5(c)")
+	local i
+
+	# leave free space on pages for the HOT updates
+	$PSQL <<EOF
+DROP TABLE IF EXISTS $table;
+CREATE TABLE $table (id int, a int, b int, c text, pad text) WITH (fillfactor = 80);
+INSERT INTO $table SELECT i, mod(i, 1000), (random() * 1000000)::int, md5(i::text), repeat('x', $width)
+  FROM generate_series(1, $rows) s(i);
+EOF
+
+	for i in $(seq 1 "$nindexes"); do
+		$PSQL -c "CREATE INDEX ${table}_idx_$i ON $table (${columns[$((i - 1))]})"
+	done
+
+	# freeze the table first, so that the quick mode can skip pages
+	$PSQL -c "VACUUM (FREEZE, ANALYZE) $table"
+
+	# HOT updates (only the non-indexed column changes)
+	if [ "$hot" != "0" ]; then
+		$PSQL -c "UPDATE $table SET pad = repeat('y', $width) WHERE random() < $hot"
+		$PSQL -c "ANALYZE $table"
+	fi
+
+	echo "$table"
+}
+
+# run a single check in a new connection, print "[hwm hwm] errors seconds"
+# (\! does not interpolate psql variables, so pass the PID through env)
+run_check() {
+	local setup=$1 query=$2
+
+	$PSQL <<EOF
+SET client_min_messages = error;
+$setup
+SELECT pg_backend_pid() AS pid \gset
+\setenv BENCH_PID :pid
+\! awk '/^VmHWM/ { printf "%s ", \$2 }' /proc/\$BENCH_PID/status 2>/dev/null || true
+SELECT extract(epoch FROM clock_timestamp()) AS start \gset
+SELECT ($query) AS errors \gset
+SELECT :errors || ' ' || round((extract(epoch FROM clock_timestamp()) - :start)::numeric, 6) AS result \gset
+\! awk '/^VmHWM/ { printf "%s ", \$2 }' /proc/\$BENCH_PID/status 2>/dev/null || true
+\echo :result
+EOF
+}
+
+# run the check repeatedly, append the results to the output file
+measure() {
+	local table=$1 rows=$2 width=$3 hot=$4 nindexes=$5
+	local relation=$6 function=$7 mode=$8 setup=$9 query=${10}
+	local pages tuples run out hwm_before hwm_after errors seconds rss
+
+	pages=$($PSQL -c "SELECT pg_relation_size('$relation') / current_setting('block_size')::int")
+	tuples=$($PSQL -c "SELECT greatest(reltuples, 0)::bigint FROM pg_class WHERE oid = '$relation'::regclass")
+
+	for run in $(seq 1 "$RUNS"); do
+		out=$(run_check "$setup" "$query")
+
+		# without /proc, there are just the two values
+		set -- $out
+		if [ $# -eq 4 ]; then
+			hwm_before=$1 errors=$3 seconds=$4 hwm_after=$2
+			rss=$((hwm_after - hwm_before))
+		else
+			errors=$1 seconds=$2 rss=""
+		fi
+
+		echo "$GIT,$SERVER,$table,$rows,$width,$hot,$nindexes,$relation,$function,$mode,$run,$pages,$tuples,$errors,$seconds,$(awk "BEGIN { printf \"%.1f\", ($seconds > 0) ? $pages / $seconds : 0 }"),$(awk "BEGIN { printf \"%.1f\", ($seconds > 0) ? $tuples / $seconds : 0 }"),$rss" >> "$OUTPUT"
+
+		echo "$relation $mode run $run: $seconds s ($errors errors)"
+	done
+}
+
+for rows in $ROWS; do
+for width in $WIDTHS; do
+for hot in $HOT; do
+for nindexes in $INDEXES; do
+
+	table=$(create_table "$rows" "$width" "$hot" "$nindexes" | tail -n 1)
+
+	for mode in $MODES; do
+		setup=""
+		case $mode in
+			table)       query="pg_check_table('$table', false, false)" ;;
+			indexes)     query="pg_check_table('$table', true, false)" ;;
+			bitmap)      query="pg_check_table('$table', true, true)"
+			             setup="SET pg_check.cross_check_method = bitmap;" ;;
+			fingerprint) query="pg_check_table('$table', true, true)"
+			             setup="SET pg_check.cross_check_method = fingerprint;" ;;
+			online)      query="pg_check_table('$table', true, true, online := true)" ;;
+			quick)       query="pg_check_table('$table', false, false, quick := true)" ;;
+			sample)      query="pg_check_table('$table', false, false, sample_fraction := 0.01)" ;;
+			index)
+				for index in $($PSQL -c "SELECT indexrelid::regclass FROM pg_index WHERE indrelid = '$table'::regclass ORDER BY 1"); do
+					measure "$table" "$rows" "$width" "$hot" "$nindexes" "$index" \
+						pg_check_index index "" "pg_check_index('$index')"
+				done
+				continue ;;
+			*)
+				echo "unknown mode: $mode" >&2
+				exit 1 ;;
+		esac
+
+		measure "$table" "$rows" "$width" "$hot" "$nindexes" "$table" \
+			pg_check_table "$mode" "$setup" "$query"
+	done
+
+	if [ "$KEEP" = "0" ]; then
+		$PSQL -c "DROP TABLE $table"
+	fi
+
+done
+done
+done
+done
+
+echo "results written to $OUTPUT"
@@ -0,0 +1,80 @@
+-- Adjust this setting to control where the objects get created.
+SET search_path = public;
+
+--
+-- pg_check_table()
+--
+
+CREATE OR REPLACE FUNCTION pg_check_table(table_relation regclass, check_indexes bool default true, cross_check bool default true, block_start bigint default null, block_end bigint default null, quick bool default false, sample_fraction float8 default null, sample_blocks bigint default null, online bool default false)
+RETURNS int4
+AS '$libdir/pg_check', 'pg_check_table'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pg_check_table(regclass, bool, bool, bigint, bigint, bool, float8, bigint, bool) IS 'checks consistency of a part of the table (range of pages) and optionally all indexes on it';
+
+--
+-- pg_check_index()
+--
+
+CREATE OR REPLACE FUNCTION pg_check_index(index_relation regclass, block_start bigint default null, block_end bigint default null, sample_fraction float8 default null, sample_blocks bigint default null)
+RETURNS int4
+AS '$libdir/pg_check', 'pg_check_index'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pg_check_index(regclass, bigint, bigint, float8, bigint) IS 'checks consistency of a part of the index (range of pages)';
+
+--
+-- pg_check_partitions()
+--
+
+CREATE OR REPLACE FUNCTION pg_check_partitions(table_relation regclass, check_indexes bool default true, cross_check bool default true, quick bool default false, online bool default false, OUT partition regclass, OUT blocks bigint, OUT errors int4)
+RETURNS SETOF record
+AS '$libdir/pg_check', 'pg_check_partitions'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pg_check_partitions(regclass, bool, bool, bool, bool) IS 'checks consistency of all partitions of a partitioned table (in parallel), returns issues found in each partition';
+
+--
+-- pg_check_instrumentation()
+--
+
+CREATE OR REPLACE FUNCTION pg_check_instrumentation(OUT read_time float8, OUT lock_time float8, OUT copy_time float8, OUT heap_time float8, OUT toast_time float8, OUT index_time float8, OUT bitmap_time float8, OUT compare_time float8, OUT heap_pages bigint, OUT index_pages bigint, OUT buffer_hits bigint, OUT buffer_reads bigint, OUT bytes_read bigint, OUT bitmap_bytes bigint)
+RETURNS record
+AS '$libdir/pg_check', 'pg_check_instrumentation'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pg_check_instrumentation() IS 'returns per-phase timing (in milliseconds) and I/O statistics of the last check (with pg_check.instrument enabled)';
+
+--
+-- pg_check_stats(), pg_stat_check
+--
+
+CREATE OR REPLACE FUNCTION pg_check_stats(OUT dbid oid, OUT relid oid, OUT checks bigint, OUT last_check timestamptz, OUT last_time float8, OUT last_pages bigint, OUT last_errors bigint, OUT total_time float8, OUT total_pages bigint, OUT total_errors bigint)
+RETURNS SETOF record
+AS '$libdir/pg_check', 'pg_check_stats'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pg_check_stats() IS 'returns cumulative statistics of checks of all relations (needs shared_preload_libraries)';
+
+CREATE OR REPLACE FUNCTION pg_check_stats_reset()
+RETURNS void
+AS '$libdir/pg_check', 'pg_check_stats_reset'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pg_check_stats_reset() IS 'discards cumulative statistics of checks';
+
+REVOKE ALL ON FUNCTION pg_check_stats_reset() FROM PUBLIC;
+
+-- relation names are only known for the current database
+CREATE VIEW pg_stat_check AS
+SELECT s.dbid, d.datname, s.relid, n.nspname AS schemaname, c.relname, c.relkind,
+       s.checks, s.last_check, s.last_time, s.last_pages, s.last_errors,
+       s.last_pages * 1000 / nullif(s.last_time, 0) AS last_pages_per_sec,
+       s.total_time, s.total_pages, s.total_errors,
+       s.total_pages * 1000 / nullif(s.total_time, 0) AS avg_pages_per_sec
+  FROM pg_check_stats() s
+  LEFT JOIN pg_database d ON (d.oid = s.dbid)
+  LEFT JOIN pg_class c ON (c.oid = s.relid AND d.datname = current_database())
+  LEFT JOIN pg_namespace n ON (n.oid = c.relnamespace);
+
+COMMENT ON VIEW pg_stat_check IS 'cumulative statistics of checks of relations (last check, duration, pages, issues, throughput)';
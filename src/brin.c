@@ -0,0 +1,413 @@
+#include "postgres.h"
+
+#include "brin.h"
+
+#if (PG_VERSION_NUM >= 90500)
+
+#include "access/brin.h"
+#include "access/brin_page.h"
+#include "access/genam.h"
+#include "access/htup.h"
+#include "access/htup_details.h"
+#include "catalog/pg_am.h"
+#include "storage/bufmgr.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+#include "common.h"
+
+static void brin_load_summary(brin_check * brin, BlockNumber rangeStart);
+static uint32 brin_check_metapage(char *raw_page, BlockNumber block);
+static uint32 brin_check_revmap_page(Relation rel, char *raw_page,
+					   BlockNumber block);
+static uint32 brin_check_regular_page(Relation rel, PageHeader header,
+						char *raw_page, BlockNumber block);
+
+/* prepare the state for verifying summaries of the BRIN index */
+brin_check *
+brin_check_init(Relation heaprel, Relation indexrel)
+{
+	brin_check *brin;
+	int			keyno;
+
+	Assert(indexrel->rd_rel->relam == BRIN_AM_OID);
+
+	brin = (brin_check *) palloc0(sizeof(brin_check));
+
+	brin->heaprel = heaprel;
+	brin->indexrel = indexrel;
+	brin->bdesc = brin_build_desc(indexrel);
+	brin->buf = InvalidBuffer;
+
+#if (PG_VERSION_NUM >= 100000)
+	brin->revmap = brinRevmapInitialize(indexrel, &brin->pagesPerRange, NULL);
+#else
+	brin->revmap = brinRevmapInitialize(indexrel, &brin->pagesPerRange);
+#endif
+
+	brin->expr = index_expr_init(heaprel, indexrel);
+
+	for (keyno = 0; keyno < brin->bdesc->bd_tupdesc->natts; keyno++)
+		brin->addValue[keyno] = index_getprocinfo(indexrel, keyno + 1,
+												  BRIN_PROCNUM_ADDVALUE);
+
+	brin->rangecxt = AllocSetContextCreate(CurrentMemoryContext,
+										   "pg_check BRIN range",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+
+	return brin;
+}
+
+/* release the state, close the index */
+void
+brin_check_free(brin_check * brin)
+{
+	if (BufferIsValid(brin->buf))
+		ReleaseBuffer(brin->buf);
+
+	brinRevmapTerminate(brin->revmap);
+	brin_free_desc(brin->bdesc);
+	index_expr_free(brin->expr);
+	MemoryContextDelete(brin->rangecxt);
+
+	index_close(brin->indexrel, AccessShareLock);
+
+	pfree(brin);
+}
+
+/*
+ * brin_check_heap_page
+ *		Verify the heap page is consistent with the BRIN summary.
+ *
+ * The stored summary may be wider than the summary computed from the heap
+ * (deleted values are not removed from it until the range gets summarized
+ * again), so we can't simply recompute it and compare. Instead, we add the
+ * values from the heap to the stored summary, using the opclass addValue
+ * procedure - which tells us if the summary had to be modified. If it did,
+ * the value was not covered by the summary, and queries may miss the row.
+ *
+ * The modified summary is kept for the rest of the range, so each value
+ * extending the summary is reported only once.
+ *
+ * We only consider tuples that are certainly live - dead tuples are not
+ * necessarily covered, if the range was summarized after they died.
+ */
+uint32
+brin_check_heap_page(brin_check * brin, heap_check_state * state,
+					 BlockNumber block, char *raw_page)
+{
+	uint32		nerrs = 0;
+	BlockNumber rangeStart = (block / brin->pagesPerRange) * brin->pagesPerRange;
+	OffsetNumber maxoff = PageGetMaxOffsetNumber(raw_page);
+	OffsetNumber offnum;
+	Datum		values[INDEX_MAX_KEYS];
+	bool		isnull[INDEX_MAX_KEYS];
+
+	if (!brin->hasRange || (brin->rangeStart != rangeStart))
+		brin_load_summary(brin, rangeStart);
+
+	/* range not summarized yet (or being summarized right now) */
+	if (brin->summary == NULL)
+		return nerrs;
+
+	for (offnum = FirstOffsetNumber; offnum <= maxoff; offnum++)
+	{
+		ItemId		lp = PageGetItemId(raw_page, offnum);
+		HeapTupleData tuple;
+		MemoryContext oldcxt;
+		int			keyno;
+
+		if (!ItemIdIsNormal(lp))
+			continue;
+
+		tuple.t_data = (HeapTupleHeader) PageGetItem(raw_page, lp);
+		tuple.t_len = ItemIdGetLength(lp);
+		tuple.t_tableOid = RelationGetRelid(brin->heaprel);
+		ItemPointerSet(&tuple.t_self, block, offnum);
+
+		if (!heap_tuple_is_live(state, tuple.t_data))
+			continue;
+
+		/* not matching the index predicate */
+		if (!index_expr_values(brin->expr, &tuple, values, isnull))
+			continue;
+
+		/* the summary may get extended, so do it in the range context */
+		oldcxt = MemoryContextSwitchTo(brin->rangecxt);
+
+		for (keyno = 0; keyno < brin->bdesc->bd_tupdesc->natts; keyno++)
+		{
+			BrinValues *bval = &brin->summary->bt_columns[keyno];
+
+			if (DatumGetBool(FunctionCall4Coll(brin->addValue[keyno],
+											   brin->indexrel->rd_indcollation[keyno],
+											   PointerGetDatum(brin->bdesc),
+											   PointerGetDatum(bval),
+											   values[keyno],
+											   BoolGetDatum(isnull[keyno]))))
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] value of column %d not covered by summary of range %u in index \"%s\"",
+								block, offnum, (keyno + 1), rangeStart,
+								RelationGetRelationName(brin->indexrel))));
+				nerrs++;
+			}
+		}
+
+		MemoryContextSwitchTo(oldcxt);
+	}
+
+	return nerrs;
+}
+
+/* load the summary for the range starting at the given heap block */
+static void
+brin_load_summary(brin_check * brin, BlockNumber rangeStart)
+{
+	BrinTuple  *tup;
+	OffsetNumber off;
+	Size		size;
+	MemoryContext oldcxt;
+
+	MemoryContextReset(brin->rangecxt);
+
+	brin->hasRange = true;
+	brin->rangeStart = rangeStart;
+	brin->summary = NULL;
+
+#if (PG_VERSION_NUM >= 100000)
+	tup = brinGetTupleForHeapBlock(brin->revmap, rangeStart, &brin->buf,
+								   &off, &size, BUFFER_LOCK_SHARE, NULL);
+#else
+	tup = brinGetTupleForHeapBlock(brin->revmap, rangeStart, &brin->buf,
+								   &off, &size, BUFFER_LOCK_SHARE);
+#endif
+
+	/* not summarized */
+	if (tup == NULL)
+		return;
+
+	/* summarization in progress (can't happen while the table is locked) */
+	if (BrinTupleIsPlaceholder(tup))
+	{
+		LockBuffer(brin->buf, BUFFER_LOCK_UNLOCK);
+		return;
+	}
+
+	oldcxt = MemoryContextSwitchTo(brin->rangecxt);
+
+#if (PG_VERSION_NUM >= 110000)
+	tup = brin_copy_tuple(tup, size, NULL, NULL);
+	LockBuffer(brin->buf, BUFFER_LOCK_UNLOCK);
+	brin->summary = brin_deform_tuple(brin->bdesc, tup, NULL);
+#else
+	tup = brin_copy_tuple(tup, size);
+	LockBuffer(brin->buf, BUFFER_LOCK_UNLOCK);
+	brin->summary = brin_deform_tuple(brin->bdesc, tup);
+#endif
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * brin_check_page
+ *		Check a BRIN page (metapage, revmap or regular page).
+ *
+ * The BRIN index is not cross-checked with the heap using the bitmap (there
+ * are no TIDs), the summaries are verified during the heap pass instead.
+ */
+uint32
+brin_check_page(Relation rel, PageHeader header, BlockNumber block,
+				char *raw_page, item_bitmap * bitmap, void *state)
+{
+	uint32		nerrs = 0;
+
+	/* make sure we only ever call this for BRIN indexes */
+	Assert(rel->rd_rel->relam == BRIN_AM_OID);
+
+	/* check basic page header */
+	nerrs += check_page_header(header, block);
+
+	if (PageIsNew(raw_page))
+		return nerrs;
+
+	/* check there's enough space for index-relevant data */
+	if (PageGetSpecialSize(raw_page) != MAXALIGN(sizeof(BrinSpecialSpace)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] special space has unexpected size %d (expected %d)",
+						block, (int) PageGetSpecialSize(raw_page),
+						(int) MAXALIGN(sizeof(BrinSpecialSpace)))));
+		return ++nerrs;
+	}
+
+	/* the metapage is always the first block */
+	if (block == BRIN_METAPAGE_BLKNO)
+		return nerrs + brin_check_metapage(raw_page, block);
+
+	switch (BrinPageType(raw_page))
+	{
+		case BRIN_PAGETYPE_REVMAP:
+			nerrs += brin_check_revmap_page(rel, raw_page, block);
+			break;
+
+		case BRIN_PAGETYPE_REGULAR:
+			nerrs += brin_check_regular_page(rel, header, raw_page, block);
+			break;
+
+		default:
+			ereport(WARNING,
+					(errmsg("[%d] invalid page type 0x%04X",
+							block, BrinPageType(raw_page))));
+			nerrs++;
+	}
+
+	return nerrs;
+}
+
+/* checks the metapage (magic, version, pages per range) */
+static uint32
+brin_check_metapage(char *raw_page, BlockNumber block)
+{
+	uint32		nerrs = 0;
+	BrinMetaPageData *meta = (BrinMetaPageData *) PageGetContents(raw_page);
+
+	ereport(DEBUG2,
+			(errmsg("[%d] is a meta-page [magic=0x%08X, version=%u, pages per range=%u, last revmap page=%u]",
+					block, meta->brinMagic, meta->brinVersion,
+					meta->pagesPerRange, meta->lastRevmapPage)));
+
+	if (BrinPageType(raw_page) != BRIN_PAGETYPE_META)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage has invalid page type 0x%04X",
+						block, BrinPageType(raw_page))));
+		nerrs++;
+	}
+
+	if (meta->brinMagic != BRIN_META_MAGIC)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid magic number 0x%08X (should be 0x%08X)",
+						block, meta->brinMagic, BRIN_META_MAGIC)));
+		nerrs++;
+	}
+
+	if (meta->brinVersion != BRIN_CURRENT_VERSION)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid version %u (should be %d)",
+						block, meta->brinVersion, BRIN_CURRENT_VERSION)));
+		nerrs++;
+	}
+
+	if (meta->pagesPerRange == 0)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid pages per range %u",
+						block, meta->pagesPerRange)));
+		nerrs++;
+	}
+
+	return nerrs;
+}
+
+/* checks the revmap page (TIDs of summary tuples, or invalid) */
+static uint32
+brin_check_revmap_page(Relation rel, char *raw_page, BlockNumber block)
+{
+	uint32		nerrs = 0;
+	RevmapContents *contents = (RevmapContents *) PageGetContents(raw_page);
+	BlockNumber nblocks = RelationGetNumberOfBlocks(rel);
+	int			i;
+
+	for (i = 0; i < REVMAP_PAGE_MAXITEMS; i++)
+	{
+		ItemPointer tid = &contents->rm_tids[i];
+		BlockNumber target;
+
+		/* range not summarized */
+		if (!ItemPointerIsValid(tid))
+			continue;
+
+		target = ItemPointerGetBlockNumber(tid);
+
+		if ((target == BRIN_METAPAGE_BLKNO) || (target >= nblocks))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] revmap item points to block %u (not within [1, %u))",
+							block, (i + 1), target, nblocks)));
+			nerrs++;
+		}
+	}
+
+	return nerrs;
+}
+
+/* checks the regular page (summary tuples) */
+static uint32
+brin_check_regular_page(Relation rel, PageHeader header, char *raw_page,
+						BlockNumber block)
+{
+	uint32		nerrs = 0;
+	int			ntuples = PageGetMaxOffsetNumber(raw_page);
+	BlockNumber pagesPerRange = BrinGetPagesPerRange(rel);
+	int			i;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		ItemId		lp = &header->pd_linp[i];
+		BrinTuple  *tup;
+
+		/* removed summaries leave unused items behind */
+		if (lp->lp_flags == LP_UNUSED)
+			continue;
+
+		if (lp->lp_flags != LP_NORMAL)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] item is not LP_NORMAL (flag %u)",
+							block, (i + 1), lp->lp_flags)));
+			nerrs++;
+			continue;
+		}
+
+		if ((lp->lp_off < header->pd_upper) ||
+			(lp->lp_off + lp->lp_len > header->pd_special) ||
+			(lp->lp_len < SizeOfBrinTuple))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] item (%d,%d) not within [upper %d, special %d]",
+							block, (i + 1), lp->lp_off, lp->lp_len,
+							header->pd_upper, header->pd_special)));
+			nerrs++;
+			continue;
+		}
+
+		tup = (BrinTuple *) (raw_page + lp->lp_off);
+
+		if (BrinTupleDataOffset(tup) > lp->lp_len)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] data offset %zu exceeds item length %d",
+							block, (i + 1), BrinTupleDataOffset(tup),
+							lp->lp_len)));
+			nerrs++;
+		}
+
+		/* summaries are for whole ranges */
+		if (tup->bt_blkno % pagesPerRange != 0)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] summary for block %u, not a start of a range (%u pages per range)",
+							block, (i + 1), tup->bt_blkno, pagesPerRange)));
+			nerrs++;
+		}
+	}
+
+	return nerrs;
+}
+
+#endif							/* PG_VERSION_NUM >= 90500 */
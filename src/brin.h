@@ -0,0 +1,64 @@
+#ifndef BRIN_CHECK_H
+#define BRIN_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "heap.h"
+#include "item-bitmap.h"
+
+/* BRIN indexes were introduced in 9.5 */
+#if (PG_VERSION_NUM >= 90500)
+
+#include "access/brin_internal.h"
+#include "access/brin_revmap.h"
+#include "access/brin_tuple.h"
+
+#include "index-expr.h"
+
+/* state for verifying BRIN summaries during the heap pass */
+typedef struct brin_check
+{
+	Relation	heaprel;
+	Relation	indexrel;
+
+	BrinDesc   *bdesc;
+	BrinRevmap *revmap;
+	BlockNumber pagesPerRange;
+	Buffer		buf;			/* revmap/regular page (kept pinned) */
+
+	index_expr_state *expr;		/* computes index values from heap tuples */
+	FmgrInfo   *addValue[INDEX_MAX_KEYS];
+
+	/* summary of the current range (NULL if not summarized) */
+	bool		hasRange;
+	BlockNumber rangeStart;
+	BrinMemTuple *summary;
+	MemoryContext rangecxt;		/* reset for each range */
+}			brin_check;
+
+/* Prepares state for verifying summaries of the BRIN index (which needs to
+ * be opened and locked by the caller, and gets closed by brin_check_free).
+ */
+brin_check *brin_check_init(Relation heaprel, Relation indexrel);
+
+/* Releases the state, and closes the index. */
+void		brin_check_free(brin_check * brin);
+
+/* Checks that values of live tuples on the heap page are consistent with
+ * the summary of the block range the page belongs to. Expects the heap
+ * pages to be passed in sequential order.
+ *
+ * Returns number of issues found.
+ */
+uint32		brin_check_heap_page(brin_check * brin, heap_check_state * state,
+								 BlockNumber block, char *raw_page);
+
+/* Checks a BRIN index page (metapage, revmap or regular page). */
+uint32		brin_check_page(Relation rel, PageHeader header, BlockNumber block,
+							char *raw_page, item_bitmap * bitmap,
+							void *state);
+
+#endif							/* PG_VERSION_NUM >= 90500 */
+
+#endif							/* BRIN_CHECK_H */
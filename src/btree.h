@@ -0,0 +1,19 @@
+#ifndef BTREE_CHECK_H
+#define BTREE_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "item-bitmap.h"
+
+/* Checks a b-tree index page (metapage, internal or leaf page). When a
+ * bitmap is supplied, the heap TIDs from leaf pages are added to it, for
+ * the cross-check with the table.
+ *
+ * Returns number of issues found.
+ */
+uint32		btree_check_page(Relation rel, PageHeader header, BlockNumber block,
+							 char *raw_page, item_bitmap * bitmap,
+							 void *state);
+
+#endif							/* BTREE_CHECK_H */
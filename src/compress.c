@@ -0,0 +1,92 @@
+#include "postgres.h"
+
+#if (PG_VERSION_NUM >= 90500)
+#include "common/pg_lzcompress.h"
+#endif
+#include "utils/memutils.h"
+
+#include "compress.h"
+
+/* initial size of the buffers (grow as needed) */
+#define COMPRESS_BUFFER_INITIAL		(64 * 1024)
+
+static char *compress_buffer(char **buffer, Size *size, Size needed);
+
+/* allocate the state, with the buffers */
+compress_check *
+compress_check_init(void)
+{
+	compress_check *compress;
+
+	compress = (compress_check *) palloc0(sizeof(compress_check));
+
+	compress->rawsize = COMPRESS_BUFFER_INITIAL;
+	compress->raw = (char *) palloc(compress->rawsize);
+
+	compress->datasize = COMPRESS_BUFFER_INITIAL;
+	compress->data = (char *) palloc(compress->datasize);
+
+	return compress;
+}
+
+/* free the buffers */
+void
+compress_check_free(compress_check * compress)
+{
+	Assert(compress != NULL);
+
+	ereport(DEBUG1,
+			(errmsg("decompressed " UINT64_FORMAT " values (buffers %zu / %zu bytes)",
+					compress->nvalues, compress->rawsize, compress->datasize)));
+
+	pfree(compress->raw);
+	pfree(compress->data);
+	pfree(compress);
+}
+
+/* buffer for a compressed TOAST value */
+char *
+compress_check_buffer(compress_check * compress, Size size)
+{
+	return compress_buffer(&compress->data, &compress->datasize, size);
+}
+
+/* decompress the data into the pooled buffer, return the raw length */
+int32
+compress_check_decompress(compress_check * compress, const char *data,
+						  int32 size, int32 rawsize)
+{
+	compress->nvalues++;
+
+#if (PG_VERSION_NUM >= 90500)
+	compress_buffer(&compress->raw, &compress->rawsize, rawsize);
+
+	return pglz_decompress(data, size, compress->raw, rawsize);
+#else
+	/* no way to detect corrupted data in older pglz_decompress */
+	return rawsize;
+#endif
+}
+
+/*
+ * Make sure the buffer has at least the requested size. The buffer grows at
+ * least twice, so that a series of slightly larger values does not cause
+ * a reallocation for each of them. The contents are not preserved.
+ */
+static char *
+compress_buffer(char **buffer, Size *size, Size needed)
+{
+	/* the callers validate the sizes, so this would be a bug */
+	if (needed > MaxAllocSize)
+		elog(ERROR, "invalid decompression buffer size %zu", needed);
+
+	if (needed <= *size)
+		return *buffer;
+
+	*size = Min(Max(needed, 2 * (*size)), MaxAllocSize);
+
+	pfree(*buffer);
+	*buffer = (char *) palloc(*size);
+
+	return *buffer;
+}
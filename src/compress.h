@@ -0,0 +1,45 @@
+#ifndef COMPRESS_CHECK_H
+#define COMPRESS_CHECK_H
+
+#include "postgres.h"
+
+/*
+ * Per-scan state for decompressing values (inline compressed values and
+ * compressed TOAST values). The buffers are reused for all the values, and
+ * only grow when a larger value is found, so there's no palloc per value.
+ */
+typedef struct compress_check
+{
+	char	   *raw;			/* decompressed data */
+	Size		rawsize;
+
+	char	   *data;			/* compressed TOAST value (assembled chunks) */
+	Size		datasize;
+
+	uint64		nvalues;		/* number of values decompressed */
+}			compress_check;
+
+/* Allocates the state (with buffers of the initial size). */
+compress_check *compress_check_init(void);
+
+/* Releases the state, including the buffers. */
+void		compress_check_free(compress_check * compress);
+
+/* Returns the buffer for assembling a compressed TOAST value (of the given
+ * size), enlarging it if needed. The contents are not preserved. */
+char	   *compress_check_buffer(compress_check * compress, Size size);
+
+/* Decompresses the pglz data into the pooled buffer.
+ *
+ * - data : compressed data (without the varlena header and raw size)
+ * - size : length of the compressed data
+ * - rawsize : expected length of the decompressed data
+ *
+ * Returns length of the decompressed data, or -1 if the compressed data are
+ * corrupted (on 9.4 and older the data are not checked, returns rawsize).
+ */
+int32		compress_check_decompress(compress_check * compress,
+									  const char *data, int32 size,
+									  int32 rawsize);
+
+#endif							/* COMPRESS_CHECK_H */
@@ -0,0 +1,601 @@
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "utils/array.h"
+#if (PG_VERSION_NUM >= 90400)
+#include "utils/jsonb.h"
+#endif
+#include "utils/lsyscache.h"
+#if (PG_VERSION_NUM >= 90200)
+#include "utils/rangetypes.h"
+#endif
+#include "utils/typcache.h"
+
+#include "datum.h"
+
+/*
+ * Format of numeric values, copied from src/backend/utils/adt/numeric.c (the
+ * special values are NaN, and infinities since 14).
+ */
+#define NUMERIC_SIGN_MASK		0xC000
+#define NUMERIC_SHORT			0x8000
+#define NUMERIC_SPECIAL			0xC000
+#define NUMERIC_NBASE			10000
+
+/*
+ * Registry of validators. The match function decides whether the validator
+ * applies to a (base) type, and fills info about the type needed by the
+ * validator (so that it's looked up only once, not for each value).
+ */
+typedef struct datum_validator_entry
+{
+	const char *type;
+	bool		(*match) (Oid typid, datum_attr * attr);
+	datum_validator validate;
+}			datum_validator_entry;
+
+static bool numeric_match(Oid typid, datum_attr * attr);
+static const char *numeric_validate(datum_attr * attr, const char *data, int len);
+
+static bool array_match(Oid typid, datum_attr * attr);
+static const char *array_validate(datum_attr * attr, const char *data, int len);
+
+#if (PG_VERSION_NUM >= 90400)
+static bool jsonb_match(Oid typid, datum_attr * attr);
+static const char *jsonb_validate(datum_attr * attr, const char *data, int len);
+static const char *jsonb_validate_container(const char *data, int len);
+#endif
+
+#if (PG_VERSION_NUM >= 90200)
+static bool range_match(Oid typid, datum_attr * attr);
+static const char *range_validate(datum_attr * attr, const char *data, int len);
+static const char *range_validate_bound(datum_attr * attr, const char *data,
+										int end, int *off);
+#endif
+
+static const datum_validator_entry validators[] = {
+	{"numeric", numeric_match, numeric_validate},
+	{"array", array_match, array_validate},
+#if (PG_VERSION_NUM >= 90400)
+	{"jsonb", jsonb_match, jsonb_validate},
+#endif
+#if (PG_VERSION_NUM >= 90200)
+	{"range", range_match, range_validate},
+#endif
+	{NULL, NULL, NULL}
+};
+
+/* reads a value at the offset (relative to the 4B header), may be unaligned */
+#define DATUM_READ(data, off, type, dst) \
+	memcpy((dst), (data) + (off) - VARHDRSZ, sizeof(type))
+
+/* pick validators for the attributes */
+datum_check *
+datum_check_init(Relation rel)
+{
+	datum_check *datums;
+	bool		found = false;
+	int			j;
+
+	datums = (datum_check *) palloc0(sizeof(datum_check));
+
+	datums->natts = RelationGetNumberOfAttributes(rel);
+	datums->attrs = (datum_attr **) palloc0(sizeof(datum_attr *) * datums->natts);
+
+	for (j = 0; j < datums->natts; j++)
+	{
+		Form_pg_attribute attr = rel->rd_att->attrs[j];
+		const datum_validator_entry *entry;
+		datum_attr	info;
+		Oid			typid;
+
+		/* all the validated types are varlena */
+		if (attr->attisdropped || (attr->attlen != -1))
+			continue;
+
+		typid = getBaseType(attr->atttypid);
+
+		for (entry = validators; entry->type != NULL; entry++)
+		{
+			memset(&info, 0, sizeof(datum_attr));
+
+			if (!entry->match(typid, &info))
+				continue;
+
+			info.type = entry->type;
+			info.validate = entry->validate;
+			info.typid = typid;
+
+			datums->attrs[j] = (datum_attr *) palloc(sizeof(datum_attr));
+			memcpy(datums->attrs[j], &info, sizeof(datum_attr));
+
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		datum_check_free(datums);
+		return NULL;
+	}
+
+	return datums;
+}
+
+void
+datum_check_free(datum_check * datums)
+{
+	int			j;
+
+	Assert(datums != NULL);
+
+	ereport(DEBUG1,
+			(errmsg("validated " UINT64_FORMAT " values", datums->nvalues)));
+
+	for (j = 0; j < datums->natts; j++)
+	{
+		if (datums->attrs[j])
+			pfree(datums->attrs[j]);
+	}
+
+	pfree(datums->attrs);
+	pfree(datums);
+}
+
+const char *
+datum_check_value(datum_check * datums, int attnum, const char *data, int len)
+{
+	datum_attr *attr = datums->attrs[attnum];
+
+	Assert(attr != NULL);
+
+	datums->nvalues++;
+
+	return attr->validate(attr, data, len);
+}
+
+static bool
+numeric_match(Oid typid, datum_attr * attr)
+{
+	return (typid == NUMERICOID);
+}
+
+/*
+ * Digits have to be in the [0, NBASE) range, and there should be no leading
+ * or trailing zero digits (those are always stripped).
+ */
+static const char *
+numeric_validate(datum_attr * attr, const char *data, int len)
+{
+	uint16		header;
+	int16		digit;
+	int			hdrsz;
+	int			ndigits;
+	int			i;
+
+	if (len < sizeof(uint16))
+		return "too short";
+
+	memcpy(&header, data, sizeof(uint16));
+
+	/* NaN and infinities have just the header */
+	if ((header & NUMERIC_SIGN_MASK) == NUMERIC_SPECIAL)
+		return (len == sizeof(uint16)) ? NULL : "special value with digits";
+
+	/* the long format has a separate weight */
+	hdrsz = (header & NUMERIC_SHORT) ? sizeof(uint16) : sizeof(uint16) + sizeof(int16);
+
+	if ((len < hdrsz) || ((len - hdrsz) % sizeof(int16) != 0))
+		return "invalid length";
+
+	ndigits = (len - hdrsz) / sizeof(int16);
+
+	for (i = 0; i < ndigits; i++)
+	{
+		memcpy(&digit, data + hdrsz + i * sizeof(int16), sizeof(int16));
+
+		if ((digit < 0) || (digit >= NUMERIC_NBASE))
+			return "digit out of range";
+
+		if ((digit == 0) && ((i == 0) || (i == ndigits - 1)))
+			return "leading or trailing zero digit";
+	}
+
+	return NULL;
+}
+
+static bool
+array_match(Oid typid, datum_attr * attr)
+{
+	/* true arrays only (not fixed-length types with typelem, like point) */
+	if (get_typlen(typid) != -1)
+		return false;
+
+	attr->elemtype = get_element_type(typid);
+
+	if (!OidIsValid(attr->elemtype))
+		return false;
+
+	get_typlenbyvalalign(attr->elemtype, &attr->elmlen, &attr->elmbyval,
+						 &attr->elmalign);
+
+	return true;
+}
+
+/*
+ * The header has to be consistent (dimensions, element type, offset of the
+ * data with the NULL bitmap), and the elements have to add up to exactly
+ * the length of the array.
+ */
+static const char *
+array_validate(datum_attr * attr, const char *data, int len)
+{
+	int32		ndim;
+	int32		dataoffset;
+	Oid			elemtype;
+	int32		dim;
+	int			size = len + VARHDRSZ;	/* as if with a 4B header */
+	int64		nitems = 1;
+	int			bitmap = sizeof(ArrayType);
+	int			off;
+	int64		i;
+
+	if (size < sizeof(ArrayType))
+		return "too short";
+
+	DATUM_READ(data, offsetof(ArrayType, ndim), int32, &ndim);
+	DATUM_READ(data, offsetof(ArrayType, dataoffset), int32, &dataoffset);
+	DATUM_READ(data, offsetof(ArrayType, elemtype), Oid, &elemtype);
+
+	if ((ndim < 0) || (ndim > MAXDIM))
+		return "invalid number of dimensions";
+
+	if (elemtype != attr->elemtype)
+		return "invalid element type";
+
+	/* empty arrays have just the header */
+	if (ndim == 0)
+		return ((dataoffset == 0) && (size == sizeof(ArrayType))) ?
+			NULL : "empty array with data";
+
+	if (size < sizeof(ArrayType) + 2 * sizeof(int) * ndim)
+		return "too short for the dimensions";
+
+	for (i = 0; i < ndim; i++)
+	{
+		DATUM_READ(data, sizeof(ArrayType) + i * sizeof(int), int32, &dim);
+
+		if (dim < 0)
+			return "negative dimension";
+
+		nitems *= dim;
+
+		if (nitems > MaxArraySize)
+			return "too many elements";
+	}
+
+	/* the NULL bitmap follows dimensions and lower bounds */
+	bitmap += 2 * sizeof(int) * ndim;
+
+	if ((dataoffset != 0) &&
+		(dataoffset != ARR_OVERHEAD_WITHNULLS(ndim, nitems)))
+		return "invalid data offset";
+
+	off = (dataoffset != 0) ? dataoffset : ARR_OVERHEAD_NONULLS(ndim);
+
+	if (off > size)
+		return "data offset past the end";
+
+	/* walk the elements (skipping NULLs), to check the data length */
+	for (i = 0; i < nitems; i++)
+	{
+		if (dataoffset != 0)
+		{
+			uint8		bits;
+
+			DATUM_READ(data, bitmap + i / 8, uint8, &bits);
+
+			if ((bits & (1 << (i % 8))) == 0)
+				continue;
+		}
+
+		off = att_align_nominal(off, attr->elmalign);
+
+		if (attr->elmlen > 0)
+			off += attr->elmlen;
+		else if (attr->elmlen == -1)
+		{
+			uint32		header;
+
+			/* elements are always detoasted (with a 4B header) */
+			if (off + VARHDRSZ > size)
+				return "element past the end";
+
+			DATUM_READ(data, off, uint32, &header);
+
+			if (!VARATT_IS_4B_U(&header) || (VARSIZE_4B(&header) < VARHDRSZ))
+				return "invalid element header";
+
+			if (VARSIZE_4B(&header) > size - off)
+				return "element past the end";
+
+			off += VARSIZE_4B(&header);
+		}
+		else
+		{
+			if (off >= size)
+				return "element past the end";
+
+			off += strnlen(data + off - VARHDRSZ, size - off) + 1;
+		}
+
+		if (off > size)
+			return "element past the end";
+	}
+
+	if (off != size)
+		return "elements don't match the length";
+
+	return NULL;
+}
+
+#if (PG_VERSION_NUM >= 90400)
+
+static bool
+jsonb_match(Oid typid, datum_attr * attr)
+{
+	return (typid == JSONBOID);
+}
+
+static const char *
+jsonb_validate(datum_attr * attr, const char *data, int len)
+{
+	return jsonb_validate_container(data, len);
+}
+
+/*
+ * Validate the container header and the entries - flags, types and offsets
+ * of the entries, keys of objects have to be strings. Nested containers and
+ * numeric values are validated too.
+ */
+static const char *
+jsonb_validate_container(const char *data, int len)
+{
+	uint32		header;
+	uint32		count;
+	uint32		nentries;
+	uint32		offset = 0;
+	const char *base;
+	uint32		baselen;
+	uint32		i;
+
+	check_stack_depth();
+
+	if (len < sizeof(uint32))
+		return "container too short";
+
+	memcpy(&header, data, sizeof(uint32));
+
+	count = header & JB_CMASK;
+
+	/* either an object or an array, scalars are arrays with one element */
+	if (((header & JB_FOBJECT) != 0) == ((header & JB_FARRAY) != 0))
+		return "invalid container flags";
+
+	if ((header & JB_FSCALAR) && (!(header & JB_FARRAY) || (count != 1)))
+		return "invalid scalar container";
+
+	/* objects have entries for keys first, then for the values */
+	nentries = (header & JB_FOBJECT) ? 2 * count : count;
+
+	if ((uint64) nentries * sizeof(JEntry) > len - sizeof(uint32))
+		return "too many entries";
+
+	base = data + sizeof(uint32) + nentries * sizeof(JEntry);
+	baselen = len - sizeof(uint32) - nentries * sizeof(JEntry);
+
+	for (i = 0; i < nentries; i++)
+	{
+		JEntry		entry;
+		uint32		start = offset;
+		uint32		end;
+
+		memcpy(&entry, data + sizeof(uint32) + i * sizeof(JEntry), sizeof(JEntry));
+
+		/* some entries store the end offset, the others just the length */
+		if (JBE_HAS_OFF(entry))
+			end = JBE_OFFLENFLD(entry);
+		else
+			end = offset + JBE_OFFLENFLD(entry);
+
+		if ((end < start) || (end > baselen))
+			return "invalid entry offset";
+
+		if ((header & JB_FOBJECT) && (i < count) && !JBE_ISSTRING(entry))
+			return "object key is not a string";
+
+		/* numeric values and containers are aligned */
+		if (JBE_ISNUMERIC(entry) || JBE_ISCONTAINER(entry))
+		{
+			const char *value = base + INTALIGN(start);
+			int			valuelen = (int) end - (int) INTALIGN(start);
+			const char *issue;
+
+			if (valuelen < 1)
+				return "invalid entry offset";
+
+			if (JBE_ISCONTAINER(entry))
+				issue = jsonb_validate_container(value, valuelen);
+			else if (VARATT_IS_1B(value) && !VARATT_IS_1B_E(value) &&
+					 (VARSIZE_1B(value) == valuelen))
+				issue = numeric_validate(NULL, value + VARHDRSZ_SHORT,
+										 valuelen - VARHDRSZ_SHORT);
+			else if (VARATT_IS_1B(value) || (valuelen < VARHDRSZ))
+				issue = "invalid numeric header";
+			else
+			{
+				uint32		vheader;
+
+				memcpy(&vheader, value, sizeof(uint32));
+
+				if (!VARATT_IS_4B_U(&vheader) || (VARSIZE_4B(&vheader) != valuelen))
+					issue = "invalid numeric header";
+				else
+					issue = numeric_validate(NULL, value + VARHDRSZ,
+											 valuelen - VARHDRSZ);
+			}
+
+			if (issue)
+				return issue;
+		}
+		else if (JBE_ISNULL(entry) || JBE_ISBOOL(entry))
+		{
+			/* nulls and booleans have no data */
+			if (end != start)
+				return "null or boolean entry with data";
+		}
+		else if (!JBE_ISSTRING(entry))
+			return "invalid entry type";
+
+		offset = end;
+	}
+
+	return NULL;
+}
+
+#endif
+
+#if (PG_VERSION_NUM >= 90200)
+
+static bool
+range_match(Oid typid, datum_attr * attr)
+{
+	TypeCacheEntry *typcache;
+
+	if (!type_is_range(typid))
+		return false;
+
+	typcache = lookup_type_cache(typid, TYPECACHE_RANGE_INFO);
+
+	attr->elemtype = typcache->rngelemtype->type_id;
+	attr->elmlen = typcache->rngelemtype->typlen;
+	attr->elmbyval = typcache->rngelemtype->typbyval;
+	attr->elmalign = typcache->rngelemtype->typalign;
+
+	return true;
+}
+
+/*
+ * The range type and flags have to be valid, and the bounds (stored only for
+ * non-empty ranges and finite bounds) have to match the length.
+ */
+static const char *
+range_validate(datum_attr * attr, const char *data, int len)
+{
+	int			size = len + VARHDRSZ;	/* as if with a 4B header */
+	int			off = sizeof(RangeType);
+	Oid			rangetypid;
+	char		flags;
+	const char *issue;
+
+	if (size < sizeof(RangeType) + sizeof(char))
+		return "too short";
+
+	DATUM_READ(data, offsetof(RangeType, rangetypid), Oid, &rangetypid);
+
+	if (rangetypid != attr->typid)
+		return "invalid range type";
+
+	/* flags are stored in the last byte */
+	flags = data[len - 1];
+
+	/* NULL bounds are not used anymore */
+	if (flags & (RANGE_LB_NULL | RANGE_UB_NULL))
+		return "invalid flags";
+
+	if (flags & RANGE_EMPTY)
+		return (size == sizeof(RangeType) + sizeof(char)) ?
+			NULL : "empty range with bounds";
+
+	if (((flags & RANGE_LB_INF) && (flags & RANGE_LB_INC)) ||
+		((flags & RANGE_UB_INF) && (flags & RANGE_UB_INC)))
+		return "inclusive infinite bound";
+
+	if (!(flags & RANGE_LB_INF) &&
+		((issue = range_validate_bound(attr, data, size - 1, &off)) != NULL))
+		return issue;
+
+	if (!(flags & RANGE_UB_INF) &&
+		((issue = range_validate_bound(attr, data, size - 1, &off)) != NULL))
+		return issue;
+
+	if (off != size - 1)
+		return "bounds don't match the length";
+
+	return NULL;
+}
+
+/* skip a bound (aligned the same way as in range_deserialize) */
+static const char *
+range_validate_bound(datum_attr * attr, const char *data, int end, int *off)
+{
+	if (*off >= end)
+		return "bound past the end";
+
+	if (attr->elmlen == -1)
+	{
+		const char *value = data + *off - VARHDRSZ;
+
+		/* short varlena bounds are not aligned (see att_align_pointer) */
+		if (!VARATT_NOT_PAD_BYTE(value))
+		{
+			*off = att_align_nominal(*off, attr->elmalign);
+
+			if (*off >= end)
+				return "bound past the end";
+
+			value = data + *off - VARHDRSZ;
+		}
+
+		if (VARATT_IS_1B(value) && !VARATT_IS_1B_E(value))
+			*off += VARSIZE_1B(value);
+		else
+		{
+			uint32		header;
+
+			if (VARATT_IS_1B(value) || (*off + VARHDRSZ > end))
+				return "invalid bound header";
+
+			DATUM_READ(data, *off, uint32, &header);
+
+			if (!VARATT_IS_4B_U(&header) || (VARSIZE_4B(&header) < VARHDRSZ))
+				return "invalid bound header";
+
+			if (VARSIZE_4B(&header) > end - *off)
+				return "bound past the end";
+
+			*off += VARSIZE_4B(&header);
+		}
+	}
+	else
+	{
+		*off = att_align_nominal(*off, attr->elmalign);
+
+		if (*off >= end)
+			return "bound past the end";
+
+		if (attr->elmlen > 0)
+			*off += attr->elmlen;
+		else
+			*off += strnlen(data + *off - VARHDRSZ, end - *off) + 1;
+	}
+
+	if (*off > end)
+		return "bound past the end";
+
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef DATUM_CHECK_H
+#define DATUM_CHECK_H
+
+#include "postgres.h"
+#include "utils/rel.h"
+
+/*
+ * Validates the structure of a value of a particular type. The data are the
+ * value without the varlena header (and decompressed), not aligned. Offsets
+ * within the value are relative to a 4B header, as if it was detoasted.
+ *
+ * Returns NULL if the value is fine, otherwise description of the issue.
+ */
+struct datum_attr;
+typedef const char *(*datum_validator) (struct datum_attr *attr,
+										const char *data, int len);
+
+/* validator of an attribute, with info about the type (looked up once) */
+typedef struct datum_attr
+{
+	const char *type;			/* name of the validator (for messages) */
+	datum_validator validate;
+
+	Oid			typid;			/* base type of the attribute */
+
+	/* element of an array, or subtype of a range */
+	Oid			elemtype;
+	int16		elmlen;
+	bool		elmbyval;
+	char		elmalign;
+}			datum_attr;
+
+/* per-scan state, with validators for attributes (NULL if not checked) */
+typedef struct datum_check
+{
+	int			natts;
+	datum_attr **attrs;
+	uint64		nvalues;		/* values validated */
+}			datum_check;
+
+/* Looks up validators for attributes of the relation (in the registry of
+ * validators, by the base type of the attribute).
+ *
+ * Returns NULL if there are no attributes with a validator.
+ */
+datum_check *datum_check_init(Relation rel);
+
+/* Releases the state. */
+void		datum_check_free(datum_check * datums);
+
+/* Validates a value of the attribute (attnum starting at 0).
+ *
+ * Returns NULL if the value is fine, otherwise description of the issue.
+ */
+const char *datum_check_value(datum_check * datums, int attnum,
+							  const char *data, int len);
+
+#endif							/* DATUM_CHECK_H */
@@ -0,0 +1,225 @@
+#include "postgres.h"
+
+#if defined(__x86_64__) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define USE_SSE2_ASCII
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define USE_AVX2_ASCII
+#endif
+#endif
+
+#include "catalog/pg_type.h"
+#include "mb/pg_wchar.h"
+#include "utils/lsyscache.h"
+
+#include "encoding.h"
+
+/*
+ * Size of blocks checked by the ASCII fast path. After a block with some
+ * non-ASCII bytes we validate at least this many bytes char by char, before
+ * trying the fast path again.
+ */
+#define ASCII_BLOCK		32
+
+/* returns length of the prefix with only ASCII bytes (in whole blocks) */
+typedef size_t (*ascii_prefix_fn) (const unsigned char *s, size_t len);
+
+static ascii_prefix_fn ascii_prefix = NULL;
+
+static size_t ascii_prefix_scalar(const unsigned char *s, size_t len);
+#ifdef USE_SSE2_ASCII
+static size_t ascii_prefix_sse2(const unsigned char *s, size_t len);
+#endif
+#ifdef USE_AVX2_ASCII
+static size_t ascii_prefix_avx2(const unsigned char *s, size_t len);
+#endif
+
+static bool utf8_verify(const unsigned char *s, int len);
+
+/* decide which attributes to validate */
+encoding_check *
+encoding_check_init(Relation rel)
+{
+	encoding_check *encoding;
+	bool		found = false;
+	int			j;
+
+	/* SQL_ASCII accepts anything (except zero bytes, but let's not bother) */
+	if (GetDatabaseEncoding() == PG_SQL_ASCII)
+		return NULL;
+
+	encoding = (encoding_check *) palloc0(sizeof(encoding_check));
+
+	encoding->encoding = GetDatabaseEncoding();
+	encoding->natts = RelationGetNumberOfAttributes(rel);
+	encoding->attrs = (bool *) palloc0(sizeof(bool) * encoding->natts);
+
+	for (j = 0; j < encoding->natts; j++)
+	{
+		Form_pg_attribute attr = rel->rd_att->attrs[j];
+		Oid			typid;
+
+		if (attr->attisdropped)
+			continue;
+
+		/* the syscache lookup happens only once per attribute */
+		typid = getBaseType(attr->atttypid);
+
+		if ((typid == TEXTOID) || (typid == VARCHAROID) ||
+			(typid == BPCHAROID) || (typid == NAMEOID))
+			encoding->attrs[j] = found = true;
+	}
+
+	if (!found)
+	{
+		encoding_check_free(encoding);
+		return NULL;
+	}
+
+	/* pick the fastest ASCII check supported by the CPU (only once) */
+	if (ascii_prefix == NULL)
+	{
+		ascii_prefix = ascii_prefix_scalar;
+#ifdef USE_SSE2_ASCII
+		ascii_prefix = ascii_prefix_sse2;
+#endif
+#ifdef USE_AVX2_ASCII
+		if (__builtin_cpu_supports("avx2"))
+			ascii_prefix = ascii_prefix_avx2;
+#endif
+	}
+
+	return encoding;
+}
+
+void
+encoding_check_free(encoding_check * encoding)
+{
+	Assert(encoding != NULL);
+
+	ereport(DEBUG1,
+			(errmsg("validated " UINT64_FORMAT " bytes in encoding \"%s\"",
+					encoding->nbytes,
+					pg_encoding_to_char(encoding->encoding))));
+
+	pfree(encoding->attrs);
+	pfree(encoding);
+}
+
+bool
+encoding_check_value(encoding_check * encoding, const char *data, int len)
+{
+	encoding->nbytes += len;
+
+	if (encoding->encoding == PG_UTF8)
+		return utf8_verify((const unsigned char *) data, len);
+
+	return (pg_verify_mbstr_len(encoding->encoding, data, len, true) >= 0);
+}
+
+/*
+ * Validate UTF-8 data. Text is usually mostly ASCII, so we skip blocks of
+ * ASCII bytes (without zero bytes) first, and only validate the remaining
+ * characters one by one.
+ */
+static bool
+utf8_verify(const unsigned char *s, int len)
+{
+	const unsigned char *end = s + len;
+
+	while (s < end)
+	{
+		const unsigned char *block_end;
+
+		s += ascii_prefix(s, end - s);
+
+		/* validate the rest of the block (or the tail) char by char */
+		block_end = (end - s > ASCII_BLOCK) ? s + ASCII_BLOCK : end;
+
+		while (s < block_end)
+		{
+			int			l;
+
+			if (*s == '\0')
+				return false;
+
+			if (!IS_HIGHBIT_SET(*s))
+			{
+				s++;
+				continue;
+			}
+
+			l = pg_utf_mblen(s);
+
+			if ((l > end - s) || !pg_utf8_islegal(s, l))
+				return false;
+
+			s += l;
+		}
+	}
+
+	return true;
+}
+
+/* ASCII check, 8 bytes at a time (high bit set, or a zero byte) */
+static size_t
+ascii_prefix_scalar(const unsigned char *s, size_t len)
+{
+	size_t		i;
+
+	for (i = 0; i + sizeof(uint64) <= len; i += sizeof(uint64))
+	{
+		uint64		w;
+
+		memcpy(&w, s + i, sizeof(uint64));
+
+		if ((w | ((w - UINT64CONST(0x0101010101010101)) & ~w)) &
+			UINT64CONST(0x8080808080808080))
+			break;
+	}
+
+	return i;
+}
+
+#ifdef USE_SSE2_ASCII
+/* ASCII check, 16 bytes at a time (SSE2 is always available on x86-64) */
+static size_t
+ascii_prefix_sse2(const unsigned char *s, size_t len)
+{
+	size_t		i;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		__m128i		v = _mm_loadu_si128((const __m128i *) (s + i));
+
+		/* the zero bytes get all bits set, so just check the high bits */
+		if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))) != 0)
+			break;
+	}
+
+	return i;
+}
+#endif
+
+#ifdef USE_AVX2_ASCII
+/* ASCII check, 32 bytes at a time (only when the CPU supports AVX2) */
+__attribute__((target("avx2")))
+static size_t
+ascii_prefix_avx2(const unsigned char *s, size_t len)
+{
+	size_t		i;
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (i = 0; i + 32 <= len; i += 32)
+	{
+		__m256i		v = _mm256_loadu_si256((const __m256i *) (s + i));
+
+		if (_mm256_movemask_epi8(_mm256_or_si256(v, _mm256_cmpeq_epi8(v, zero))) != 0)
+			break;
+	}
+
+	return i;
+}
+#endif
@@ -0,0 +1,37 @@
+#ifndef ENCODING_CHECK_H
+#define ENCODING_CHECK_H
+
+#include "postgres.h"
+#include "utils/rel.h"
+
+/*
+ * Per-scan state for validating text values in the database encoding. The
+ * attributes to validate are determined once, when initializing the state.
+ */
+typedef struct encoding_check
+{
+	int			encoding;		/* database encoding */
+	int			natts;
+	bool	   *attrs;			/* attributes with text values (by attnum - 1) */
+	uint64		nbytes;			/* bytes validated */
+}			encoding_check;
+
+/* Prepares validation of text attributes (text, varchar, char and name,
+ * including domains) of the relation.
+ *
+ * Returns NULL if there's nothing to validate - no text attributes, or the
+ * database encoding is SQL_ASCII (which accepts any bytes).
+ */
+encoding_check *encoding_check_init(Relation rel);
+
+/* Releases the state. */
+void		encoding_check_free(encoding_check * encoding);
+
+/* Checks the data are valid in the database encoding (and contain no zero
+ * bytes). UTF-8 is validated with a fast path for ASCII (using SSE2/AVX2
+ * when available), other encodings use pg_verify_mbstr_len.
+ */
+bool		encoding_check_value(encoding_check * encoding, const char *data,
+								 int len);
+
+#endif							/* ENCODING_CHECK_H */
@@ -0,0 +1,640 @@
+#include "postgres.h"
+
+/* compressed posting lists were introduced in 9.4 */
+#if (PG_VERSION_NUM >= 90400)
+
+#include "access/gin_private.h"
+#include "access/itup.h"
+#include "catalog/pg_am.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+
+#include "common.h"
+#include "gin.h"
+
+/*
+ * Item pointers in compressed posting lists are encoded as 64-bit integers,
+ * with the offset number in the lowest 11 bits (see ginpostinglist.c).
+ */
+#define GIN_OFFSET_BITS		11
+#define GIN_OFFSET_MASK		((UINT64CONST(1) << GIN_OFFSET_BITS) - 1)
+
+/* continuation bits of 8 varbyte-encoded bytes */
+#define VARBYTE_HIGH_BITS	UINT64CONST(0x8080808080808080)
+#define VARBYTE_LOW_BITS	UINT64CONST(0x0101010101010101)
+
+/* at most 7 bytes per encoded delta (43 bits) */
+#define VARBYTE_MAX_SHIFT	42
+
+static uint32 gin_check_metapage(Relation rel, char *raw_page,
+				   BlockNumber block);
+static uint32 gin_check_entry_page(Relation rel, PageHeader header,
+					 BlockNumber block, char *raw_page,
+					 item_bitmap * bitmap);
+static uint32 gin_check_entry_tuple(Relation rel, IndexTuple itup,
+					  bool isleaf, BlockNumber block, int item,
+					  BlockNumber *nblocks, item_bitmap * bitmap);
+static uint32 gin_check_data_page(Relation rel, PageHeader header,
+					BlockNumber block, char *raw_page,
+					item_bitmap * bitmap);
+static uint32 gin_check_list_page(PageHeader header, BlockNumber block,
+					char *raw_page, item_bitmap * bitmap);
+static uint32 gin_check_item(PageHeader header, BlockNumber block, int item);
+static uint32 gin_check_block(Relation rel, BlockNumber *nblocks,
+				BlockNumber target, const char *what,
+				BlockNumber block, int item);
+static uint32 gin_decode_segment(GinPostingList * segment, uint64 *prev,
+				   BlockNumber block, int item,
+				   item_bitmap * bitmap, int *nitems);
+
+/* item pointer as a 64-bit integer (the same as in ginpostinglist.c) */
+static inline uint64
+itemptr_to_uint64(ItemPointer iptr)
+{
+	uint64		val;
+
+	val = BlockIdGetBlockNumber(&iptr->ip_blkid);
+	val <<= GIN_OFFSET_BITS;
+	val |= iptr->ip_posid;
+
+	return val;
+}
+
+/* add the decoded item to the bitmap (after checking the offset) */
+static inline uint32
+gin_add_item(uint64 val, BlockNumber block, int item, item_bitmap * bitmap)
+{
+	OffsetNumber offnum = (val & GIN_OFFSET_MASK);
+
+	if ((offnum < FirstOffsetNumber) || (offnum > MaxHeapTuplesPerPage))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] posting list item (%u,%u) has invalid offset",
+						block, item, (BlockNumber) (val >> GIN_OFFSET_BITS),
+						offnum)));
+		return 1;
+	}
+
+	/* duplicate TIDs are expected in GIN (one per key), so don't check */
+	if (bitmap)
+		bitmap_set(bitmap, (BlockNumber) (val >> GIN_OFFSET_BITS), offnum - 1);
+
+	return 0;
+}
+
+/*
+ * gin_check_page
+ *		Check a GIN page, and optionally add the heap TIDs to the bitmap.
+ *
+ * The GIN index consists of a metapage, an entry tree (B-tree on the keys),
+ * posting trees (B-trees on TIDs, for keys with too many items to fit into
+ * a posting list in the entry tuple) and the pending list (unsorted tuples
+ * not yet merged into the main structure, with fastupdate=on).
+ *
+ * FIXME This only checks individual pages, not the tree structure.
+ */
+uint32
+gin_check_page(Relation rel, PageHeader header, BlockNumber block,
+			   char *raw_page, item_bitmap * bitmap, void *state)
+{
+	uint32		nerrs = 0;
+	GinPageOpaque opaque;
+
+	/* make sure we only ever call this for GIN indexes */
+	Assert(rel->rd_rel->relam == GIN_AM_OID);
+
+	/* check basic page header */
+	nerrs += check_page_header(header, block);
+
+	if (PageIsNew(raw_page))
+		return nerrs;
+
+	/* check there's enough space for index-relevant data */
+	if (PageGetSpecialSize(raw_page) != MAXALIGN(sizeof(GinPageOpaqueData)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] special space has unexpected size %d (expected %d)",
+						block, (int) PageGetSpecialSize(raw_page),
+						(int) MAXALIGN(sizeof(GinPageOpaqueData)))));
+		return ++nerrs;
+	}
+
+	opaque = GinPageGetOpaque(raw_page);
+
+	ereport(DEBUG2,
+			(errmsg("[%d] GIN page [flags=%u, maxoff=%u, rightlink=%u]",
+					block, opaque->flags, opaque->maxoff, opaque->rightlink)));
+
+	/* the metapage is always the first block */
+	if (block == GIN_METAPAGE_BLKNO)
+		return nerrs + gin_check_metapage(rel, raw_page, block);
+
+	if (GinPageIsMeta(raw_page))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] page is marked as metapage", block)));
+		return ++nerrs;
+	}
+
+	/* contents of deleted pages are irrelevant */
+	if (GinPageIsDeleted(raw_page))
+		return nerrs;
+
+	if (GinPageIsList(raw_page))
+		nerrs += gin_check_list_page(header, block, raw_page, bitmap);
+	else if (GinPageIsData(raw_page))
+		nerrs += gin_check_data_page(rel, header, block, raw_page, bitmap);
+	else
+		nerrs += gin_check_entry_page(rel, header, block, raw_page, bitmap);
+
+	return nerrs;
+}
+
+/* checks the metapage (version, pending list) */
+static uint32
+gin_check_metapage(Relation rel, char *raw_page, BlockNumber block)
+{
+	uint32		nerrs = 0;
+	GinMetaPageData *meta = GinPageGetMeta(raw_page);
+	BlockNumber nblocks = 0;
+
+	ereport(DEBUG2,
+			(errmsg("[%d] is a meta-page [version=%d, head=%u, tail=%u, pending pages=%u]",
+					block, meta->ginVersion, meta->head, meta->tail,
+					meta->nPendingPages)));
+
+	if (!GinPageIsMeta(raw_page))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage is not marked as metapage (flags %u)",
+						block, GinPageGetOpaque(raw_page)->flags)));
+		nerrs++;
+	}
+
+	if ((meta->ginVersion < 1) || (meta->ginVersion > GIN_CURRENT_VERSION))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid version %d (should be %d)",
+						block, meta->ginVersion, GIN_CURRENT_VERSION)));
+		nerrs++;
+	}
+
+	/* the pending list is either empty, or both head and tail are set */
+	if ((meta->head == InvalidBlockNumber) != (meta->tail == InvalidBlockNumber))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] pending list head %u and tail %u are inconsistent",
+						block, meta->head, meta->tail)));
+		nerrs++;
+	}
+	else if (meta->head != InvalidBlockNumber)
+	{
+		nerrs += gin_check_block(rel, &nblocks, meta->head,
+								 "pending list head", block, 0);
+		nerrs += gin_check_block(rel, &nblocks, meta->tail,
+								 "pending list tail", block, 0);
+	}
+	else if (meta->nPendingPages != 0)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] pending list is empty, but has %u pages",
+						block, meta->nPendingPages)));
+		nerrs++;
+	}
+
+	return nerrs;
+}
+
+/* checks entry tree page (keys with posting lists, or downlinks) */
+static uint32
+gin_check_entry_page(Relation rel, PageHeader header, BlockNumber block,
+					 char *raw_page, item_bitmap * bitmap)
+{
+	uint32		nerrs = 0;
+	int			ntuples = PageGetMaxOffsetNumber(raw_page);
+	bool		isleaf = GinPageIsLeaf(raw_page);
+	BlockNumber nblocks = 0;
+	int			i;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		ItemId		lp = &header->pd_linp[i];
+		uint32		item_nerrs = gin_check_item(header, block, i + 1);
+
+		if (item_nerrs > 0)
+		{
+			nerrs += item_nerrs;
+			continue;
+		}
+
+		nerrs += gin_check_entry_tuple(rel, (IndexTuple) (raw_page + lp->lp_off),
+									   isleaf, block, i + 1, &nblocks,
+									   (isleaf) ? bitmap : NULL);
+	}
+
+	return nerrs;
+}
+
+/* checks a single entry tuple (posting list, posting tree root or downlink) */
+static uint32
+gin_check_entry_tuple(Relation rel, IndexTuple itup, bool isleaf,
+					  BlockNumber block, int item, BlockNumber *nblocks,
+					  item_bitmap * bitmap)
+{
+	uint32		nerrs = 0;
+	Size		size = IndexTupleSize(itup);
+	int			nposting;
+
+	if (!isleaf)
+		return gin_check_block(rel, nblocks, GinGetDownlink(itup),
+							   "downlink", block, item);
+
+	if (GinIsPostingTree(itup))
+		return gin_check_block(rel, nblocks, GinGetPostingTree(itup),
+							   "posting tree root", block, item);
+
+	nposting = GinGetNPosting(itup);
+
+	if (GinGetPostingOffset(itup) > size)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] posting list offset %u exceeds tuple length %zu",
+						block, item, GinGetPostingOffset(itup), size)));
+		return ++nerrs;
+	}
+
+	if (GinItupIsCompressed(itup))
+	{
+		GinPostingList *segment = (GinPostingList *) GinGetPosting(itup);
+		Size		maxsize = size - GinGetPostingOffset(itup);
+		uint64		prev = 0;
+		int			nitems = 0;
+
+		/* entry tuples have a single posting list segment */
+		if (nposting == 0)
+			return nerrs;
+
+		if ((maxsize < offsetof(GinPostingList, bytes)) ||
+			(SizeOfGinPostingList(segment) > maxsize))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] posting list does not fit into the tuple (%zu bytes)",
+							block, item, maxsize)));
+			return ++nerrs;
+		}
+
+		nerrs += gin_decode_segment(segment, &prev, block, item, bitmap, &nitems);
+
+		if (nitems != nposting)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] posting list has %d items (expected %d)",
+							block, item, nitems, nposting)));
+			nerrs++;
+		}
+	}
+	else
+	{
+		/* uncompressed posting list (pg_upgraded from before 9.4) */
+		ItemPointer items = (ItemPointer) GinGetPosting(itup);
+		uint64		prev = 0;
+		int			i;
+
+		if (GinGetPostingOffset(itup) + nposting * sizeof(ItemPointerData) > size)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] posting list with %d items does not fit into the tuple",
+							block, item, nposting)));
+			return ++nerrs;
+		}
+
+		for (i = 0; i < nposting; i++)
+		{
+			uint64		val = itemptr_to_uint64(&items[i]);
+
+			if (val <= prev)
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] posting list items not in ascending order",
+								block, item)));
+				return ++nerrs;
+			}
+
+			nerrs += gin_add_item(val, block, item, bitmap);
+			prev = val;
+		}
+	}
+
+	return nerrs;
+}
+
+/* checks posting tree page (TIDs in leaf pages, downlinks otherwise) */
+static uint32
+gin_check_data_page(Relation rel, PageHeader header, BlockNumber block,
+					char *raw_page, item_bitmap * bitmap)
+{
+	uint32		nerrs = 0;
+	GinPageOpaque opaque = GinPageGetOpaque(raw_page);
+	Size		datasize = header->pd_lower - MAXALIGN(SizeOfPageHeaderData) -
+	MAXALIGN(sizeof(ItemPointerData));
+	uint64		prev = 0;
+
+	/* the data are stored between the page header (and right bound) and pd_lower */
+	if ((header->pd_lower < MAXALIGN(SizeOfPageHeaderData) + MAXALIGN(sizeof(ItemPointerData))) ||
+		(header->pd_lower > header->pd_upper))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] data page has invalid pd_lower %d",
+						block, header->pd_lower)));
+		return ++nerrs;
+	}
+
+	if (!GinPageIsLeaf(raw_page))
+	{
+		BlockNumber nblocks = 0;
+		OffsetNumber i;
+
+		if (opaque->maxoff * sizeof(PostingItem) > datasize)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] data page with %u posting items does not fit into pd_lower %d",
+							block, opaque->maxoff, header->pd_lower)));
+			return ++nerrs;
+		}
+
+		for (i = FirstOffsetNumber; i <= opaque->maxoff; i++)
+		{
+			PostingItem *pitem = GinDataPageGetPostingItem(raw_page, i);
+
+			nerrs += gin_check_block(rel, &nblocks, PostingItemGetBlockNumber(pitem),
+									 "downlink", block, i);
+		}
+
+		return nerrs;
+	}
+
+	if (GinPageIsCompressed(raw_page))
+	{
+		char	   *ptr = (char *) GinDataLeafPageGetPostingList(raw_page);
+		char	   *end = ptr + datasize;
+		int			nsegment = 0;
+
+		while (ptr < end)
+		{
+			GinPostingList *segment = (GinPostingList *) ptr;
+			int			nitems = 0;
+
+			nsegment++;
+
+			if ((end - ptr < offsetof(GinPostingList, bytes)) ||
+				(SizeOfGinPostingList(segment) > end - ptr))
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] posting list segment exceeds the data (%d bytes)",
+								block, nsegment, (int) (end - ptr))));
+				return ++nerrs;
+			}
+
+			nerrs += gin_decode_segment(segment, &prev, block, nsegment,
+										bitmap, &nitems);
+
+			ptr = (char *) GinNextPostingListSegment(segment);
+		}
+	}
+	else
+	{
+		/* uncompressed leaf page (pg_upgraded from before 9.4) */
+		ItemPointer items = (ItemPointer) GinDataPageGetData(raw_page);
+		OffsetNumber i;
+
+		if (opaque->maxoff * sizeof(ItemPointerData) > datasize)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] data page with %u items does not fit into pd_lower %d",
+							block, opaque->maxoff, header->pd_lower)));
+			return ++nerrs;
+		}
+
+		for (i = 0; i < opaque->maxoff; i++)
+		{
+			uint64		val = itemptr_to_uint64(&items[i]);
+
+			if (val <= prev)
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] posting tree items not in ascending order",
+								block, i + 1)));
+				return ++nerrs;
+			}
+
+			nerrs += gin_add_item(val, block, i + 1, bitmap);
+			prev = val;
+		}
+	}
+
+	/* all items have to be below the right bound (except the rightmost page) */
+	if ((opaque->rightlink != InvalidBlockNumber) &&
+		(prev > itemptr_to_uint64(GinDataPageGetRightBound(raw_page))))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] posting tree items exceed the right bound (%u,%u)",
+						block,
+						ItemPointerGetBlockNumber(GinDataPageGetRightBound(raw_page)),
+						ItemPointerGetOffsetNumber(GinDataPageGetRightBound(raw_page)))));
+		nerrs++;
+	}
+
+	return nerrs;
+}
+
+/* checks pending list page (regular index tuples, pointing to the heap) */
+static uint32
+gin_check_list_page(PageHeader header, BlockNumber block, char *raw_page,
+					item_bitmap * bitmap)
+{
+	uint32		nerrs = 0;
+	int			ntuples = PageGetMaxOffsetNumber(raw_page);
+	int			i;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		ItemId		lp = &header->pd_linp[i];
+		IndexTuple	itup;
+		uint32		item_nerrs = gin_check_item(header, block, i + 1);
+
+		if (item_nerrs > 0)
+		{
+			nerrs += item_nerrs;
+			continue;
+		}
+
+		itup = (IndexTuple) (raw_page + lp->lp_off);
+
+		nerrs += gin_add_item(itemptr_to_uint64(&itup->t_tid), block, i + 1,
+							  bitmap);
+	}
+
+	return nerrs;
+}
+
+/* checks the line pointer and that the index tuple fits into it */
+static uint32
+gin_check_item(PageHeader header, BlockNumber block, int item)
+{
+	ItemId		lp = &header->pd_linp[item - 1];
+	IndexTuple	itup;
+
+	/* GIN does not use LP_DEAD/LP_REDIRECT, and removes tuples right away */
+	if (lp->lp_flags != LP_NORMAL)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] item is not LP_NORMAL (flag %u)",
+						block, item, lp->lp_flags)));
+		return 1;
+	}
+
+	if ((lp->lp_off < header->pd_upper) ||
+		(lp->lp_off + lp->lp_len > header->pd_special) ||
+		(lp->lp_len < sizeof(IndexTupleData)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] item (%d,%d) not within [upper %d, special %d]",
+						block, item, lp->lp_off, lp->lp_len,
+						header->pd_upper, header->pd_special)));
+		return 1;
+	}
+
+	itup = (IndexTuple) ((char *) header + lp->lp_off);
+
+	if (IndexTupleSize(itup) > lp->lp_len)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] tuple length %zu exceeds item length %d",
+						block, item, IndexTupleSize(itup), lp->lp_len)));
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Checks that a block referenced from the page is within the index. The
+ * index may be extended concurrently, so re-read the size when needed.
+ */
+static uint32
+gin_check_block(Relation rel, BlockNumber *nblocks, BlockNumber target,
+				const char *what, BlockNumber block, int item)
+{
+	if (target >= *nblocks)
+		*nblocks = RelationGetNumberOfBlocks(rel);
+
+	if ((target == GIN_METAPAGE_BLKNO) || (target >= *nblocks))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] %s %u not within [1, %u)",
+						block, item, what, target, *nblocks)));
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Decodes a compressed posting list segment, and adds the items to the
+ * bitmap. The items have to be in ascending order (also across segments,
+ * so prev is the last item of the preceding segment).
+ *
+ * The first item is stored uncompressed, the others as varbyte-encoded
+ * deltas (7 bits per byte, the high bit set when more bytes follow). Items
+ * on the same heap page usually differ by a single byte delta, so we look
+ * at 8 bytes at once - when none of them continues into the next byte (and
+ * none is zero, which would be a duplicate), we decode all 8 at once. This
+ * is much faster than decoding the deltas byte by byte, which matters as
+ * the largest GIN indexes have millions of items.
+ */
+static uint32
+gin_decode_segment(GinPostingList * segment, uint64 *prev,
+				   BlockNumber block, int item,
+				   item_bitmap * bitmap, int *nitems)
+{
+	uint32		nerrs = 0;
+	unsigned char *ptr = segment->bytes;
+	unsigned char *end = segment->bytes + segment->nbytes;
+	uint64		val = itemptr_to_uint64(&segment->first);
+
+	if (val <= *prev)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] posting list items not in ascending order",
+						block, item)));
+		return ++nerrs;
+	}
+
+	nerrs += gin_add_item(val, block, item, bitmap);
+	(*nitems)++;
+
+	while (ptr < end)
+	{
+		uint64		delta = 0;
+		int			shift = 0;
+		unsigned char c;
+
+		/* fast path - 8 single-byte (non-zero) deltas */
+		if (end - ptr >= sizeof(uint64))
+		{
+			uint64		chunk;
+
+			memcpy(&chunk, ptr, sizeof(uint64));
+
+			if (((chunk & VARBYTE_HIGH_BITS) == 0) &&
+				(((chunk - VARBYTE_LOW_BITS) & VARBYTE_HIGH_BITS) == 0))
+			{
+				int			i;
+
+				for (i = 0; i < sizeof(uint64); i++)
+				{
+					val += ptr[i];
+					nerrs += gin_add_item(val, block, item, bitmap);
+				}
+
+				*nitems += sizeof(uint64);
+				ptr += sizeof(uint64);
+				continue;
+			}
+		}
+
+		/* slow path - decode a single delta */
+		do
+		{
+			if ((ptr == end) || (shift > VARBYTE_MAX_SHIFT))
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] posting list contains invalid varbyte item",
+								block, item)));
+				return ++nerrs;
+			}
+
+			c = *(ptr++);
+			delta |= (uint64) (c & 0x7F) << shift;
+			shift += 7;
+		} while (c & 0x80);
+
+		if (delta == 0)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] posting list items not in ascending order",
+							block, item)));
+			return ++nerrs;
+		}
+
+		val += delta;
+		nerrs += gin_add_item(val, block, item, bitmap);
+		(*nitems)++;
+	}
+
+	*prev = val;
+
+	return nerrs;
+}
+
+#endif							/* PG_VERSION_NUM >= 90400 */
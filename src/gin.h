@@ -0,0 +1,20 @@
+#ifndef GIN_CHECK_H
+#define GIN_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "item-bitmap.h"
+
+/* Checks a GIN index page (metapage, entry tree, posting tree or pending
+ * list page). When a bitmap is supplied, all the heap TIDs referenced by
+ * the page (posting lists, posting tree leaves, pending list) are added
+ * to it, for the cross-check with the table.
+ *
+ * Returns number of issues found.
+ */
+uint32		gin_check_page(Relation rel, PageHeader header, BlockNumber block,
+						   char *raw_page, item_bitmap * bitmap,
+						   void *state);
+
+#endif							/* GIN_CHECK_H */
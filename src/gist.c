@@ -0,0 +1,243 @@
+#include "postgres.h"
+
+/* NSN stored as a page LSN (comparable with the page LSN) since 9.3 */
+#if (PG_VERSION_NUM >= 90300)
+
+#include "access/gist_private.h"
+#include "access/itup.h"
+#include "catalog/pg_am.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+
+#include "common.h"
+#include "gist.h"
+
+static uint32 gist_check_tuple(Relation rel, PageHeader header,
+				 BlockNumber block, int item, bool isleaf,
+				 BlockNumber *nblocks, item_bitmap * bitmap);
+static uint32 gist_check_block(Relation rel, BlockNumber *nblocks,
+				 BlockNumber target, const char *what,
+				 BlockNumber block, int item);
+
+/*
+ * gist_check_page
+ *		Check a GiST page, and optionally add the heap TIDs to the bitmap.
+ *
+ * GiST pages don't have any ordering of the keys (that's up to the opclass),
+ * so we only check the page flags, the rightlink/NSN used to detect
+ * concurrent page splits, and the tuples (internal tuples point to child
+ * pages, leaf tuples to heap tuples).
+ *
+ * FIXME This only checks individual pages, not the tree structure.
+ */
+uint32
+gist_check_page(Relation rel, PageHeader header, BlockNumber block,
+				char *raw_page, item_bitmap * bitmap, void *state)
+{
+	uint32		nerrs = 0;
+	GISTPageOpaque opaque;
+	BlockNumber nblocks = 0;
+	bool		isleaf;
+	int			ntuples;
+	int			i;
+
+	/* make sure we only ever call this for GiST indexes */
+	Assert(rel->rd_rel->relam == GIST_AM_OID);
+
+	/* check basic page header */
+	nerrs += check_page_header(header, block);
+
+	if (PageIsNew(raw_page))
+		return nerrs;
+
+	/* check there's enough space for index-relevant data */
+	if (PageGetSpecialSize(raw_page) != MAXALIGN(sizeof(GISTPageOpaqueData)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] special space has unexpected size %d (expected %d)",
+						block, (int) PageGetSpecialSize(raw_page),
+						(int) MAXALIGN(sizeof(GISTPageOpaqueData)))));
+		return ++nerrs;
+	}
+
+	opaque = GistPageGetOpaque(raw_page);
+
+	ereport(DEBUG2,
+			(errmsg("[%d] GiST page [flags=%u, rightlink=%u, nsn=%X/%X]",
+					block, opaque->flags, opaque->rightlink,
+					(uint32) (GistPageGetNSN(raw_page) >> 32),
+					(uint32) GistPageGetNSN(raw_page))));
+
+	if (opaque->gist_page_id != GIST_PAGE_ID)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] invalid page id 0x%04X (should be 0x%04X)",
+						block, opaque->gist_page_id, GIST_PAGE_ID)));
+		return ++nerrs;
+	}
+
+	/* contents of deleted pages are irrelevant */
+	if (GistPageIsDeleted(raw_page))
+		return nerrs;
+
+	/*
+	 * Page splits set the NSN of the left page to the LSN of the split, and
+	 * the page itself is modified by the split too. So the NSN can't be
+	 * newer than the page LSN.
+	 */
+	if (GistPageGetNSN(raw_page) > PageGetLSN(raw_page))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] NSN %X/%X is newer than page LSN %X/%X",
+						block,
+						(uint32) (GistPageGetNSN(raw_page) >> 32),
+						(uint32) GistPageGetNSN(raw_page),
+						(uint32) (PageGetLSN(raw_page) >> 32),
+						(uint32) PageGetLSN(raw_page))));
+		nerrs++;
+	}
+
+	/* the root is split by moving the contents to new pages */
+	if (block == GIST_ROOT_BLKNO)
+	{
+		if ((opaque->rightlink != InvalidBlockNumber) || GistFollowRight(raw_page))
+		{
+			ereport(WARNING,
+					(errmsg("[%d] root page has a right sibling %u (flags %u)",
+							block, opaque->rightlink, opaque->flags)));
+			nerrs++;
+		}
+	}
+	else if (opaque->rightlink != InvalidBlockNumber)
+	{
+		if (opaque->rightlink == block)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] rightlink points to the page itself", block)));
+			nerrs++;
+		}
+		else
+			nerrs += gist_check_block(rel, &nblocks, opaque->rightlink,
+									  "rightlink", block, 0);
+	}
+	else if (GistFollowRight(raw_page))
+	{
+		/* incomplete split, but there has to be the right half */
+		ereport(WARNING,
+				(errmsg("[%d] page marked as follow-right, but has no rightlink",
+						block)));
+		nerrs++;
+	}
+
+	isleaf = GistPageIsLeaf(raw_page);
+	ntuples = PageGetMaxOffsetNumber(raw_page);
+
+	for (i = 0; i < ntuples; i++)
+		nerrs += gist_check_tuple(rel, header, block, i + 1, isleaf,
+								  &nblocks, bitmap);
+
+	return nerrs;
+}
+
+/*
+ * Checks a single GiST tuple - internal tuples have to point to a child
+ * page, leaf tuples to a heap tuple (which gets added to the bitmap).
+ */
+static uint32
+gist_check_tuple(Relation rel, PageHeader header, BlockNumber block,
+				 int item, bool isleaf, BlockNumber *nblocks,
+				 item_bitmap * bitmap)
+{
+	ItemId		lp = &header->pd_linp[item - 1];
+	IndexTuple	itup;
+
+	/* LP_DEAD marks tuples killed by index scans, nothing else is used */
+	if ((lp->lp_flags != LP_NORMAL) && (lp->lp_flags != LP_DEAD))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] item is not LP_NORMAL/LP_DEAD (flag %u)",
+						block, item, lp->lp_flags)));
+		return 1;
+	}
+
+	if ((lp->lp_off < header->pd_upper) ||
+		(lp->lp_off + lp->lp_len > header->pd_special) ||
+		(lp->lp_len < sizeof(IndexTupleData)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] item (%d,%d) not within [upper %d, special %d]",
+						block, item, lp->lp_off, lp->lp_len,
+						header->pd_upper, header->pd_special)));
+		return 1;
+	}
+
+	itup = (IndexTuple) ((char *) header + lp->lp_off);
+
+	if (IndexTupleSize(itup) > lp->lp_len)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] tuple length %zu exceeds item length %d",
+						block, item, IndexTupleSize(itup), lp->lp_len)));
+		return 1;
+	}
+
+	/* incomplete splits from before 9.1 (needs REINDEX) */
+	if (GistTupleIsInvalid(itup))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] invalid tuple (incomplete split from before 9.1)",
+						block, item)));
+		return 1;
+	}
+
+	if (!isleaf)
+		return gist_check_block(rel, nblocks,
+								ItemPointerGetBlockNumber(&(itup->t_tid)),
+								"downlink", block, item);
+
+	if ((ItemPointerGetOffsetNumber(&(itup->t_tid)) < FirstOffsetNumber) ||
+		(ItemPointerGetOffsetNumber(&(itup->t_tid)) > MaxHeapTuplesPerPage))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] heap pointer (%u,%u) has invalid offset",
+						block, item,
+						ItemPointerGetBlockNumber(&(itup->t_tid)),
+						ItemPointerGetOffsetNumber(&(itup->t_tid)))));
+		return 1;
+	}
+
+	/*
+	 * Killed tuples are still expected - the heap item is only removed after
+	 * the index entry is (until then it's at least an LP_DEAD stub).
+	 */
+	if (bitmap)
+		bitmap_set(bitmap, ItemPointerGetBlockNumber(&(itup->t_tid)),
+				   ItemPointerGetOffsetNumber(&(itup->t_tid)) - 1);
+
+	return 0;
+}
+
+/*
+ * Checks that a block referenced from the page is within the index (and
+ * is not the root, which is never a child or a right sibling). The index
+ * may be extended concurrently, so re-read the size when needed.
+ */
+static uint32
+gist_check_block(Relation rel, BlockNumber *nblocks, BlockNumber target,
+				 const char *what, BlockNumber block, int item)
+{
+	if (target >= *nblocks)
+		*nblocks = RelationGetNumberOfBlocks(rel);
+
+	if ((target == GIST_ROOT_BLKNO) || (target >= *nblocks))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] %s %u not within [1, %u)",
+						block, item, what, target, *nblocks)));
+		return 1;
+	}
+
+	return 0;
+}
+
+#endif							/* PG_VERSION_NUM >= 90300 */
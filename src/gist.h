@@ -0,0 +1,19 @@
+#ifndef GIST_CHECK_H
+#define GIST_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "item-bitmap.h"
+
+/* Checks a GiST index page (internal or leaf). When a bitmap is supplied,
+ * the heap TIDs from leaf pages are added to it, for the cross-check with
+ * the table.
+ *
+ * Returns number of issues found.
+ */
+uint32		gist_check_page(Relation rel, PageHeader header, BlockNumber block,
+							char *raw_page, item_bitmap * bitmap,
+							void *state);
+
+#endif							/* GIST_CHECK_H */
@@ -0,0 +1,516 @@
+#include "postgres.h"
+
+#include "hash.h"
+
+#if (PG_VERSION_NUM >= 100000)
+
+#include "access/hash.h"
+#include "access/itup.h"
+#include "catalog/pg_am.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+
+#include "common.h"
+
+/* page info, remembered for checking the bucket chains at the end */
+typedef struct hash_page_info
+{
+	uint16		flags;			/* LH_PAGE_TYPE bits (0 if not seen) */
+	Bucket		bucket;
+	BlockNumber prevblkno;
+	BlockNumber nextblkno;
+}			hash_page_info;
+
+/* per-index state */
+typedef struct hash_check_state
+{
+	HashMetaPageData meta;		/* copy of the metapage (may get refreshed) */
+
+	/* info about pages (only when checking all the pages) */
+	BlockNumber npages;
+	hash_page_info *pages;
+}			hash_check_state;
+
+static void hash_read_metapage(Relation rel, hash_check_state * state);
+static uint32 hash_check_metapage(Relation rel, HashMetaPage meta,
+					BlockNumber block);
+static uint32 hash_check_bucket_page(Relation rel, hash_check_state * state,
+					   PageHeader header, char *raw_page,
+					   BlockNumber block, item_bitmap * bitmap);
+static bool hash_bucket_matches(Relation rel, hash_check_state * state,
+					Bucket bucket, uint32 hashkey);
+static Bucket hash_old_bucket(Bucket bucket);
+
+/* allocate the state, read the metapage */
+void *
+hash_check_begin(Relation rel, bool complete)
+{
+	hash_check_state *state;
+
+	Assert(rel->rd_rel->relam == HASH_AM_OID);
+
+	state = (hash_check_state *) palloc0(sizeof(hash_check_state));
+
+	hash_read_metapage(rel, state);
+
+	/* the chains can only be checked when we see all the pages */
+	if (complete)
+	{
+		state->npages = RelationGetNumberOfBlocks(rel);
+		state->pages = (hash_page_info *)
+			palloc_extended(state->npages * sizeof(hash_page_info),
+							MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+	}
+
+	return state;
+}
+
+/*
+ * Read (a copy of) the current metapage. We don't use the metapage cached
+ * in the relcache (_hash_getcachedmetap), as it errors out on a corrupted
+ * metapage. We don't check it here, that happens when checking block 0.
+ */
+static void
+hash_read_metapage(Relation rel, hash_check_state * state)
+{
+	Buffer		buf;
+
+	buf = ReadBuffer(rel, HASH_METAPAGE);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+
+	memcpy(&state->meta, HashPageGetMeta(BufferGetPage(buf)),
+		   sizeof(HashMetaPageData));
+
+	UnlockReleaseBuffer(buf);
+}
+
+/*
+ * hash_check_page
+ *		Check a hash index page, in physical order (not walking the chains).
+ */
+uint32
+hash_check_page(Relation rel, PageHeader header, BlockNumber block,
+				char *raw_page, item_bitmap * bitmap, void *state)
+{
+	uint32		nerrs = 0;
+	hash_check_state *hstate = (hash_check_state *) state;
+	HashPageOpaque opaque;
+	uint16		pagetype;
+
+	/* make sure we only ever call this for hash indexes */
+	Assert(rel->rd_rel->relam == HASH_AM_OID);
+
+	/* check basic page header */
+	nerrs += check_page_header(header, block);
+
+	/* pages of splitpoints not used yet are all zeroes */
+	if (PageIsNew(raw_page))
+		return nerrs;
+
+	/* check there's enough space for index-relevant data */
+	if (PageGetSpecialSize(raw_page) != MAXALIGN(sizeof(HashPageOpaqueData)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] special space has unexpected size %d (expected %d)",
+						block, (int) PageGetSpecialSize(raw_page),
+						(int) MAXALIGN(sizeof(HashPageOpaqueData)))));
+		return ++nerrs;
+	}
+
+	opaque = (HashPageOpaque) PageGetSpecialPointer(raw_page);
+	pagetype = (opaque->hasho_flag & LH_PAGE_TYPE);
+
+	ereport(DEBUG2,
+			(errmsg("[%d] hash page [flags=%u, bucket=%u, prev=%u, next=%u]",
+					block, opaque->hasho_flag, opaque->hasho_bucket,
+					opaque->hasho_prevblkno, opaque->hasho_nextblkno)));
+
+	if (opaque->hasho_page_id != HASHO_PAGE_ID)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] invalid page id 0x%04X (should be 0x%04X)",
+						block, opaque->hasho_page_id, HASHO_PAGE_ID)));
+		return ++nerrs;
+	}
+
+	/* the metapage is always the first block */
+	if ((block == HASH_METAPAGE) != (pagetype == LH_META_PAGE))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] invalid page type %u for block %u",
+						block, pagetype, block)));
+		return ++nerrs;
+	}
+
+	switch (pagetype)
+	{
+		case LH_META_PAGE:
+			nerrs += hash_check_metapage(rel, HashPageGetMeta(raw_page), block);
+			break;
+
+		case LH_BUCKET_PAGE:
+		case LH_OVERFLOW_PAGE:
+			nerrs += hash_check_bucket_page(rel, hstate, header, raw_page,
+											block, bitmap);
+			break;
+
+		case LH_BITMAP_PAGE:
+			{
+				uint32		i;
+
+				/* bitmap pages have to be listed in the metapage */
+				for (i = 0; i < hstate->meta.hashm_nmaps; i++)
+				{
+					if (hstate->meta.hashm_mapp[i] == block)
+						break;
+				}
+
+				if (i == hstate->meta.hashm_nmaps)
+				{
+					ereport(WARNING,
+							(errmsg("[%d] bitmap page not listed in the metapage",
+									block)));
+					nerrs++;
+				}
+				break;
+			}
+
+		case LH_UNUSED_PAGE:
+			/* freed overflow page */
+			break;
+
+		default:
+			ereport(WARNING,
+					(errmsg("[%d] invalid page type %u", block, pagetype)));
+			nerrs++;
+	}
+
+	/* remember the page for checking the chains at the end */
+	if (hstate->pages && (block < hstate->npages))
+	{
+		hash_page_info *info = &hstate->pages[block];
+
+		info->flags = pagetype;
+		info->bucket = opaque->hasho_bucket;
+		info->prevblkno = opaque->hasho_prevblkno;
+		info->nextblkno = opaque->hasho_nextblkno;
+	}
+
+	return nerrs;
+}
+
+/* checks the metapage (magic, version, masks, bitmap pages) */
+static uint32
+hash_check_metapage(Relation rel, HashMetaPage meta, BlockNumber block)
+{
+	uint32		nerrs = 0;
+	BlockNumber nblocks = RelationGetNumberOfBlocks(rel);
+	uint32		i;
+
+	ereport(DEBUG2,
+			(errmsg("[%d] is a meta-page [magic=0x%08X, version=%u, max bucket=%u, high mask=0x%08X, low mask=0x%08X]",
+					block, meta->hashm_magic, meta->hashm_version,
+					meta->hashm_maxbucket, meta->hashm_highmask,
+					meta->hashm_lowmask)));
+
+	if (meta->hashm_magic != HASH_MAGIC)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid magic number 0x%08X (should be 0x%08X)",
+						block, meta->hashm_magic, HASH_MAGIC)));
+		nerrs++;
+	}
+
+	if (meta->hashm_version != HASH_VERSION)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid version %u (should be %d)",
+						block, meta->hashm_version, HASH_VERSION)));
+		nerrs++;
+	}
+
+	/* the max bucket has to be in the upper half of the masks */
+	if ((meta->hashm_lowmask != (meta->hashm_highmask >> 1)) ||
+		(meta->hashm_maxbucket > meta->hashm_highmask) ||
+		(meta->hashm_maxbucket < meta->hashm_lowmask))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] max bucket %u inconsistent with masks (high 0x%08X, low 0x%08X)",
+						block, meta->hashm_maxbucket, meta->hashm_highmask,
+						meta->hashm_lowmask)));
+		nerrs++;
+	}
+
+	if (meta->hashm_nmaps > HASH_MAX_BITMAPS)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage has too many bitmap pages %u (max %d)",
+						block, meta->hashm_nmaps, HASH_MAX_BITMAPS)));
+		return ++nerrs;
+	}
+
+	for (i = 0; i < meta->hashm_nmaps; i++)
+	{
+		if ((meta->hashm_mapp[i] == HASH_METAPAGE) ||
+			(meta->hashm_mapp[i] >= nblocks))
+		{
+			ereport(WARNING,
+					(errmsg("[%d] bitmap page %u not within [1, %u)",
+							block, meta->hashm_mapp[i], nblocks)));
+			nerrs++;
+		}
+	}
+
+	return nerrs;
+}
+
+/*
+ * Check bucket (or overflow) page, and the tuples on it. The hash codes are
+ * sorted on each page, and have to map to the bucket of the page - with the
+ * exception of tuples left behind in the old bucket by a split, until the
+ * old bucket gets cleaned up.
+ */
+static uint32
+hash_check_bucket_page(Relation rel, hash_check_state * state,
+					   PageHeader header, char *raw_page, BlockNumber block,
+					   item_bitmap * bitmap)
+{
+	uint32		nerrs = 0;
+	HashPageOpaque opaque = (HashPageOpaque) PageGetSpecialPointer(raw_page);
+	Bucket		bucket = opaque->hasho_bucket;
+	int			ntuples = PageGetMaxOffsetNumber(raw_page);
+	uint32		prevkey = 0;
+	int			i;
+
+	/* the bucket has to exist, and primary pages have a fixed location */
+	if (bucket > state->meta.hashm_maxbucket)
+		hash_read_metapage(rel, state);
+
+	if (bucket > state->meta.hashm_maxbucket)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] bucket %u exceeds max bucket %u",
+						block, bucket, state->meta.hashm_maxbucket)));
+		return ++nerrs;
+	}
+
+	if ((opaque->hasho_flag & LH_BUCKET_PAGE) &&
+		(BUCKET_TO_BLKNO(&state->meta, bucket) != block))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] primary page of bucket %u should be block %u",
+						block, bucket, BUCKET_TO_BLKNO(&state->meta, bucket))));
+		nerrs++;
+	}
+
+	for (i = 0; i < ntuples; i++)
+	{
+		ItemId		lp = &header->pd_linp[i];
+		IndexTuple	itup;
+		uint32		hashkey;
+
+		/* hash indexes only use LP_NORMAL and LP_DEAD (killed) items */
+		if ((lp->lp_flags != LP_NORMAL) && (lp->lp_flags != LP_DEAD))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] item is not LP_NORMAL/LP_DEAD (flag %u)",
+							block, (i + 1), lp->lp_flags)));
+			nerrs++;
+			continue;
+		}
+
+		if ((lp->lp_off < header->pd_upper) ||
+			(lp->lp_off + lp->lp_len > header->pd_special) ||
+			(lp->lp_len < MAXALIGN(sizeof(IndexTupleData)) + sizeof(uint32)))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] item (%d,%d) not within [upper %d, special %d]",
+							block, (i + 1), lp->lp_off, lp->lp_len,
+							header->pd_upper, header->pd_special)));
+			nerrs++;
+			continue;
+		}
+
+		itup = (IndexTuple) (raw_page + lp->lp_off);
+		hashkey = _hash_get_indextuple_hashkey(itup);
+
+		if (hashkey < prevkey)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] hash code 0x%08X lower than the preceding one 0x%08X",
+							block, (i + 1), hashkey, prevkey)));
+			nerrs++;
+		}
+
+		prevkey = hashkey;
+
+		if (!hash_bucket_matches(rel, state, bucket, hashkey))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] hash code 0x%08X maps to bucket %u, not %u",
+							block, (i + 1), hashkey,
+							_hash_hashkey2bucket(hashkey,
+												 state->meta.hashm_maxbucket,
+												 state->meta.hashm_highmask,
+												 state->meta.hashm_lowmask),
+							bucket)));
+			nerrs++;
+		}
+
+		/*
+		 * Duplicates are possible during a split (moved tuples). Killed items
+		 * are still expected, as the heap item can't be removed before the
+		 * index entry is.
+		 */
+		if (bitmap)
+			bitmap_set(bitmap, ItemPointerGetBlockNumber(&itup->t_tid),
+					   ItemPointerGetOffsetNumber(&itup->t_tid) - 1);
+	}
+
+	return nerrs;
+}
+
+/*
+ * Does the hash code belong to the bucket? Either it maps directly to it
+ * (with the same masks the AM uses), or it maps to a bucket split from it
+ * (possibly repeatedly), and the tuple was not removed from the old bucket
+ * yet. The metapage may have changed since we read it (concurrent splits),
+ * so re-read it before giving up.
+ */
+static bool
+hash_bucket_matches(Relation rel, hash_check_state * state, Bucket bucket,
+					uint32 hashkey)
+{
+	int			attempt;
+
+	for (attempt = 0; attempt < 2; attempt++)
+	{
+		Bucket		target = _hash_hashkey2bucket(hashkey,
+												  state->meta.hashm_maxbucket,
+												  state->meta.hashm_highmask,
+												  state->meta.hashm_lowmask);
+
+		/* walk to the bucket the target was split from */
+		while (target > bucket)
+			target = hash_old_bucket(target);
+
+		if (target == bucket)
+			return true;
+
+		if (attempt == 0)
+			hash_read_metapage(rel, state);
+	}
+
+	return false;
+}
+
+/* bucket the given bucket was split from (clear the highest bit) */
+static Bucket
+hash_old_bucket(Bucket bucket)
+{
+	uint32		mask = 1;
+
+	while ((mask <= bucket) && (mask < PG_UINT32_MAX / 2))
+		mask <<= 1;
+
+	return bucket & ((mask >> 1) - 1);
+}
+
+/*
+ * hash_check_end
+ *		Check the bucket chains, using the info collected from the pages.
+ *
+ * Each bucket has a primary page (at a location determined by the bucket
+ * number), with a chain of overflow pages. The pages are linked in both
+ * directions (except that primary pages use the prev link to remember
+ * the max bucket at the time of the last split), and all pages in a chain
+ * belong to the same bucket.
+ */
+uint32
+hash_check_end(Relation rel, void *state)
+{
+	uint32		nerrs = 0;
+	hash_check_state *hstate = (hash_check_state *) state;
+	BlockNumber block;
+	Bucket		bucket;
+
+	if (hstate->pages == NULL)
+	{
+		pfree(hstate);
+		return nerrs;
+	}
+
+	for (block = 0; block < hstate->npages; block++)
+	{
+		hash_page_info *info = &hstate->pages[block];
+		hash_page_info *next;
+
+		if ((info->flags != LH_BUCKET_PAGE) && (info->flags != LH_OVERFLOW_PAGE))
+			continue;
+
+		/* overflow pages have to be linked from the previous page */
+		if (info->flags == LH_OVERFLOW_PAGE)
+		{
+			if ((info->prevblkno >= hstate->npages) ||
+				(hstate->pages[info->prevblkno].nextblkno != block))
+			{
+				ereport(WARNING,
+						(errmsg("[%d] overflow page not linked from the previous page %u",
+								block, info->prevblkno)));
+				nerrs++;
+			}
+		}
+
+		if (info->nextblkno == InvalidBlockNumber)
+			continue;
+
+		if (info->nextblkno >= hstate->npages)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] next page %u not within index (%u blocks)",
+							block, info->nextblkno, hstate->npages)));
+			nerrs++;
+			continue;
+		}
+
+		next = &hstate->pages[info->nextblkno];
+
+		if (next->flags != LH_OVERFLOW_PAGE)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] next page %u is not an overflow page (type %u)",
+							block, info->nextblkno, next->flags)));
+			nerrs++;
+		}
+		else if (next->bucket != info->bucket)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] next page %u belongs to bucket %u, not %u",
+							block, info->nextblkno, next->bucket, info->bucket)));
+			nerrs++;
+		}
+	}
+
+	/* all the buckets have to have a primary page */
+	for (bucket = 0; bucket <= hstate->meta.hashm_maxbucket; bucket++)
+	{
+		block = BUCKET_TO_BLKNO(&hstate->meta, bucket);
+
+		if ((block >= hstate->npages) ||
+			(hstate->pages[block].flags != LH_BUCKET_PAGE) ||
+			(hstate->pages[block].bucket != bucket))
+		{
+			ereport(WARNING,
+					(errmsg("bucket %u has no primary page (block %u)",
+							bucket, block)));
+			nerrs++;
+		}
+	}
+
+	pfree(hstate->pages);
+	pfree(hstate);
+
+	return nerrs;
+}
+
+#endif							/* PG_VERSION_NUM >= 100000 */
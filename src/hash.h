@@ -0,0 +1,34 @@
+#ifndef HASH_CHECK_H
+#define HASH_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "item-bitmap.h"
+
+/* hash indexes are crash-safe (and have the current format) since 10 */
+#if (PG_VERSION_NUM >= 100000)
+
+/* Allocates state for checking the hash index (reads the metapage). */
+void	   *hash_check_begin(Relation rel, bool complete);
+
+/* Checks a hash index page (metapage, bucket, overflow or bitmap page).
+ * For bucket and overflow pages, checks that the hash codes of the tuples
+ * map to the bucket of the page, and adds the TIDs to the bitmap.
+ *
+ * Returns number of issues found.
+ */
+uint32		hash_check_page(Relation rel, PageHeader header, BlockNumber block,
+							char *raw_page, item_bitmap * bitmap, void *state);
+
+/* Checks the bucket chains (primary bucket pages and overflow pages link
+ * to each other correctly), when all the pages were checked. Releases the
+ * state.
+ *
+ * Returns number of issues found.
+ */
+uint32		hash_check_end(Relation rel, void *state);
+
+#endif							/* PG_VERSION_NUM >= 100000 */
+
+#endif							/* HASH_CHECK_H */
@@ -4,22 +4,29 @@
 #if (PG_VERSION_NUM >= 90300)
 #include "access/htup_details.h"
 #endif
+#include "access/transam.h"
+#include "access/tuptoaster.h"
+#include "access/xact.h"
 #include "funcapi.h"
+#include "mb/pg_wchar.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 #include "heap.h"
 
 
 static uint32 check_heap_tuple(Relation rel, PageHeader header,
-				 BlockNumber block, int i, char *buffer);
+				 BlockNumber block, int i, char *buffer,
+				 heap_check_state * state);
 
 static uint32 check_heap_tuple_attributes(Relation rel, PageHeader header,
-							BlockNumber block, int i, char *buffer);
+							BlockNumber block, int i, char *buffer,
+							heap_check_state * state);
 
 /* checks heap tuples (table) on the page, one by one */
 uint32
 check_heap_tuples(Relation rel, PageHeader header, char *buffer,
-				  BlockNumber block)
+				  BlockNumber block, heap_check_state * state)
 {
 	/* tuple checks */
 	int			ntuples = PageGetMaxOffsetNumber(buffer);
@@ -30,7 +37,7 @@ check_heap_tuples(Relation rel, PageHeader header, char *buffer,
 			(errmsg("[%d] max number of tuples = %d", block, ntuples)));
 
 	for (i = 0; i < ntuples; i++)
-		nerrs += check_heap_tuple(rel, header, block, i, buffer);
+		nerrs += check_heap_tuple(rel, header, block, i, buffer, state);
 
 	if (nerrs > 0)
 		ereport(WARNING,
@@ -43,7 +50,7 @@ check_heap_tuples(Relation rel, PageHeader header, char *buffer,
 /* checks that the tuples do not overlap and then the individual attributes */
 static uint32
 check_heap_tuple(Relation rel, PageHeader header, BlockNumber block,
-				 int i, char *buffer)
+				 int i, char *buffer, heap_check_state * state)
 {
 	uint32		nerrs = 0;
 	int			j,
@@ -232,13 +239,14 @@ check_heap_tuple(Relation rel, PageHeader header, BlockNumber block,
 		}
 	}
 
-	return nerrs + check_heap_tuple_attributes(rel, header, block, i, buffer);
+	return nerrs + check_heap_tuple_attributes(rel, header, block, i, buffer,
+											   state);
 }
 
 /* checks the individual attributes of the tuple */
 static uint32
 check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
-							int i, char *buffer)
+							int i, char *buffer, heap_check_state * state)
 {
 	HeapTupleHeader tupheader;
 	uint32		nerrs = 0;
@@ -247,6 +255,7 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 				endoff;
 	int			tuplenatts;
 	bool		has_nulls = false;
+	bool		check_toast = false;
 
 	ItemId		lp = &header->pd_linp[i];
 
@@ -286,6 +295,22 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 			(errmsg("[%d:%d] tuple has %d attributes (%d in relation)",
 					block, (i + 1), tuplenatts, rel->rd_att->natts)));
 
+	/*
+	 * Check xmin/xmax, but only for complete headers of LP_NORMAL tuples
+	 * (the header of LP_DEAD tuples is not interesting anymore).
+	 */
+	if (state->check_xids && (lp->lp_flags == LP_NORMAL) &&
+		(lp->lp_len >= SizeofHeapTupleHeader) &&
+		(lp->lp_off + lp->lp_len <= BLCKSZ))
+		nerrs += check_tuple_xids(state->xids, tupheader, block, (i + 1));
+
+	/*
+	 * Only remember TOAST pointers from live tuples - TOAST tables may be
+	 * vacuumed independently, so values of dead tuples may be gone already.
+	 */
+	if (state->toast && (lp->lp_flags == LP_NORMAL))
+		check_toast = heap_tuple_is_live(state, tupheader);
+
 	/* check all the attributes */
 	for (j = 0; j < tuplenatts; j++)
 	{
@@ -294,6 +319,15 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 		/* actual length of the attribute value */
 		int			len;
 
+		/* TOAST pointer (to be verified later) */
+		bool		is_external = false;
+
+		/* inline compressed value (with a sane raw size) */
+		bool		is_compressed = false;
+
+		/* decompressed successfully (the data are in the buffer) */
+		bool		decompressed = false;
+
 		/* copied from src/backend/commands/analyze.c */
 		bool		is_varlena = (!attr->attbyval && attr->attlen == -1);
 		bool		is_varwidth = (!attr->attbyval && attr->attlen < 0);
@@ -339,7 +373,7 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 			{
 				/* the raw length should be less than 1G (and positive) */
 				if ((VARRAWSIZE_4B_C(buffer + off) < 0) ||
-					(VARRAWSIZE_4B_C(buffer + off) > 1024 * 1024))
+					(VARRAWSIZE_4B_C(buffer + off) > MaxAllocSize - VARHDRSZ))
 				{
 					ereport(WARNING,
 							(errmsg("[%d:%d]  attribute '%s' has invalid length %d (should be between 0 and 1G)",
@@ -356,12 +390,16 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 					 * structure, so we may check the other attributes.
 					 */
 				}
+				else
+					is_compressed = (len >= VARHDRSZ + sizeof(int32));
 			}
 
 			/*
-			 * FIXME  Check if the varlena value can be detoasted - see
-			 * heap_tuple_untoast_attr in backend/access/heap/tuptoaster.c.
+			 * Pointers to TOAST tables are verified later, in a single pass
+			 * over the TOAST table (see toast_check_values), including
+			 * decompressing the compressed ones.
 			 */
+			is_external = VARATT_IS_EXTERNAL_ONDISK(buffer + off);
 		}
 		else if (is_varwidth)
 		{
@@ -397,6 +435,93 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 
 		Assert(len >= 0);
 
+		/* decompress inline values (the whole value is within the tuple) */
+		if (is_compressed && state->compress)
+		{
+			int32		rawsize = VARRAWSIZE_4B_C(buffer + off);
+			int32		rawlen;
+
+			rawlen = compress_check_decompress(state->compress,
+											   VARDATA_4B_C(buffer + off),
+											   len - (VARHDRSZ + sizeof(int32)),
+											   rawsize);
+
+			if (rawlen != rawsize)
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] attribute '%s' is corrupted, decompressed %d bytes (expected %d)",
+								block, (i + 1), attr->attname.data,
+								rawlen, rawsize)));
+				++nerrs;
+			}
+			else
+				decompressed = true;
+		}
+
+		/*
+		 * Check contents of the value - text values in the database encoding,
+		 * structure of values with a type-specific validator. TOASTed values
+		 * are not checked (the chunks are not assembled unless compressed).
+		 */
+		if ((state->encoding && state->encoding->attrs[j]) ||
+			(state->datums && state->datums->attrs[j]))
+		{
+			const char *data = NULL;
+			int			datalen = 0;
+			const char *issue;
+
+			if (!is_varlena)
+			{
+				/* name (NUL-terminated, fixed length) */
+				data = buffer + off;
+				datalen = strnlen(data, len);
+			}
+#if (PG_VERSION_NUM >= 90500)
+			else if (decompressed)
+			{
+				data = state->compress->raw;
+				datalen = VARRAWSIZE_4B_C(buffer + off);
+			}
+#endif
+			else if (!VARATT_IS_EXTENDED(buffer + off) ||
+					 VARATT_IS_SHORT(buffer + off))
+			{
+				data = VARDATA_ANY(buffer + off);
+				datalen = VARSIZE_ANY_EXHDR(buffer + off);
+			}
+
+			if (data && state->encoding && state->encoding->attrs[j] &&
+				!encoding_check_value(state->encoding, data, datalen))
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] attribute '%s' is not valid in encoding \"%s\"",
+								block, (i + 1), attr->attname.data,
+								GetDatabaseEncodingName())));
+				++nerrs;
+			}
+
+			if (data && state->datums && state->datums->attrs[j] &&
+				((issue = datum_check_value(state->datums, j, data, datalen)) != NULL))
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] attribute '%s' is not a valid %s (%s)",
+								block, (i + 1), attr->attname.data,
+								state->datums->attrs[j]->type, issue)));
+				++nerrs;
+			}
+		}
+
+		/* remember the TOAST pointer (the whole pointer is within the tuple) */
+		if (is_external && check_toast)
+		{
+			struct varatt_external toast_pointer;
+
+			VARATT_EXTERNAL_GET_POINTER(toast_pointer, buffer + off);
+
+			nerrs += toast_check_add(state->toast, &toast_pointer,
+									 block, (i + 1));
+		}
+
 		/* skip to the next attribute */
 		off += len;
 
@@ -435,3 +560,56 @@ check_heap_tuple_attributes(Relation rel, PageHeader header, BlockNumber block,
 
 	return nerrs;
 }
+
+/*
+ * Decides whether the tuple is certainly live, i.e. inserted by a committed
+ * (or our own) transaction, and not deleted by a committed transaction.
+ * Tuples we can't decide about (multixacts etc.) are considered not live.
+ *
+ * This is only meant for checks that need to skip tuples whose data might
+ * have been removed by vacuum already (e.g. TOAST values), so being more
+ * conservative than HeapTupleSatisfiesVacuum is fine.
+ *
+ * We never look up status of XIDs older than relfrozenxid, as the CLOG may
+ * have been truncated already. The lookups go through the per-scan cache.
+ */
+bool
+heap_tuple_is_live(heap_check_state * state, HeapTupleHeader tupheader)
+{
+	TransactionId xmin = HeapTupleHeaderGetRawXmin(tupheader);
+	TransactionId xmax = HeapTupleHeaderGetRawXmax(tupheader);
+	xid_check  *xids = state->xids;
+
+	/* inserting transaction (committed, frozen or our own) */
+	if (HeapTupleHeaderXminInvalid(tupheader))
+		return false;
+
+	if (!HeapTupleHeaderXminCommitted(tupheader) &&
+		TransactionIdIsNormal(xmin) &&
+		!TransactionIdIsCurrentTransactionId(xmin))
+	{
+		if (TransactionIdPrecedes(xmin, xids->relfrozenxid))
+			return false;
+
+		if (xid_get_status(xids, xmin) != CHECK_XID_COMMITTED)
+			return false;
+	}
+
+	/* deleting transaction */
+	if ((tupheader->t_infomask & HEAP_XMAX_INVALID) ||
+		!TransactionIdIsValid(xmax) ||
+		HEAP_XMAX_IS_LOCKED_ONLY(tupheader->t_infomask))
+		return true;
+
+	if (tupheader->t_infomask & HEAP_XMAX_IS_MULTI)
+		return false;
+
+	if (tupheader->t_infomask & HEAP_XMAX_COMMITTED)
+		return false;
+
+	if (TransactionIdPrecedes(xmax, xids->relfrozenxid))
+		return false;
+
+	/* deletes by us or in-progress transactions keep the data around */
+	return xid_get_status(xids, xmax) != CHECK_XID_COMMITTED;
+}
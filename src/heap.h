@@ -4,6 +4,44 @@
 #include "postgres.h"
 #include "access/heapam.h"
 
-uint32		check_heap_tuples(Relation rel, PageHeader header, char *buffer, BlockNumber block);
+#include "compress.h"
+#include "datum.h"
+#include "encoding.h"
+#include "toast.h"
+#include "xid.h"
+
+/* per-scan state of the heap checks (optional checks, collected data) */
+typedef struct heap_check_state
+{
+	/* TOAST pointers to verify at the end (NULL when not checking TOAST) */
+	toast_check *toast;
+
+	/* cached XID status lookups (always set), and whether to check XIDs */
+	xid_check  *xids;
+	bool		check_xids;
+
+	/* buffers for decompressing values (NULL when not decompressing) */
+	compress_check *compress;
+
+	/* text attributes to validate (NULL when not validating) */
+	encoding_check *encoding;
+
+	/* validators of attribute values (NULL when not validating) */
+	datum_check *datums;
+
+	/* blocks with issues, in increasing order (only when cross-checking) */
+	BlockNumber *corrupted;
+	BlockNumber ncorrupted;
+	BlockNumber maxcorrupted;
+}			heap_check_state;
+
+uint32		check_heap_tuples(Relation rel, PageHeader header, char *buffer,
+							  BlockNumber block, heap_check_state * state);
+
+/* Decides whether the tuple is certainly live (inserted by a committed
+ * transaction, not deleted by a committed one).
+ */
+bool		heap_tuple_is_live(heap_check_state * state,
+							   HeapTupleHeader tupheader);
 
 #endif							/* HEAP_CHECK_H */
@@ -0,0 +1,217 @@
+#include "postgres.h"
+
+#include "catalog/index.h"
+#if (PG_VERSION_NUM >= 90600)
+#include "catalog/pg_am.h"
+#endif
+#include "executor/executor.h"
+#include "utils/rel.h"
+
+#include "index-expr.h"
+
+/* prepare the executor state, just like IndexBuildHeapScan does */
+index_expr_state *
+index_expr_init(Relation heaprel, Relation indexrel)
+{
+	index_expr_state *state;
+
+	state = (index_expr_state *) palloc0(sizeof(index_expr_state));
+
+	state->indexInfo = BuildIndexInfo(indexrel);
+	state->estate = CreateExecutorState();
+	state->econtext = GetPerTupleExprContext(state->estate);
+	state->slot = MakeSingleTupleTableSlot(RelationGetDescr(heaprel));
+
+	/* expressions and the predicate are evaluated on the heap tuple */
+	state->econtext->ecxt_scantuple = state->slot;
+
+#if (PG_VERSION_NUM >= 100000)
+	state->predicate = ExecPrepareQual(state->indexInfo->ii_Predicate,
+									   state->estate);
+#else
+	state->predicate = (List *) ExecPrepareExpr((Expr *) state->indexInfo->ii_Predicate,
+												state->estate);
+#endif
+
+#if (PG_VERSION_NUM >= 100000)
+	/* hash indexes don't store NULL keys (the key is a single column) */
+	state->skip_nulls = (indexrel->rd_rel->relam == HASH_AM_OID);
+#endif
+
+	return state;
+}
+
+/* release the executor state */
+void
+index_expr_free(index_expr_state * state)
+{
+	ExecDropSingleTupleTableSlot(state->slot);
+	FreeExecutorState(state->estate);
+	pfree(state);
+}
+
+/* compute index values for the heap tuple (unless excluded by predicate) */
+bool
+index_expr_values(index_expr_state * state, HeapTuple tuple,
+				  Datum *values, bool *isnull)
+{
+	/* free values computed for the previous tuple */
+	ResetExprContext(state->econtext);
+
+	ExecStoreTuple(tuple, state->slot, InvalidBuffer, false);
+
+#if (PG_VERSION_NUM >= 100000)
+	if (state->predicate != NULL &&
+		!ExecQual(state->predicate, state->econtext))
+		return false;
+#else
+	if (state->predicate != NIL &&
+		!ExecQual(state->predicate, state->econtext, false))
+		return false;
+#endif
+
+	FormIndexDatum(state->indexInfo, state->slot, state->estate,
+				   values, isnull);
+
+	return true;
+}
+
+/* evaluate the predicate for a batch of tuples */
+void
+index_expr_predicate_batch(index_expr_state * state, HeapTuple tuples,
+						   int ntuples, bool *matches)
+{
+	int			i;
+
+	/* free values computed for the previous batch */
+	ResetExprContext(state->econtext);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		ExecStoreTuple(&tuples[i], state->slot, InvalidBuffer, false);
+
+#if (PG_VERSION_NUM >= 100000)
+		matches[i] = (state->predicate == NULL) ||
+			ExecQual(state->predicate, state->econtext);
+#else
+		matches[i] = (state->predicate == NIL) ||
+			ExecQual(state->predicate, state->econtext, false);
+#endif
+
+		/* the key may be an expression, so compute it just like the AM */
+		if (matches[i] && state->skip_nulls)
+		{
+			Datum		values[INDEX_MAX_KEYS];
+			bool		isnull[INDEX_MAX_KEYS];
+
+			FormIndexDatum(state->indexInfo, state->slot, state->estate,
+						   values, isnull);
+
+			matches[i] = !isnull[0];
+		}
+	}
+
+	ExecClearTuple(state->slot);
+}
+
+/*
+ * Find a live tuple in the HOT chain starting at the offset. The predicate
+ * (and key) columns are the same for the whole chain, so we can evaluate it
+ * on any live member. Dead and aborted tuples may reference TOAST values
+ * that were vacuumed already, so evaluating on those might fail.
+ */
+static OffsetNumber
+index_expr_live_tuple(heap_check_state * heapstate, char *raw_page,
+					  OffsetNumber offnum)
+{
+	int			steps;
+
+	for (steps = 0; steps < MaxHeapTuplesPerPage; steps++)
+	{
+		ItemId		lp;
+		HeapTupleHeader htup;
+
+		if ((offnum < FirstOffsetNumber) ||
+			(offnum > PageGetMaxOffsetNumber((Page) raw_page)))
+			break;
+
+		lp = PageGetItemId((Page) raw_page, offnum);
+
+		if (!ItemIdIsNormal(lp))
+			break;
+
+		htup = (HeapTupleHeader) PageGetItem((Page) raw_page, lp);
+
+		if (heap_tuple_is_live(heapstate, htup))
+			return offnum;
+
+		if (!HeapTupleHeaderIsHotUpdated(htup))
+			break;
+
+		offnum = ItemPointerGetOffsetNumber(&htup->t_ctid);
+	}
+
+	return InvalidOffsetNumber;
+}
+
+/*
+ * add items from the heap page matching the partial index predicate (and
+ * with a non-NULL key, for hash indexes)
+ */
+void
+index_expr_add_heap_items(index_expr_state * state,
+						  heap_check_state * heapstate, item_bitmap * bitmap,
+						  item_bitmap * unknown, PageHeader header,
+						  char *raw_page, BlockNumber page)
+{
+	int			nitems;
+	int			ntuples = 0;
+	int			i;
+	OffsetNumber items[MaxHeapTuplesPerPage];
+	OffsetNumber tuples[MaxHeapTuplesPerPage];
+	OffsetNumber roots[MaxHeapTuplesPerPage];
+	HeapTupleData htups[MaxHeapTuplesPerPage];
+	bool		matches[MaxHeapTuplesPerPage];
+
+	/* should we ignore this page entirely? */
+	if ((page < bitmap->startpage) ||
+		(page >= bitmap->startpage + bitmap->npages))
+		return;
+
+	nitems = heap_page_index_items(header, raw_page, items, tuples);
+
+	/* build the batch of tuples to evaluate the predicate on */
+	for (i = 0; i < nitems; i++)
+	{
+		ItemId		lp;
+		OffsetNumber offnum = InvalidOffsetNumber;
+
+		if (tuples[i] != InvalidOffsetNumber)
+			offnum = index_expr_live_tuple(heapstate, raw_page, tuples[i]);
+
+		/* no tuple, or no live one to evaluate the predicate on */
+		if (offnum == InvalidOffsetNumber)
+		{
+			if (unknown)
+				bitmap_set(unknown, page, items[i] - 1);
+			continue;
+		}
+
+		lp = PageGetItemId((Page) raw_page, offnum);
+
+		htups[ntuples].t_data = (HeapTupleHeader) PageGetItem((Page) raw_page, lp);
+		htups[ntuples].t_len = ItemIdGetLength(lp);
+		htups[ntuples].t_tableOid = InvalidOid;
+		ItemPointerSet(&htups[ntuples].t_self, page, offnum);
+
+		roots[ntuples++] = items[i];
+	}
+
+	index_expr_predicate_batch(state, htups, ntuples, matches);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		if (matches[i])
+			bitmap_set(bitmap, page, roots[i] - 1);
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef INDEX_EXPR_H
+#define INDEX_EXPR_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+#include "nodes/execnodes.h"
+
+#include "heap.h"
+#include "item-bitmap.h"
+
+/* state for computing index values (incl. expressions) from heap tuples */
+typedef struct index_expr_state
+{
+	IndexInfo  *indexInfo;
+	EState	   *estate;
+	ExprContext *econtext;
+	TupleTableSlot *slot;
+#if (PG_VERSION_NUM >= 100000)
+	ExprState  *predicate;		/* partial index predicate (or NULL) */
+#else
+	List	   *predicate;		/* partial index predicate (or NIL) */
+#endif
+	bool		skip_nulls;		/* NULL keys not indexed (hash) */
+}			index_expr_state;
+
+/* Prepares state for computing values of the index from heap tuples. */
+index_expr_state *index_expr_init(Relation heaprel, Relation indexrel);
+
+/* Releases the state (executor state, slot). */
+void		index_expr_free(index_expr_state * state);
+
+/* Computes the index values (evaluating expressions) for a heap tuple,
+ * just like when inserting the tuple into the index. The values are
+ * allocated in a per-tuple memory context, reset by the next call.
+ *
+ * Returns false if the tuple does not match the partial index predicate
+ * (and thus should not be in the index at all).
+ */
+bool		index_expr_values(index_expr_state * state, HeapTuple tuple,
+							  Datum *values, bool *isnull);
+
+/* Evaluates the partial index predicate for a batch of heap tuples (e.g. all
+ * tuples from a heap page), resetting the per-tuple memory context only once
+ * for the whole batch. Sets matches[i] for tuples matching the predicate
+ * (and with a non-NULL key, for indexes not storing NULL keys).
+ */
+void		index_expr_predicate_batch(index_expr_state * state,
+									   HeapTuple tuples, int ntuples,
+									   bool *matches);
+
+/* Updates the bitmap with items from the heap page expected to be in the
+ * partial index (i.e. matching the predicate), or in the hash index (i.e.
+ * with a non-NULL key). The predicate is only evaluated on live tuples (the
+ * first live one in a HOT chain). Items where we can't decide (dead items
+ * without a tuple, dead or aborted tuples) are added to the 'unknown' bitmap
+ * instead (if supplied).
+ */
+void		index_expr_add_heap_items(index_expr_state * state,
+									  heap_check_state * heapstate,
+									  item_bitmap * bitmap,
+									  item_bitmap * unknown,
+									  PageHeader header, char *raw_page,
+									  BlockNumber page);
+
+#endif							/* INDEX_EXPR_H */
@@ -6,9 +6,30 @@
 #include "heap.h"
 #include "item-bitmap.h"
 
+/*
+ * Callbacks of an index check method. The begin/end callbacks are optional,
+ * for methods that need per-index state (e.g. to cross-check pages with
+ * each other at the end). The 'complete' flag says if all the pages are
+ * going to be checked (not just a sample or a range of blocks), with a lock
+ * preventing concurrent changes of the index.
+ */
+typedef void *(*check_begin_cb) (Relation rel, bool complete);
 typedef uint32 (*check_page_cb) (Relation, PageHeader, BlockNumber,
-								 char *, item_bitmap *);
+								 char *, item_bitmap *, void *);
+typedef uint32 (*check_end_cb) (Relation rel, void *state);
 
-check_page_cb lookup_check_method(Oid oid, bool *crosscheck);
+typedef struct index_check_methods
+{
+	Oid			oid;			/* index access method */
+	check_begin_cb begin;
+	check_page_cb check_page;
+	check_end_cb end;
+	bool		crosscheck;		/* supports cross-check using bitmap */
+	bool		repeated;		/* may reference the same TID repeatedly */
+}			index_check_methods;
+
+/* Returns check methods for the index access method (generic page checks
+ * if there are no specific ones). */
+const index_check_methods *lookup_check_method(Oid oid);
 
 #endif
@@ -0,0 +1,79 @@
+#include "postgres.h"
+
+#include "executor/instrument.h"
+
+#include "instrument.h"
+
+bool		pgcheck_instrument = false;
+
+/* instrumentation of the last check */
+check_instrumentation pgcheck_instr;
+
+/* current phase, and when it started (only when instrumenting) */
+static CheckPhase current_phase = CHECK_PHASE_NONE;
+static instr_time phase_start;
+
+/* buffer usage at the beginning of the check */
+static BufferUsage buffers_start;
+
+void
+instrument_start(void)
+{
+	current_phase = CHECK_PHASE_NONE;
+
+	/* don't keep results of an earlier check when not instrumenting */
+	memset(&pgcheck_instr, 0, sizeof(check_instrumentation));
+
+	if (!pgcheck_instrument)
+		return;
+
+	pgcheck_instr.valid = true;
+
+	buffers_start = pgBufferUsage;
+}
+
+void
+instrument_end(void)
+{
+	(void) instrument_phase(CHECK_PHASE_NONE);
+
+	if (!pgcheck_instrument || !pgcheck_instr.valid)
+		return;
+
+	pgcheck_instr.buffer_hits = pgBufferUsage.shared_blks_hit -
+		buffers_start.shared_blks_hit;
+	pgcheck_instr.buffer_reads = pgBufferUsage.shared_blks_read -
+		buffers_start.shared_blks_read;
+}
+
+CheckPhase
+instrument_phase(CheckPhase phase)
+{
+	CheckPhase	prev = current_phase;
+
+	if (phase == prev)
+		return prev;
+
+	if (pgcheck_instrument)
+	{
+		instr_time	now;
+
+		INSTR_TIME_SET_CURRENT(now);
+
+		if (prev != CHECK_PHASE_NONE)
+			INSTR_TIME_ACCUM_DIFF(pgcheck_instr.time[prev], now, phase_start);
+
+		phase_start = now;
+	}
+
+	current_phase = phase;
+
+	return prev;
+}
+
+void
+instrument_bitmap_memory(Size bytes)
+{
+	if (pgcheck_instrument && (bytes > pgcheck_instr.bitmap_bytes))
+		pgcheck_instr.bitmap_bytes = bytes;
+}
@@ -0,0 +1,59 @@
+#ifndef INSTRUMENT_CHECK_H
+#define INSTRUMENT_CHECK_H
+
+#include "postgres.h"
+#include "portability/instr_time.h"
+
+/* phase of the check (for timing) */
+typedef enum
+{
+	CHECK_PHASE_NONE,			/* not running a check */
+	CHECK_PHASE_READ,			/* reading pages into shared buffers */
+	CHECK_PHASE_LOCK,			/* locking the buffers */
+	CHECK_PHASE_COPY,			/* copying pages from shared buffers */
+	CHECK_PHASE_HEAP,			/* checks of heap pages */
+	CHECK_PHASE_TOAST,			/* verifying TOAST pointers */
+	CHECK_PHASE_INDEX,			/* checks of index pages */
+	CHECK_PHASE_BITMAP,			/* building heap bitmaps for the cross-check */
+	CHECK_PHASE_COMPARE			/* comparing heap and index bitmaps */
+}			CheckPhase;
+
+#define CHECK_PHASES	(CHECK_PHASE_COMPARE + 1)
+
+/*
+ * Instrumentation of the last check (pg_check.instrument = on), i.e. time
+ * spent in each phase (exclusive, time of nested phases is not included),
+ * buffer accesses and memory used by the cross-check bitmaps.
+ */
+typedef struct check_instrumentation
+{
+	bool		valid;			/* collected by the last check? */
+	instr_time	time[CHECK_PHASES];
+	int64		heap_pages;		/* heap pages checked */
+	int64		index_pages;	/* index pages checked */
+	int64		buffer_hits;	/* shared buffer hits */
+	int64		buffer_reads;	/* shared buffer reads */
+	Size		bitmap_bytes;	/* peak memory of the bitmaps */
+}			check_instrumentation;
+
+extern bool pgcheck_instrument;
+extern check_instrumentation pgcheck_instr;
+
+/* Starts a new check (called by the SQL functions) - resets the counters
+ * (so that results of an earlier check are not returned when not
+ * instrumenting this one) and the current phase. */
+void		instrument_start(void);
+
+/* Finishes the check - computes the buffer counters, and accounts time
+ * of the last phase. */
+void		instrument_end(void);
+
+/* Switches to a new phase, returns the previous one (so that the caller
+ * can switch back, e.g. after a nested index check). With instrumentation
+ * enabled, adds time since the last switch to the previous phase. */
+CheckPhase	instrument_phase(CheckPhase phase);
+
+/* Records memory used by bitmaps (keeps the maximum). */
+void		instrument_bitmap_memory(Size bytes);
+
+#endif							/* INSTRUMENT_CHECK_H */
@@ -1,9 +1,10 @@
 #include "item-bitmap.h"
 
 #include "access/itup.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
 
 #if (PG_VERSION_NUM >= 90300)
-#include <math.h>
 #include "access/nbtree.h"
 #include "access/htup_details.h"
 #endif
@@ -15,14 +16,34 @@
  */
 #define BITMAP_BYTES_PER_PAGE	((Size)(MaxHeapTuplesPerPage + 7) / 8)
 
+/*
+ * Bytes of the bitmap printed in a single message (a multiple of 3, so that
+ * the base64-encoded chunks can be simply concatenated). Also the size of
+ * the list of per-page item counts in a single message.
+ */
+#define BITMAP_PRINT_CHUNK		3072
+
 #define GetBitmapIndex(b,p,o)	\
 	((p - (b)->startpage) * MaxHeapTuplesPerPage + (o))
 
 #define GetBitmapByte(b,p,o)	(GetBitmapIndex(b,p,o) / 8)
 #define GetBitmapBit(b,p,o)		(GetBitmapIndex(b,p,o) % 8)
 
-static int	count_digits(uint64 values[], BlockNumber n);
-static char *itoa(int value, char *str, int maxlen);
+/* hash of a TID, for the per-page fingerprints (murmur3 finalizer) */
+static inline uint32
+tid_hash(BlockNumber page, int item)
+{
+	uint32		h = (page << 9) ^ (uint32) item ^ (page >> 23);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
 static char *hex(const char *data, int n);
 static char *binary(const char *data, int n);
 static char *base64(const char *data, int n);
@@ -48,6 +69,22 @@ bitmap_init(BlockNumber startpage, BlockNumber npages)
 	return bitmap;
 }
 
+/* init the bitmap in the fingerprint mode (no bits, only fingerprints) */
+item_bitmap *
+bitmap_init_fingerprint(BlockNumber startpage, BlockNumber npages)
+{
+	item_bitmap *bitmap;
+
+	bitmap = (item_bitmap *) palloc0(sizeof(item_bitmap));
+
+	bitmap->startpage = startpage;
+	bitmap->npages = npages;
+	bitmap->fingerprints = (tid_fingerprint *)
+		palloc0(sizeof(tid_fingerprint) * npages);
+
+	return bitmap;
+}
+
 /* copy the bitmap (except the actual bitmap data, keep zeroes) */
 item_bitmap *
 bitmap_copy(item_bitmap * src)
@@ -63,6 +100,13 @@ bitmap_copy(item_bitmap * src)
 	bitmap->npages = src->npages;
 	bitmap->nbytes = src->nbytes;
 
+	if (src->fingerprints)
+	{
+		bitmap->fingerprints = (tid_fingerprint *)
+			palloc0(sizeof(tid_fingerprint) * src->npages);
+		return bitmap;
+	}
+
 	bitmap->pages = (uint64 *) palloc(sizeof(uint64) * src->npages);
 	memcpy(bitmap->pages, src->pages, sizeof(uint64) * src->npages);
 
@@ -76,6 +120,13 @@ bitmap_copy(item_bitmap * src)
 void
 bitmap_reset(item_bitmap * bitmap)
 {
+	if (bitmap->fingerprints)
+	{
+		memset(bitmap->fingerprints, 0,
+			   sizeof(tid_fingerprint) * bitmap->npages);
+		return;
+	}
+
 	memset(bitmap->data, 0, bitmap->nbytes);
 }
 
@@ -85,28 +136,47 @@ bitmap_free(item_bitmap * bitmap)
 {
 	Assert(bitmap != NULL);
 
-	pfree(bitmap->pages);
-	pfree(bitmap->data);
+	if (bitmap->fingerprints)
+		pfree(bitmap->fingerprints);
+	else
+	{
+		pfree(bitmap->pages);
+		pfree(bitmap->data);
+	}
+
 	pfree(bitmap);
 }
 
-/* update the bitmap with all items from a page (tracks number of items) */
+/* memory used by the bitmap (including the struct) */
+Size
+bitmap_size(item_bitmap * bitmap)
+{
+	if (bitmap->fingerprints)
+		return sizeof(item_bitmap) + sizeof(tid_fingerprint) * bitmap->npages;
+
+	return sizeof(item_bitmap) + sizeof(uint64) * bitmap->npages + bitmap->nbytes;
+}
+
+/*
+ * Determine items on a heap page expected to be referenced from indexes,
+ * i.e. all items except for LP_UNUSED ones and heap-only tuples (members of
+ * HOT chains, referenced through the root item).
+ *
+ * For each such item, we also return offset of the tuple with the indexed
+ * values - the item itself, or the target of a LP_REDIRECT item (tuples in
+ * a HOT chain have the same indexed values). Dead items without storage
+ * have no tuple, so InvalidOffsetNumber is returned for those.
+ */
 int
-bitmap_add_heap_items(item_bitmap * bitmap, PageHeader header,
-					  char *raw_page, BlockNumber page)
+heap_page_index_items(PageHeader header, char *raw_page,
+					  OffsetNumber *items, OffsetNumber *tuples)
 {
-	/* tuple checks */
-	int			nerrs = 0;
 	int			ntuples = PageGetMaxOffsetNumber(raw_page);
+	int			nitems = 0;
 	int			item;
 	Page		p = (Page) raw_page;
 	bool		add[MaxHeapTuplesPerPage];
 
-	/* should we ignore this page entirely? */
-	if ((page < bitmap->startpage) ||
-		(page >= bitmap->startpage + bitmap->npages))
-		return nerrs;
-
 	/* assume we're adding all items from this heap page */
 	memset(add, 1, sizeof(add));
 
@@ -150,17 +220,77 @@ bitmap_add_heap_items(item_bitmap * bitmap, PageHeader header,
 
 	for (item = 0; item < ntuples; item++)
 	{
-		if (add[item])
-		{
-			/* increment number of items tracked on this page */
-			bitmap->pages[page]++;
-			bitmap_set(bitmap, page, item);
-		}
+		ItemId		lp = &header->pd_linp[item];
+
+		if (!add[item])
+			continue;
+
+		items[nitems] = (item + 1);
+		tuples[nitems] = InvalidOffsetNumber;
+
+		if (lp->lp_len > 0 &&
+			((lp->lp_flags == LP_NORMAL) || (lp->lp_flags == LP_DEAD)))
+			tuples[nitems] = (item + 1);
+		else if ((lp->lp_flags == LP_REDIRECT) &&
+				 (lp->lp_off >= FirstOffsetNumber) && (lp->lp_off <= ntuples) &&
+				 (header->pd_linp[lp->lp_off - 1].lp_flags == LP_NORMAL))
+			tuples[nitems] = lp->lp_off;
+
+		nitems++;
+	}
+
+	return nitems;
+}
+
+/* update the bitmap with all items from a page (tracks number of items) */
+int
+bitmap_add_heap_items(item_bitmap * bitmap, PageHeader header,
+					  char *raw_page, BlockNumber page)
+{
+	/* tuple checks */
+	int			nerrs = 0;
+	int			nitems;
+	int			i;
+	OffsetNumber items[MaxHeapTuplesPerPage];
+	OffsetNumber tuples[MaxHeapTuplesPerPage];
+
+	/* should we ignore this page entirely? */
+	if ((page < bitmap->startpage) ||
+		(page >= bitmap->startpage + bitmap->npages))
+		return nerrs;
+
+	nitems = heap_page_index_items(header, raw_page, items, tuples);
+
+	for (i = 0; i < nitems; i++)
+	{
+		/* increment number of items tracked on this page */
+		if (bitmap->pages)
+			bitmap->pages[page - bitmap->startpage]++;
+
+		bitmap_set(bitmap, page, items[i] - 1);
 	}
 
 	return nerrs;
 }
 
+/*
+ * Replace items with unknown status in the heap bitmap by the items from the
+ * index bitmap, so that they are not reported as differences.
+ */
+void
+bitmap_merge_unknown(item_bitmap * bitmap_heap, item_bitmap * bitmap_idx,
+					 item_bitmap * unknown)
+{
+	Size		i;
+
+	Assert(bitmap_heap->nbytes == bitmap_idx->nbytes);
+	Assert(bitmap_heap->nbytes == unknown->nbytes);
+
+	for (i = 0; i < bitmap_heap->nbytes; i++)
+		bitmap_heap->data[i] = (bitmap_heap->data[i] & ~unknown->data[i]) |
+			(bitmap_idx->data[i] & unknown->data[i]);
+}
+
 /* mark the (page,item) as occupied */
 void
 bitmap_set(item_bitmap * bitmap, BlockNumber page, int item)
@@ -173,9 +303,13 @@ bitmap_set(item_bitmap * bitmap, BlockNumber page, int item)
 		(page >= bitmap->startpage + bitmap->npages))
 		return;
 
-	if (page >= bitmap->npages)
+	/* only update the fingerprint of the page */
+	if (bitmap->fingerprints)
 	{
-		elog(WARNING, "invalid page %d (max page %d)", page, bitmap->npages - 1);
+		tid_fingerprint *fp = &bitmap->fingerprints[page - bitmap->startpage];
+
+		fp->ntids++;
+		fp->hash += tid_hash(page, item);
 		return;
 	}
 
@@ -196,16 +330,12 @@ bitmap_get(item_bitmap * bitmap, BlockNumber page, int item)
 	int			byte = GetBitmapByte(bitmap, page, item);
 	int			bit = GetBitmapBit(bitmap, page, item);
 
-	/* ignore pages outside the range */
+	/* ignore pages outside the range (and individual items are not known
+	 * in the fingerprint mode) */
 	if ((page < bitmap->startpage) ||
-		(page >= bitmap->startpage + bitmap->npages))
-		return false;
-
-	if (page >= bitmap->npages)
-	{
-		elog(WARNING, "invalid page %d (max page %d)", page, bitmap->npages - 1);
+		(page >= bitmap->startpage + bitmap->npages) ||
+		(bitmap->fingerprints != NULL))
 		return false;
-	}
 
 	if (byte > bitmap->nbytes)
 	{
@@ -216,6 +346,27 @@ bitmap_get(item_bitmap * bitmap, BlockNumber page, int item)
 	return (bitmap->data[byte] & (0x01 << bit));
 }
 
+/* add items from a regular bitmap to the fingerprints */
+void
+bitmap_add_fingerprints(item_bitmap * fingerprints, item_bitmap * bitmap)
+{
+	BlockNumber page;
+	OffsetNumber offset;
+
+	Assert(fingerprints->fingerprints && !bitmap->fingerprints);
+	Assert(fingerprints->npages == bitmap->npages);
+	Assert(fingerprints->startpage == bitmap->startpage);
+
+	for (page = bitmap->startpage; page < bitmap->startpage + bitmap->npages; page++)
+	{
+		for (offset = 0; offset < MaxHeapTuplesPerPage; offset++)
+		{
+			if (bitmap_get(bitmap, page, offset))
+				bitmap_set(fingerprints, page, offset);
+		}
+	}
+}
+
 /* counts bits set to 1 in the bitmap */
 uint64
 bitmap_count(item_bitmap * bitmap)
@@ -224,6 +375,14 @@ bitmap_count(item_bitmap * bitmap)
 	int			j;
 	uint64		items = 0;
 
+	if (bitmap->fingerprints)
+	{
+		for (i = 0; i < bitmap->npages; i++)
+			items += bitmap->fingerprints[i].ntids;
+
+		return items;
+	}
+
 	for (i = 0; i < bitmap->nbytes; i++)
 	{
 		for (j = 0; j < 8; j++)
@@ -241,7 +400,6 @@ uint64
 bitmap_compare(item_bitmap * bitmap_a, item_bitmap * bitmap_b)
 {
 	BlockNumber block;
-	OffsetNumber offset;
 	uint64		ndiff;
 
 	Assert(bitmap_a->nbytes == bitmap_b->nbytes);
@@ -251,84 +409,170 @@ bitmap_compare(item_bitmap * bitmap_a, item_bitmap * bitmap_b)
 	/* the actual check, compares the bits one by one */
 	ndiff = 0;
 	for (block = bitmap_a->startpage; block < bitmap_a->startpage + bitmap_a->npages; block++)
+		ndiff += bitmap_compare_page(bitmap_a, bitmap_b, block);
+
+	return ndiff;
+}
+
+/* compare items on a single page, returns number of differences */
+uint64
+bitmap_compare_page(item_bitmap * bitmap_a, item_bitmap * bitmap_b,
+					BlockNumber page)
+{
+	OffsetNumber offset;
+	uint64		ndiff = 0;
+
+	for (offset = 0; offset < MaxHeapTuplesPerPage; offset++)
 	{
-		for (offset = 0; offset < MaxHeapTuplesPerPage; offset++)
+		if (bitmap_get(bitmap_a, page, offset) != bitmap_get(bitmap_b, page, offset))
 		{
-			if (bitmap_get(bitmap_a, block, offset) != bitmap_get(bitmap_a, block, offset))
-			{
-				elog(WARNING, "bitmap mismatch of [%u,%d]", block, offset);
-				ndiff++;
-			}
+			elog(WARNING, "bitmap mismatch of [%u,%d] (%s)", page, offset,
+				 bitmap_get(bitmap_a, page, offset) ? "not in index" : "not in heap");
+			ndiff++;
 		}
 	}
 
-	return 0;
+	return ndiff;
 }
 
-/* Prints the info about the bitmap and the data as a series of 0/1. */
-/* TODO print details about differences (items missing in heap, items missing in index) */
-void
-bitmap_print(item_bitmap * bitmap, BitmapFormat format)
+/* compare per-page fingerprints, returns pages with different fingerprints */
+BlockNumber
+bitmap_compare_fingerprints(item_bitmap * bitmap_a, item_bitmap * bitmap_b,
+							BlockNumber **pages)
 {
-	int			i = 0;
-	int			len = count_digits(bitmap->pages, bitmap->npages) + bitmap->npages;
-	char		pages[len];
-	char	   *ptr = pages;
-	char	   *data = NULL;
+	BlockNumber i;
+	BlockNumber npages = 0;
 
-	ptr[0] = '\0';
-	for (i = 0; i < bitmap->npages; i++)
+	Assert(bitmap_a->fingerprints && bitmap_b->fingerprints);
+	Assert(bitmap_a->npages == bitmap_b->npages);
+	Assert(bitmap_a->startpage == bitmap_b->startpage);
+
+	*pages = NULL;
+
+	for (i = 0; i < bitmap_a->npages; i++)
 	{
-		ptr = itoa(bitmap->pages[i], ptr, len - (ptr - pages));
-		*(ptr++) = ',';
+		tid_fingerprint *a = &bitmap_a->fingerprints[i];
+		tid_fingerprint *b = &bitmap_b->fingerprints[i];
+
+		if ((a->ntids == b->ntids) && (a->hash == b->hash))
+			continue;
+
+		/* mismatches are rare, so allocate the array lazily */
+		if (*pages == NULL)
+			*pages = (BlockNumber *) palloc(sizeof(BlockNumber) * bitmap_a->npages);
+
+		(*pages)[npages++] = bitmap_a->startpage + i;
 	}
-	*(--ptr) = '\0';
-
-	/* encode as binary or hex */
-	if (format == BITMAP_BINARY)
-		data = binary(bitmap->data, bitmap->nbytes);
-	else if (format == BITMAP_BASE64)
-		data = base64(bitmap->data, bitmap->nbytes);
-	else if (format == BITMAP_HEX)
-		data = hex(bitmap->data, bitmap->nbytes);
-	else if (format == BITMAP_NONE)
+
+	return npages;
+}
+
+/* find pages with different items, returns number of such pages */
+BlockNumber
+bitmap_diff_pages(item_bitmap * bitmap_a, item_bitmap * bitmap_b,
+				  BlockNumber **pages)
+{
+	BlockNumber i;
+	BlockNumber npages = 0;
+
+	Assert(!bitmap_a->fingerprints && !bitmap_b->fingerprints);
+	Assert(bitmap_a->nbytes == bitmap_b->nbytes);
+	Assert(bitmap_a->startpage == bitmap_b->startpage);
+
+	*pages = NULL;
+
+	for (i = 0; i < bitmap_a->npages; i++)
 	{
-		data = palloc(1);
-		data[0] = '\0';
+		BlockNumber page = bitmap_a->startpage + i;
+		OffsetNumber offset;
+
+		for (offset = 0; offset < MaxHeapTuplesPerPage; offset++)
+		{
+			if (bitmap_get(bitmap_a, page, offset) != bitmap_get(bitmap_b, page, offset))
+				break;
+		}
+
+		if (offset == MaxHeapTuplesPerPage)
+			continue;
+
+		/* differences are rare, so allocate the array lazily */
+		if (*pages == NULL)
+			*pages = (BlockNumber *) palloc(sizeof(BlockNumber) * bitmap_a->npages);
+
+		(*pages)[npages++] = page;
 	}
 
-	if (format == BITMAP_NONE)
+	return npages;
+}
+
+/*
+ * Prints the info about the bitmap, the item counts of pages and the data.
+ * The bitmap of a large table may be hundreds of MBs (and a multiple of that
+ * once encoded), so the output is split into messages of bounded size.
+ */
+void
+bitmap_print(item_bitmap * bitmap, BitmapFormat format)
+{
+	StringInfoData buf;
+	BlockNumber i,
+				first = 0;
+	Size		offset;
+
+	if (bitmap->fingerprints)
 	{
-		elog(WARNING, "bitmap nbytes=%zu nbits=%ld npages=%d pages=[%s]",
-			 bitmap->nbytes, bitmap_count(bitmap), bitmap->npages, pages);
+		elog(WARNING, "bitmap fingerprints npages=%d nitems=" UINT64_FORMAT,
+			 bitmap->npages, bitmap_count(bitmap));
+		return;
 	}
-	else
+
+	elog(WARNING, "bitmap nbytes=%zu nbits=" UINT64_FORMAT " npages=%d",
+		 bitmap->nbytes, bitmap_count(bitmap), bitmap->npages);
+
+	/* number of items on each page (in chunks of pages) */
+	initStringInfo(&buf);
+
+	for (i = 0; i < bitmap->npages; i++)
 	{
-		elog(WARNING, "bitmap nbytes=%zu nbits=%ld npages=%d pages=[%s] data=[%s]",
-			 bitmap->nbytes, bitmap_count(bitmap), bitmap->npages, pages, data);
+		if (buf.len > 0)
+			appendStringInfoChar(&buf, ',');
+
+		appendStringInfo(&buf, UINT64_FORMAT, bitmap->pages[i]);
+
+		if ((buf.len >= BITMAP_PRINT_CHUNK) || (i == bitmap->npages - 1))
+		{
+			elog(WARNING, "bitmap pages [%u,%u] items=[%s]",
+				 bitmap->startpage + first, bitmap->startpage + i, buf.data);
+
+			resetStringInfo(&buf);
+			first = i + 1;
+		}
 	}
 
-	pfree(data);
-}
+	pfree(buf.data);
 
-/* count digits to print the array (in ASCII) */
-static int
-count_digits(uint64 values[], BlockNumber n)
-{
-	int			i,
-				digits = 0;
+	if (format == BITMAP_NONE)
+		return;
 
-	for (i = 0; i < n; i++)
-		digits += (int) ceil(log(values[i]) / log(10));
+	/* encode the data as binary, hex or base64 (in chunks of bytes) */
+	for (offset = 0; offset < bitmap->nbytes; offset += BITMAP_PRINT_CHUNK)
+	{
+		int			n = Min(BITMAP_PRINT_CHUNK, bitmap->nbytes - offset);
+		char	   *data = NULL;
 
-	return digits;
-}
+		CHECK_FOR_INTERRUPTS();
 
-/* utility to fill an integer value in a given value */
-static char *
-itoa(int value, char *str, int maxlen)
-{
-	return str + snprintf(str, maxlen, "%d", value);
+		if (format == BITMAP_BINARY)
+			data = binary(bitmap->data + offset, n);
+		else if (format == BITMAP_BASE64)
+			data = base64(bitmap->data + offset, n);
+		else if (format == BITMAP_HEX)
+			data = hex(bitmap->data + offset, n);
+
+		elog(WARNING, "bitmap bytes [%zu,%zu] data=[%s]",
+			 offset, offset + n - 1, data);
+
+		pfree(data);
+	}
 }
 
 /* encode data to hex */
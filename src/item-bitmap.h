@@ -15,6 +15,26 @@ typedef enum
 	BITMAP_NONE
 }			BitmapFormat;
 
+/* how to cross-check heap and indexes */
+typedef enum
+{
+	CROSS_CHECK_BITMAP,			/* bitmap with a bit for each TID */
+	CROSS_CHECK_FINGERPRINT,	/* per-block TID fingerprints */
+	CROSS_CHECK_PROBE			/* probe b-tree indexes with sampled tuples */
+}			CrossCheckMethod;
+
+/*
+ * Fingerprint of TIDs pointing to a heap block - number of TIDs and a sum
+ * of their hashes, so that it does not depend on the order of TIDs (index
+ * scans don't see them in the heap order). Equal sets of TIDs have equal
+ * fingerprints, and different sets very likely have different ones.
+ */
+typedef struct tid_fingerprint
+{
+	uint32		ntids;
+	uint32		hash;
+}			tid_fingerprint;
+
 /* bitmap, used to cross-check heap and indexes */
 typedef struct item_bitmap
 {
@@ -32,6 +52,15 @@ typedef struct item_bitmap
 
 	/* data of the bitmap (0/1 for each item) */
 	char	   *data;
+
+	/* per-page fingerprints (fingerprint mode, without pages/data) */
+	tid_fingerprint *fingerprints;
+
+	/*
+	 * built from an index modified concurrently (online cross-check), so the
+	 * same TID may be seen repeatedly (e.g. tuples moved by a page split)
+	 */
+	bool		concurrent;
 }			item_bitmap;
 
 
@@ -49,6 +78,18 @@ typedef struct item_bitmap
  */
 item_bitmap *bitmap_init(BlockNumber startpage, BlockNumber npages);
 
+/* Allocates new bitmap in the fingerprint mode, sized for n pages.
+ *
+ * Instead of a bit for each possible item, the bitmap only tracks the
+ * fingerprint of items on each page (8B per page, instead of ~40B). That
+ * is enough to detect differences, but not to tell which items differ -
+ * that has to be done by building a regular bitmap for the pages with
+ * different fingerprints.
+ *
+ * Returns the allocated bitmap.
+ */
+item_bitmap *bitmap_init_fingerprint(BlockNumber startpage, BlockNumber npages);
+
 /* Copies the item bitmap (except the actual bitmap data, keeps zeroes).
  *
  * This is used to prepare a bitmap for index, matching the heap bitmap.
@@ -59,6 +100,9 @@ item_bitmap *bitmap_copy(item_bitmap * src);	/* preallocate empty bitmap */
 /* Releases the bitmap, including the inner resources (allocated memory). */
 void		bitmap_free(item_bitmap * bitmap);
 
+/* Returns memory used by the bitmap (in bytes). */
+Size		bitmap_size(item_bitmap * bitmap);
+
 /* Resets the bitmap data (not the page counts) so that it can be reused
  * for another index on a given heap relation. */
 void		bitmap_reset(item_bitmap * bitmap);
@@ -75,6 +119,28 @@ void		bitmap_reset(item_bitmap * bitmap);
 int bitmap_add_heap_items(item_bitmap * bitmap, PageHeader header,
 					  char *raw_page, BlockNumber page);
 
+/* Determines items on the heap page expected to be referenced from indexes
+ * (e.g. roots of HOT chains, not the heap-only tuples).
+ *
+ * - items : offsets of the items (output, MaxHeapTuplesPerPage elements)
+ * - tuples : offsets of the tuples with the indexed values (the item itself
+ *            or the redirect target), or InvalidOffsetNumber for items
+ *            without a tuple (dead items without storage)
+ *
+ * Returns number of items.
+ */
+int heap_page_index_items(PageHeader header, char *raw_page,
+					  OffsetNumber *items, OffsetNumber *tuples);
+
+/* Replaces items marked in the 'unknown' bitmap in the heap bitmap with the
+ * items from the index bitmap (i.e. the items are not compared at all). Used
+ * for items we can't decide if they should be in the index (dead items of
+ * a partial index, without the tuple to evaluate the predicate on).
+ */
+void		bitmap_merge_unknown(item_bitmap * bitmap_heap,
+								 item_bitmap * bitmap_idx,
+								 item_bitmap * unknown);
+
 /* Updates the bitmap with all items from the index (b-tree leaf) page.
  *
  * - bitmap : bitmap to update
@@ -87,6 +153,13 @@ int bitmap_add_heap_items(item_bitmap * bitmap, PageHeader header,
 int bitmap_add_index_items(item_bitmap * bitmap, PageHeader header,
 					   char *raw_page, BlockNumber page);
 
+/* Adds items from a regular bitmap to fingerprints of the same pages. Used
+ * for indexes that may reference a TID repeatedly (which would be counted
+ * repeatedly if added to the fingerprints directly).
+ */
+void		bitmap_add_fingerprints(item_bitmap * fingerprints,
+									item_bitmap * bitmap);
+
 /* Counts the bits set to 1 in the bitmap
  *
  * - bitmap : bitmap to count
@@ -105,10 +178,39 @@ uint64		bitmap_count(item_bitmap * bitmap);
  */
 uint64		bitmap_compare(item_bitmap * bitmap_a, item_bitmap * bitmap_b);
 
-/* Prints the info about the bitmap and the data as a series of 0/1. */
+/* Compares items on a single page in two bitmaps.
+ *
+ * Returns number of differences on the page.
+ */
+uint64		bitmap_compare_page(item_bitmap * bitmap_a, item_bitmap * bitmap_b,
+								BlockNumber page);
+
+/* Compares fingerprints of two bitmaps (in the fingerprint mode).
+ *
+ * - pages : output array of pages with different fingerprints (sorted)
+ *
+ * Returns number of pages with different fingerprints.
+ */
+BlockNumber bitmap_compare_fingerprints(item_bitmap * bitmap_a,
+										item_bitmap * bitmap_b,
+										BlockNumber **pages);
+
+/* Finds pages with different items in two bitmaps (without reporting the
+ * differences, unlike bitmap_compare).
+ *
+ * - pages : output array of pages with differences (sorted)
+ *
+ * Returns number of pages with differences.
+ */
+BlockNumber bitmap_diff_pages(item_bitmap * bitmap_a, item_bitmap * bitmap_b,
+							  BlockNumber **pages);
+
+/* Prints the info about the bitmap, the per-page item counts and the data
+ * (in the requested format), split into multiple messages of bounded size. */
 void		bitmap_print(item_bitmap * bitmap, BitmapFormat format);
 
 void		bitmap_set(item_bitmap * bitmap, BlockNumber page, int item);
+
 bool		bitmap_get(item_bitmap * bitmap, BlockNumber page, int item);
 
 #endif							/* HEAP_CHECK_H */
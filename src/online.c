@@ -0,0 +1,235 @@
+#include "postgres.h"
+
+#include "access/htup.h"
+#if (PG_VERSION_NUM >= 90300)
+#include "access/htup_details.h"
+#endif
+#include "access/subtrans.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "utils/snapmgr.h"
+
+#include "online.h"
+
+static Snapshot online_snapshot(void);
+static bool online_xid_in_snapshot(Snapshot snapshot, TransactionId xid);
+static bool online_tuple_indexed(online_check * online,
+					 HeapTupleHeader tupheader);
+
+/* allocate the state, and register the snapshot */
+online_check *
+online_check_init(Relation rel)
+{
+	online_check *online = (online_check *) palloc0(sizeof(online_check));
+
+	online->snapshot = online_snapshot();
+	online->xids = xid_check_init(rel);
+
+	return online;
+}
+
+/* free the state */
+void
+online_check_free(online_check * online)
+{
+	Assert(online->recheck == NULL);
+
+	UnregisterSnapshot(online->snapshot);
+	xid_check_free(online->xids);
+
+	pfree(online);
+}
+
+/* register the snapshot for re-checking blocks with differences */
+void
+online_recheck_begin(online_check * online)
+{
+	Assert(online->recheck == NULL);
+
+	online->recheck = online_snapshot();
+}
+
+/* unregister the snapshot for re-checking */
+void
+online_recheck_end(online_check * online)
+{
+	UnregisterSnapshot(online->recheck);
+	online->recheck = NULL;
+}
+
+/*
+ * Register a new snapshot. Parallel workers (checking partitions) can't take
+ * new snapshots, so there we use the active one (from the start of the query)
+ * which is older, and thus only makes the check more conservative.
+ */
+static Snapshot
+online_snapshot(void)
+{
+#if (PG_VERSION_NUM >= 90500)
+	if (IsInParallelMode())
+		return RegisterSnapshot(GetActiveSnapshot());
+#endif
+
+	return RegisterSnapshot(GetLatestSnapshot());
+}
+
+/*
+ * Was the transaction running (or not started yet) when the snapshot was
+ * taken? Does the same thing as XidInMVCCSnapshot (which is not available
+ * in older releases), including the lookups of subtransaction parents.
+ */
+static bool
+online_xid_in_snapshot(Snapshot snapshot, TransactionId xid)
+{
+	int			i;
+
+	if (TransactionIdPrecedes(xid, snapshot->xmin))
+		return false;
+
+	if (TransactionIdFollowsOrEquals(xid, snapshot->xmax))
+		return true;
+
+	/* the subxip array overflowed, so look for the top-level XID */
+	if (snapshot->suboverflowed)
+	{
+		xid = SubTransGetTopmostTransaction(xid);
+
+		if (TransactionIdPrecedes(xid, snapshot->xmin))
+			return false;
+	}
+	else
+	{
+		for (i = 0; i < snapshot->subxcnt; i++)
+		{
+			if (TransactionIdEquals(xid, snapshot->subxip[i]))
+				return true;
+		}
+	}
+
+	for (i = 0; i < snapshot->xcnt; i++)
+	{
+		if (TransactionIdEquals(xid, snapshot->xip[i]))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Decides whether the index entries for the tuple certainly exist, and can't
+ * be removed by a concurrent vacuum while we hold the snapshot.
+ *
+ * The inserting transaction has to be committed (or still running, as that
+ * inserts the index entries right after the heap tuple). When re-checking,
+ * it has to be visible to the recheck snapshot, i.e. committed before the
+ * index was scanned again - tuples inserted later are ignored.
+ *
+ * The tuple must not be deleted by a transaction visible to the snapshot, as
+ * such tuples may be dead to everyone, and vacuum may remove the entries at
+ * any time. Multixacts (other than lockers) are treated the same way.
+ *
+ * Tuples we can't decide about are not compared with the index at all. We
+ * never look up status of XIDs outside the valid range for the relation.
+ */
+static bool
+online_tuple_indexed(online_check * online, HeapTupleHeader tupheader)
+{
+	TransactionId xmin = HeapTupleHeaderGetRawXmin(tupheader);
+	TransactionId xmax = HeapTupleHeaderGetRawXmax(tupheader);
+	xid_check  *xids = online->xids;
+
+	/* inserting transaction (committed, frozen or our own) */
+	if (HeapTupleHeaderXminInvalid(tupheader))
+		return false;
+
+	if (TransactionIdIsNormal(xmin) &&
+		!TransactionIdIsCurrentTransactionId(xmin))
+	{
+		CheckXidStatus status = CHECK_XID_COMMITTED;
+
+		if (!HeapTupleHeaderXminCommitted(tupheader))
+		{
+			if (!xid_in_range(xids, xmin))
+				return false;
+
+			status = xid_get_status(xids, xmin);
+		}
+
+		if (status == CHECK_XID_ABORTED)
+			return false;
+
+		/* when re-checking, the insert has to be older than the index scan */
+		if (online->recheck &&
+			((status != CHECK_XID_COMMITTED) ||
+			 online_xid_in_snapshot(online->recheck, xmin)))
+			return false;
+	}
+
+	/* deleting transaction */
+	if ((tupheader->t_infomask & HEAP_XMAX_INVALID) ||
+		!TransactionIdIsValid(xmax) ||
+		HEAP_XMAX_IS_LOCKED_ONLY(tupheader->t_infomask))
+		return true;
+
+	if (tupheader->t_infomask & HEAP_XMAX_IS_MULTI)
+		return false;
+
+	if (TransactionIdIsCurrentTransactionId(xmax))
+		return true;
+
+	if (!xid_in_range(xids, xmax))
+		return false;
+
+	/* deleted by a running or aborted transaction */
+	if (!(tupheader->t_infomask & HEAP_XMAX_COMMITTED) &&
+		(xid_get_status(xids, xmax) != CHECK_XID_COMMITTED))
+		return true;
+
+	/* deleted, but the snapshot still sees the tuple (so it's not vacuumed) */
+	return online_xid_in_snapshot(online->snapshot, xmax);
+}
+
+/* update the bitmaps with items from a page (indexed or unknown) */
+void
+online_add_heap_items(online_check * online, item_bitmap * bitmap,
+					  item_bitmap * unknown, PageHeader header,
+					  char *raw_page, BlockNumber page)
+{
+	int			nitems;
+	int			i;
+	OffsetNumber items[MaxHeapTuplesPerPage];
+	OffsetNumber tuples[MaxHeapTuplesPerPage];
+
+	/* should we ignore this page entirely? */
+	if ((page < unknown->startpage) ||
+		(page >= unknown->startpage + unknown->npages))
+		return;
+
+	nitems = heap_page_index_items(header, raw_page, items, tuples);
+
+	for (i = 0; i < nitems; i++)
+	{
+		ItemId		lp = &header->pd_linp[items[i] - 1];
+		bool		indexed = false;
+
+		/*
+		 * Dead items (with or without storage) may be removed from indexes
+		 * by a concurrent vacuum. Otherwise decide using the tuple (the item
+		 * itself or the first tuple of the HOT chain).
+		 */
+		if ((tuples[i] != InvalidOffsetNumber) && (lp->lp_flags != LP_DEAD))
+			indexed = online_tuple_indexed(online,
+										   (HeapTupleHeader) PageGetItem((Page) raw_page,
+																		 &header->pd_linp[tuples[i] - 1]));
+
+		if (!indexed)
+			bitmap_set(unknown, page, items[i] - 1);
+		else if (bitmap)
+		{
+			if (bitmap->pages)
+				bitmap->pages[page - bitmap->startpage]++;
+
+			bitmap_set(bitmap, page, items[i] - 1);
+		}
+	}
+}
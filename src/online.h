@@ -0,0 +1,47 @@
+#ifndef ONLINE_CHECK_H
+#define ONLINE_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+#include "utils/snapshot.h"
+
+#include "item-bitmap.h"
+#include "xid.h"
+
+/*
+ * State of the online cross-check, i.e. cross-check of the table and
+ * indexes without locks preventing concurrent changes (AccessShareLock).
+ *
+ * Tuples inserted or deleted concurrently may or may not be in the index
+ * (yet), so the snapshots are used to decide which heap items certainly
+ * have to be in the index - the other items are not compared at all.
+ */
+typedef struct online_check
+{
+	Snapshot	snapshot;		/* registered before the heap pass */
+	Snapshot	recheck;		/* registered before re-scanning the index */
+	xid_check  *xids;			/* cached XID status lookups */
+}			online_check;
+
+/* Registers the snapshot, and allocates the state (with the XID cache). */
+online_check *online_check_init(Relation rel);
+
+/* Unregisters the snapshots, and releases the state. */
+void		online_check_free(online_check * online);
+
+/* Registers a new snapshot before re-scanning the index (the second pass
+ * over the blocks with differences), and unregisters it at the end.
+ */
+void		online_recheck_begin(online_check * online);
+void		online_recheck_end(online_check * online);
+
+/* Updates the bitmap with items from the heap page that certainly have to
+ * be in the index. The remaining items (concurrently inserted or deleted
+ * tuples, dead items) are added to the 'unknown' bitmap instead. The bitmap
+ * may be NULL, when only the unknown items are needed.
+ */
+void		online_add_heap_items(online_check * online, item_bitmap * bitmap,
+								  item_bitmap * unknown, PageHeader header,
+								  char *raw_page, BlockNumber page);
+
+#endif							/* ONLINE_CHECK_H */
@@ -0,0 +1,184 @@
+#include "postgres.h"
+
+#include "partition.h"
+
+#if (PG_VERSION_NUM >= 100000)
+
+#include "access/parallel.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#if (PG_VERSION_NUM >= 120000)
+#include "catalog/pg_inherits.h"
+#else
+#include "catalog/pg_inherits_fn.h"
+#endif
+#include "miscadmin.h"
+#include "storage/bufmgr.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+
+/* key of the shared list of partitions in the DSM segment */
+#define PARTITION_KEY_SHARED	UINT64CONST(0xFFFFFFFFFF000001)
+
+#define PartitionSharedSize(n) \
+	(offsetof(partition_shared, parts) + (n) * sizeof(partition_result))
+
+static int	partition_cmp_size(const void *a, const void *b);
+
+/* expand the partition tree, keep only the leaf partitions */
+partition_shared *
+partition_expand(Relation rel, LOCKMODE lockmode, partition_args * args)
+{
+	List	   *relids;
+	ListCell   *lc;
+	partition_shared *shared;
+	int			nparts = 0;
+
+	/* locks all the partitions, so that none of them can go away */
+	relids = find_all_inheritors(RelationGetRelid(rel), lockmode, NULL);
+
+	shared = (partition_shared *) palloc0(PartitionSharedSize(list_length(relids)));
+
+	memcpy(&shared->args, args, sizeof(partition_args));
+
+	foreach(lc, relids)
+	{
+		Oid			relid = lfirst_oid(lc);
+		Relation	partrel;
+
+		/* only leaf partitions have storage (skip foreign tables etc.) */
+		if (get_rel_relkind(relid) != RELKIND_RELATION)
+			continue;
+
+		partrel = relation_open(relid, NoLock);
+
+		shared->parts[nparts].relid = relid;
+		shared->parts[nparts].nblocks = RelationGetNumberOfBlocks(partrel);
+		nparts++;
+
+		relation_close(partrel, NoLock);
+	}
+
+	shared->nparts = nparts;
+
+	/*
+	 * Check the largest partitions first, so that a single huge partition
+	 * claimed at the very end does not leave the other workers idle.
+	 */
+	qsort(shared->parts, nparts, sizeof(partition_result), partition_cmp_size);
+
+	list_free(relids);
+
+	return shared;
+}
+
+/* sort partitions by size (descending) */
+static int
+partition_cmp_size(const void *a, const void *b)
+{
+	const partition_result *pa = (const partition_result *) a;
+	const partition_result *pb = (const partition_result *) b;
+
+	if (pa->nblocks > pb->nblocks)
+		return -1;
+	else if (pa->nblocks < pb->nblocks)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Check all the partitions, with the help of parallel workers. The list of
+ * partitions is copied into a DSM segment, and the workers (and the leader)
+ * claim them one by one until none are left. Then the results are copied
+ * back to the local list.
+ *
+ * The workers are in the same lock group as the leader, so they can open
+ * the partitions despite the locks held by the leader. Messages (warnings
+ * about issues found) from the workers are forwarded to the client by the
+ * leader.
+ */
+void
+partition_check_all(partition_shared * shared, int nworkers,
+					const char *worker_function, partition_check_cb check)
+{
+	ParallelContext *pcxt;
+	partition_shared *dsm_shared;
+	Size		size = PartitionSharedSize(shared->nparts);
+
+	/* no point in starting more workers than partitions (leader helps) */
+	nworkers = Min(nworkers, shared->nparts - 1);
+
+	if (nworkers <= 0)
+	{
+		pg_atomic_init_u32(&shared->next, 0);
+		partition_check_loop(shared, check);
+		return;
+	}
+
+	EnterParallelMode();
+
+#if (PG_VERSION_NUM >= 110000 && PG_VERSION_NUM < 120000)
+	pcxt = CreateParallelContext("pg_check", worker_function, nworkers, false);
+#else
+	pcxt = CreateParallelContext("pg_check", worker_function, nworkers);
+#endif
+
+	shm_toc_estimate_chunk(&pcxt->estimator, size);
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+
+	InitializeParallelDSM(pcxt);
+
+	/* may be NULL when DSM is not available (then the leader does all) */
+	if (pcxt->seg != NULL)
+	{
+		dsm_shared = (partition_shared *) shm_toc_allocate(pcxt->toc, size);
+		memcpy(dsm_shared, shared, size);
+		shm_toc_insert(pcxt->toc, PARTITION_KEY_SHARED, dsm_shared);
+	}
+	else
+		dsm_shared = shared;
+
+	pg_atomic_init_u32(&dsm_shared->next, 0);
+
+	LaunchParallelWorkers(pcxt);
+
+	ereport(DEBUG1,
+			(errmsg("checking %d partitions using %d parallel workers",
+					shared->nparts, pcxt->nworkers_launched)));
+
+	partition_check_loop(dsm_shared, check);
+
+	WaitForParallelWorkersToFinish(pcxt);
+
+	if (dsm_shared != shared)
+		memcpy(shared->parts, dsm_shared->parts,
+			   shared->nparts * sizeof(partition_result));
+
+	DestroyParallelContext(pcxt);
+
+	ExitParallelMode();
+}
+
+/* claim partitions one by one, and check them */
+void
+partition_check_loop(partition_shared * shared, partition_check_cb check)
+{
+	uint32		i;
+
+	while ((i = pg_atomic_fetch_add_u32(&shared->next, 1)) < shared->nparts)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		shared->parts[i].nerrs = check(shared->parts[i].relid, &shared->args);
+	}
+}
+
+/* find the shared list of partitions (in a parallel worker) */
+partition_shared *
+partition_worker_shared(shm_toc * toc)
+{
+	return (partition_shared *) shm_toc_lookup(toc, PARTITION_KEY_SHARED, false);
+}
+
+#endif							/* PG_VERSION_NUM >= 100000 */
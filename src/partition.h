@@ -0,0 +1,70 @@
+#ifndef PARTITION_CHECK_H
+#define PARTITION_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+/* partitioned tables were introduced in 10 */
+#if (PG_VERSION_NUM >= 100000)
+
+#include "port/atomics.h"
+#include "storage/shm_toc.h"
+
+/* options of the check, the same for all partitions */
+typedef struct partition_args
+{
+	bool		checkIndexes;
+	bool		crossCheck;
+	bool		online;			/* cross-check under AccessShareLock */
+	bool		quick;
+	double		sampleFraction;
+	int64		sampleBlocks;
+}			partition_args;
+
+/* a leaf partition to check, and the result */
+typedef struct partition_result
+{
+	Oid			relid;
+	BlockNumber nblocks;		/* size (when expanding the tree) */
+	uint32		nerrs;			/* number of issues found */
+}			partition_result;
+
+/*
+ * List of partitions, shared by the leader and the parallel workers (the
+ * partitions are claimed by incrementing 'next').
+ */
+typedef struct partition_shared
+{
+	partition_args args;
+	pg_atomic_uint32 next;		/* next partition to check */
+	int			nparts;
+	partition_result parts[FLEXIBLE_ARRAY_MEMBER];
+}			partition_shared;
+
+/* checks a single partition (calls check_table) */
+typedef uint32 (*partition_check_cb) (Oid relid, partition_args * args);
+
+/* Expands the partition tree into a list of leaf partitions (locked in the
+ * requested mode), sorted by size (largest first).
+ */
+partition_shared *partition_expand(Relation rel, LOCKMODE lockmode,
+								   partition_args * args);
+
+/* Checks all the partitions, using up to nworkers parallel workers (the
+ * leader participates too). The workers run the worker_function from the
+ * library, which is expected to call partition_check_loop.
+ */
+void		partition_check_all(partition_shared * shared, int nworkers,
+								const char *worker_function,
+								partition_check_cb check);
+
+/* Claims partitions one by one, and checks them until none are left. */
+void		partition_check_loop(partition_shared * shared,
+								 partition_check_cb check);
+
+/* Looks up the shared list of partitions in a parallel worker. */
+partition_shared *partition_worker_shared(shm_toc * toc);
+
+#endif							/* PG_VERSION_NUM >= 100000 */
+
+#endif							/* PARTITION_CHECK_H */
@@ -11,6 +11,14 @@
 
 #include "postgres.h"
 
+/* sampling (utils/sampling.h) and the XID checks need newer releases */
+#if (PG_VERSION_NUM < 90500)
+#error "pg_check requires PostgreSQL 9.5 or newer"
+#endif
+
+#if (PG_VERSION_NUM >= 90300)
+#include "access/htup_details.h"
+#endif
 #include "access/itup.h"
 #include "access/nbtree.h"
 #include "catalog/namespace.h"
@@ -26,12 +34,24 @@
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/relcache.h"
 #include "utils/guc.h"
+#include "utils/tuplestore.h"
 
+#include "brin.h"
 #include "common.h"
 #include "index.h"
+#include "index-expr.h"
 #include "heap.h"
+#include "instrument.h"
 #include "item-bitmap.h"
+#include "online.h"
+#include "partition.h"
+#include "probe.h"
+#include "sample.h"
+#include "stats.h"
+#include "toast.h"
+#include "vm.h"
 
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
@@ -48,23 +68,104 @@ static const struct config_enum_entry bitmap_options[] = {
 	{NULL, 0, false}
 };
 
+/* cross-check method (when cross-checking indexes) */
+static const struct config_enum_entry cross_check_options[] = {
+	{"bitmap", CROSS_CHECK_BITMAP, false},
+	{"fingerprint", CROSS_CHECK_FINGERPRINT, false},
+	{"probe", CROSS_CHECK_PROBE, false},
+	{NULL, 0, false}
+};
+
 void		_PG_init(void);
 
 bool		pgcheck_debug;
 int			pgcheck_bitmap_format = BITMAP_BINARY;
+bool		pgcheck_check_toast = false;
+bool		pgcheck_check_compression = false;
+bool		pgcheck_check_encoding = false;
+bool		pgcheck_check_datums = false;
+bool		pgcheck_check_vm = true;
+bool		pgcheck_check_xids = true;
+double		pgcheck_frozen_sample_rate = 0.01;
+int			pgcheck_cross_check_method = CROSS_CHECK_BITMAP;
+double		pgcheck_probe_sample_rate = 0.01;
+int			pgcheck_max_parallel_workers = 2;
 
 Datum		pg_check_table(PG_FUNCTION_ARGS);
 Datum		pg_check_index(PG_FUNCTION_ARGS);
+Datum		pg_check_partitions(PG_FUNCTION_ARGS);
+Datum		pg_check_instrumentation(PG_FUNCTION_ARGS);
+Datum		pg_check_stats(PG_FUNCTION_ARGS);
+Datum		pg_check_stats_reset(PG_FUNCTION_ARGS);
+
+/*
+ * Partial index, cross-checked with a separate heap bitmap (only items
+ * matching the index predicate are expected in the index). Hash indexes are
+ * handled the same way, as they don't contain items with NULL keys.
+ */
+typedef struct partial_index
+{
+	Oid			indexOid;
+	Relation	indexrel;
+	index_expr_state *expr;		/* evaluates the predicate */
+	item_bitmap *bitmap;		/* heap items matching the predicate */
+}			partial_index;
 
 static uint32 check_table(Oid relid,
 			bool checkIndexes, bool crossCheckIndexes,
 			BlockNumber blockFrom, BlockNumber blockTo,
-			bool blockRangeGiven);
+			bool blockRangeGiven, bool quick,
+			double sampleFraction, int64 sampleBlocks,
+			bool online);
+
+static bool check_frozen_page(Relation rel, BlockNumber blkno,
+				  BufferAccessStrategy strategy, Buffer *vmbuffer,
+				  char *raw_page, item_bitmap * bitmap,
+				  List *partial_indexes, item_bitmap * unknown,
+				  online_check * online, heap_check_state * state,
+				  uint32 *nerrs);
+
+static void add_heap_items(item_bitmap * bitmap, List *partial_indexes,
+			   item_bitmap * unknown, online_check * online,
+			   heap_check_state * state, PageHeader header,
+			   char *raw_page, BlockNumber blkno, bool corrupted);
+
+static void add_corrupted_block(heap_check_state * state, BlockNumber blkno);
 
 static uint32 check_index(Oid indexOid,
 			BlockNumber blockFrom, BlockNumber blockTo,
 			bool blockRangeGiven,
-			item_bitmap * bitmap, bool *crossCheck);
+			double sampleFraction, int64 sampleBlocks,
+			item_bitmap * bitmap, bool *crossCheck, bool recheck);
+
+static uint64 check_fingerprints(Relation rel, Oid indexOid,
+				   item_bitmap * bitmap_heap, item_bitmap * bitmap_idx,
+				   partial_index * partial, heap_check_state * state,
+				   bool exact, BufferAccessStrategy strategy);
+
+static uint64 check_online(Relation rel, Oid indexOid,
+			 item_bitmap * bitmap_heap, item_bitmap * bitmap_idx,
+			 partial_index * partial, online_check * online,
+			 heap_check_state * state, bool exact,
+			 BufferAccessStrategy strategy);
+
+static uint64 recheck_blocks(Relation rel, Oid indexOid,
+			   BlockNumber *blocks, BlockNumber nblocks,
+			   partial_index * partial, online_check * online,
+			   heap_check_state * state, BufferAccessStrategy strategy);
+
+static void check_sample_args(FunctionCallInfo fcinfo, int argno,
+				  double *sampleFraction, int64 *sampleBlocks);
+
+#if (PG_VERSION_NUM >= 100000)
+static partition_shared *check_partitioned_table(Oid relid,
+						bool checkIndexes, bool crossCheckIndexes,
+						bool online, bool quick,
+						double sampleFraction, int64 sampleBlocks);
+static uint32 check_partition(Oid relid, partition_args * args);
+
+PGDLLEXPORT void pg_check_partition_worker(dsm_segment *seg, shm_toc *toc);
+#endif
 
 /*
  * pg_check_table
@@ -81,10 +182,21 @@ pg_check_table(PG_FUNCTION_ARGS)
 	Oid			relid = PG_GETARG_OID(0);
 	bool		checkIndexes = PG_GETARG_BOOL(1);
 	bool		crossCheckIndexes = PG_GETARG_BOOL(2);
+	bool		quick = false;
+	bool		online = false;
+	double		sampleFraction; /* fraction of blocks to sample */
+	int64		sampleBlocks;	/* number of blocks to sample */
 	int64		blockFrom;		/* starting block */
 	int64		blockTo;		/* end block */
 	bool		blockRange = false; /* block range specified */
 
+	/* the 0.1.0 definition (before ALTER EXTENSION UPDATE) has 5 arguments */
+	if (PG_NARGS() > 5)
+	{
+		quick = PG_GETARG_BOOL(5);
+		online = PG_GETARG_BOOL(8);
+	}
+
 	/* we only allow either both block_start/block_end, or neither */
 	if (PG_ARGISNULL(3) && PG_ARGISNULL(4))
 	{
@@ -102,25 +214,62 @@ pg_check_table(PG_FUNCTION_ARGS)
 
 	/* check block numbers make sense (in uint32 range etc.) */
 
-	if ((blockFrom < 0) || (blockFrom > PG_UINT32_MAX))
-		elog(ERROR, "invalid block_start value %ld (allowed [0,%u])",
-			 blockFrom, PG_UINT32_MAX);
+	if ((blockFrom < 0) || (blockFrom > MaxBlockNumber))
+		elog(ERROR, "invalid block_start value " INT64_FORMAT " (allowed [0,%u])",
+			 blockFrom, MaxBlockNumber);
 
-	if ((blockTo < 0) || (blockTo > PG_UINT32_MAX))
-		elog(ERROR, "invalid block_end value %ld (allowed [0,%u])",
-			 blockTo, PG_UINT32_MAX);
+	if ((blockTo < 0) || (blockTo > MaxBlockNumber))
+		elog(ERROR, "invalid block_end value " INT64_FORMAT " (allowed [0,%u])",
+			 blockTo, MaxBlockNumber);
 
 	if (blockTo < blockFrom)
-		elog(ERROR, "block_start (%ld) greater than block_end (%ld)",
+		elog(ERROR, "block_start (" INT64_FORMAT ") greater than block_end (" INT64_FORMAT ")",
 			 blockFrom, blockTo);
 
 	/* check that cross-check is specified only when checking indexes */
 	if (crossCheckIndexes && (!checkIndexes))
 		elog(ERROR, "index cross-check can only be requested with index check");
 
+	/* online mode only makes a difference for the cross-check */
+	if (online && (!crossCheckIndexes))
+		elog(ERROR, "online mode can only be requested with index cross-check");
+
+	check_sample_args(fcinfo, 6, &sampleFraction, &sampleBlocks);
+
+	instrument_start();
+
+#if (PG_VERSION_NUM >= 100000)
+	/* partitioned table - check all the leaf partitions, sum the results */
+	if (get_rel_relkind(relid) == RELKIND_PARTITIONED_TABLE)
+	{
+		partition_shared *shared;
+		int			i;
+
+		if (blockRange)
+			elog(ERROR, "block range can't be specified for a partitioned table");
+
+		shared = check_partitioned_table(relid, checkIndexes,
+										 crossCheckIndexes, online, quick,
+										 sampleFraction, sampleBlocks);
+
+		nerrs = 0;
+		for (i = 0; i < shared->nparts; i++)
+			nerrs += shared->parts[i].nerrs;
+
+		pfree(shared);
+
+		instrument_end();
+
+		PG_RETURN_INT32(nerrs);
+	}
+#endif
+
 	nerrs = check_table(relid, checkIndexes, crossCheckIndexes,
 						(BlockNumber) blockFrom, (BlockNumber) blockTo,
-						blockRange);
+						blockRange, quick, sampleFraction, sampleBlocks,
+						online);
+
+	instrument_end();
 
 	PG_RETURN_INT32(nerrs);
 }
@@ -137,12 +286,14 @@ pg_check_index(PG_FUNCTION_ARGS)
 {
 	Oid			relid = PG_GETARG_OID(0);
 	uint32		nerrs;
+	double		sampleFraction; /* fraction of blocks to sample */
+	int64		sampleBlocks;	/* number of blocks to sample */
 	int64		blockFrom;		/* starting block */
 	int64		blockTo;		/* end block */
 	bool		blockRange = false; /* block range specified */
 
 	/* we only allow either both block_start/block_end, or neither */
-	if (PG_ARGISNULL(3) && PG_ARGISNULL(4))
+	if (PG_ARGISNULL(1) && PG_ARGISNULL(2))
 	{
 		blockFrom = 0;
 		blockTo = 0;
@@ -150,7 +301,7 @@ pg_check_index(PG_FUNCTION_ARGS)
 	else if ((!PG_ARGISNULL(1)) && (!PG_ARGISNULL(2)))
 	{
 		blockFrom = PG_GETARG_INT64(1);
-		blockTo = PG_GETARG_INT64(1);
+		blockTo = PG_GETARG_INT64(2);
 		blockRange = true;
 	}
 	else
@@ -159,37 +310,350 @@ pg_check_index(PG_FUNCTION_ARGS)
 	/* check block numbers make sense (in uint32 range etc.) */
 
 	if ((blockFrom < 0) || (blockFrom > MaxBlockNumber))
-		elog(ERROR, "invalid block_start value %ld (allowed [0,%u])",
+		elog(ERROR, "invalid block_start value " INT64_FORMAT " (allowed [0,%u])",
 			 blockFrom, MaxBlockNumber);
 
 	if ((blockTo < 0) || (blockTo > MaxBlockNumber))
-		elog(ERROR, "invalid block_end value %ld (allowed [0,%u])",
+		elog(ERROR, "invalid block_end value " INT64_FORMAT " (allowed [0,%u])",
 			 blockTo, MaxBlockNumber);
 
 	if (blockTo < blockFrom)
-		elog(ERROR, "block_start (%ld) greater than block_end (%ld)",
+		elog(ERROR, "block_start (" INT64_FORMAT ") greater than block_end (" INT64_FORMAT ")",
 			 blockFrom, blockTo);
 
+	check_sample_args(fcinfo, 3, &sampleFraction, &sampleBlocks);
+
+	instrument_start();
+
 	nerrs = check_index(relid,
 						(BlockNumber) blockFrom, (BlockNumber) blockTo,
-						blockRange, NULL, NULL);
+						blockRange, sampleFraction, sampleBlocks, NULL, NULL,
+						false);
+
+	instrument_end();
 
 	PG_RETURN_INT32(nerrs);
 }
 
+/*
+ * pg_check_partitions
+ *
+ * Checks all leaf partitions of a partitioned table (in parallel), returns
+ * the number of issues found in each partition.
+ */
+PG_FUNCTION_INFO_V1(pg_check_partitions);
+
+Datum
+pg_check_partitions(PG_FUNCTION_ARGS)
+{
+#if (PG_VERSION_NUM >= 100000)
+	Oid			relid = PG_GETARG_OID(0);
+	bool		checkIndexes = PG_GETARG_BOOL(1);
+	bool		crossCheckIndexes = PG_GETARG_BOOL(2);
+	bool		quick = PG_GETARG_BOOL(3);
+	bool		online = PG_GETARG_BOOL(4);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	partition_shared *shared;
+	int			i;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) ||
+		!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (get_rel_relkind(relid) != RELKIND_PARTITIONED_TABLE)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a partitioned table",
+						get_rel_name(relid))));
+
+	if (crossCheckIndexes && (!checkIndexes))
+		elog(ERROR, "index cross-check can only be requested with index check");
+
+	if (online && (!crossCheckIndexes))
+		elog(ERROR, "online mode can only be requested with index cross-check");
+
+	instrument_start();
+
+	shared = check_partitioned_table(relid, checkIndexes, crossCheckIndexes,
+									 online, quick, 0, 0);
+
+	instrument_end();
+
+	/* build the result in the per-query memory context */
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	for (i = 0; i < shared->nparts; i++)
+	{
+		Datum		values[3];
+		bool		nulls[3] = {false, false, false};
+
+		values[0] = ObjectIdGetDatum(shared->parts[i].relid);
+		values[1] = Int64GetDatum((int64) shared->parts[i].nblocks);
+		values[2] = Int32GetDatum(shared->parts[i].nerrs);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(shared);
+
+	return (Datum) 0;
+#else
+	elog(ERROR, "partitioned tables require PostgreSQL 10 or newer");
+	PG_RETURN_NULL();
+#endif
+}
+
+/*
+ * pg_check_instrumentation
+ *
+ * Returns the instrumentation collected by the last check in this backend
+ * (with pg_check.instrument enabled), or NULL if there's none.
+ */
+PG_FUNCTION_INFO_V1(pg_check_instrumentation);
+
+Datum
+pg_check_instrumentation(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[CHECK_PHASES + 5];
+	bool		nulls[CHECK_PHASES + 5];
+	int			i;
+	int			n = 0;
+
+	if (!pgcheck_instr.valid)
+		PG_RETURN_NULL();
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	memset(nulls, 0, sizeof(nulls));
+
+	/* time spent in each phase (in milliseconds) */
+	for (i = CHECK_PHASE_READ; i < CHECK_PHASES; i++)
+		values[n++] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(pgcheck_instr.time[i]));
+
+	values[n++] = Int64GetDatum(pgcheck_instr.heap_pages);
+	values[n++] = Int64GetDatum(pgcheck_instr.index_pages);
+	values[n++] = Int64GetDatum(pgcheck_instr.buffer_hits);
+	values[n++] = Int64GetDatum(pgcheck_instr.buffer_reads);
+	values[n++] = Int64GetDatum(pgcheck_instr.buffer_reads * BLCKSZ);
+	values[n++] = Int64GetDatum((int64) pgcheck_instr.bitmap_bytes);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * pg_check_stats
+ *
+ * Returns cumulative statistics of checks of all relations (in all the
+ * databases), used by the pg_stat_check view.
+ */
+PG_FUNCTION_INFO_V1(pg_check_stats);
+
+Datum
+pg_check_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) ||
+		!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* build the result in the per-query memory context */
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	stats_report(tupstore, tupdesc);
+
+	return (Datum) 0;
+}
+
+/*
+ * pg_check_stats_reset
+ *
+ * Discards all the cumulative statistics.
+ */
+PG_FUNCTION_INFO_V1(pg_check_stats_reset);
+
+Datum
+pg_check_stats_reset(PG_FUNCTION_ARGS)
+{
+	stats_reset();
+
+	PG_RETURN_VOID();
+}
+
+#if (PG_VERSION_NUM >= 100000)
+/*
+ * Check all leaf partitions of the partitioned table, using parallel workers
+ * (up to pg_check.max_parallel_workers). The partitions are locked upfront
+ * (in the same mode check_table would use), and checked largest first.
+ *
+ * Returns the list of partitions, with number of issues found in each.
+ */
+static partition_shared *
+check_partitioned_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
+						bool online, bool quick, double sampleFraction,
+						int64 sampleBlocks)
+{
+	Relation	rel;
+	LOCKMODE	lockmode;
+	partition_args args;
+	partition_shared *shared;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to use pg_check functions"))));
+
+	if ((sampleFraction > 0 || sampleBlocks > 0) && crossCheckIndexes &&
+		(pgcheck_cross_check_method != CROSS_CHECK_PROBE))
+		elog(ERROR, "cross-check with indexes not possible when sampling blocks");
+
+	/* When cross-checking, a more restrictive lock mode is needed. */
+	lockmode = (crossCheckIndexes && !online &&
+				(pgcheck_cross_check_method != CROSS_CHECK_PROBE)) ?
+		ShareRowExclusiveLock : AccessShareLock;
+
+	rel = relation_open(relid, lockmode);
+
+	args.checkIndexes = checkIndexes;
+	args.crossCheck = crossCheckIndexes;
+	args.online = online;
+	args.quick = quick;
+	args.sampleFraction = sampleFraction;
+	args.sampleBlocks = sampleBlocks;
+
+	shared = partition_expand(rel, lockmode, &args);
+
+	partition_check_all(shared, pgcheck_max_parallel_workers,
+						"pg_check_partition_worker", check_partition);
+
+	relation_close(rel, lockmode);
+
+	return shared;
+}
+
+/* check a single leaf partition (in the leader or a parallel worker) */
+static uint32
+check_partition(Oid relid, partition_args * args)
+{
+	return check_table(relid, args->checkIndexes, args->crossCheck, 0, 0,
+					   false, args->quick, args->sampleFraction,
+					   args->sampleBlocks, args->online);
+}
+
+/* entry point of the parallel workers checking partitions */
+void
+pg_check_partition_worker(dsm_segment *seg, shm_toc *toc)
+{
+	partition_check_loop(partition_worker_shared(toc), check_partition);
+}
+#endif
+
+/*
+ * Parse the sampling arguments (sample_fraction, sample_blocks), starting
+ * at argument argno. At most one of them may be specified, zero means the
+ * argument was not specified.
+ */
+static void
+check_sample_args(FunctionCallInfo fcinfo, int argno,
+				  double *sampleFraction, int64 *sampleBlocks)
+{
+	*sampleFraction = 0;
+	*sampleBlocks = 0;
+
+	/* not in the 0.1.0 definitions (before ALTER EXTENSION UPDATE) */
+	if (PG_NARGS() < argno + 2)
+		return;
+
+	if (!PG_ARGISNULL(argno) && !PG_ARGISNULL(argno + 1))
+		elog(ERROR, "only one of sample_fraction/sample_blocks may be specified");
+
+	if (!PG_ARGISNULL(argno))
+	{
+		*sampleFraction = PG_GETARG_FLOAT8(argno);
+
+		if ((*sampleFraction <= 0) || (*sampleFraction > 1))
+			elog(ERROR, "invalid sample_fraction value %f (allowed (0,1])",
+				 *sampleFraction);
+	}
+
+	if (!PG_ARGISNULL(argno + 1))
+	{
+		*sampleBlocks = PG_GETARG_INT64(argno + 1);
+
+		if ((*sampleBlocks <= 0) || (*sampleBlocks > MaxBlockNumber))
+			elog(ERROR, "invalid sample_blocks value " INT64_FORMAT " (allowed [1,%u])",
+				 *sampleBlocks, MaxBlockNumber);
+	}
+}
+
 /*
  * Check the table, all indexes on the table, and cross-check indexes.
  *
  * The function acquires ShareRowExclusiveLock or AccessShareLock.The
  * stronger lock (AccessShareLock) is used when cross-check is requested.
  *
- * XXX The index cross-check is only allowed for full table check, but
- * that is not really needed - we can scan indexes and only consider
- * pointers to the specified block range.
+ * In the online mode, the cross-check is done with just AccessShareLock, and
+ * the differences that might be caused by concurrent changes are re-checked
+ * (see check_online).
+ *
+ * In the quick mode, pages marked as all-frozen in the visibility map get
+ * only the header checked (except for a small random sample of them). The
+ * data on those pages did not change since the last aggressive vacuum, so
+ * this makes routine checks of cold data much cheaper.
+ *
+ * When sampling, only a random sample of blocks is checked (in increasing
+ * order, extended around corrupted blocks), and the estimated corruption
+ * rate is reported. Indexes are sampled at the same rate.
+ *
+ * With an explicit block range, only that part of the table is checked (the
+ * range is truncated to the current size of the table). The cross-check then
+ * uses bitmaps covering only the range, and ignores index pointers to blocks
+ * outside it - the indexes still need to be scanned whole, but the bitmaps
+ * are small, so large tables may be cross-checked in chunks.
  */
 static uint32
 check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
-			BlockNumber blockFrom, BlockNumber blockTo, bool blockRangeGiven)
+			BlockNumber blockFrom, BlockNumber blockTo, bool blockRangeGiven,
+			bool quick, double sampleFraction, int64 sampleBlocks,
+			bool online)
 {
 	Relation	rel;			/* relation for the 'relname' */
 	char	   *raw_page;		/* raw data of the page */
@@ -198,20 +662,65 @@ check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
 	BlockNumber blkno;			/* current block */
 	PageHeader	header;			/* page header */
 	BufferAccessStrategy strategy;	/* bulk strategy to avoid polluting cache */
+	Buffer		vmbuffer = InvalidBuffer;	/* visibility map page */
+	uint8		vmstatus = 0;	/* visibility map bits for the page */
+	BlockNumber nfrozen = 0;	/* all-frozen pages skipped in quick mode */
+	block_sampler sampler;		/* blocks to check (all or a sample) */
+	BlockNumber samplesize;		/* number of blocks to sample */
+	double		indexFraction = 0;	/* sample rate for indexes */
 
 	/* used to cross-check heap and indexes */
 	item_bitmap *bitmap_heap = NULL;
 
+	/* partial indexes (with their own heap bitmaps) */
+	List	   *partial_indexes = NIL;
+	item_bitmap *bitmap_unknown = NULL;
+
+	/* cross-check without the stricter lock (concurrent changes) */
+	online_check *online_state = NULL;
+
+	/* heap tuples sampled for probing b-tree indexes */
+	probe_sample *probe_state = NULL;
+	bool		probe = (crossCheckIndexes &&
+						 (pgcheck_cross_check_method == CROSS_CHECK_PROBE));
+
+	/* state of the optional heap checks */
+	heap_check_state state;
+
+	/* BRIN indexes with summaries verified during the heap pass */
+	List	   *brin_checks = NIL;
+	ListCell   *lc;
+
+	/* phase of the caller (restored at the end) */
+	CheckPhase	prev_phase;
+
+	/* for statistics (the table itself, without indexes) */
+	TimestampTz start = GetCurrentTimestamp();
+	int64		npages = 0;
+
 	if (!superuser())
 		ereport(ERROR,
 				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
 				 (errmsg("must be superuser to use pg_check functions"))));
 
-	if (blockRangeGiven && checkIndexes)	/* shouldn't happen */
-		elog(ERROR, "cross-check with indexes not possible with explicit block range");
+	/* probes only look for sampled tuples, so sampling blocks is fine */
+	if ((sampleFraction > 0 || sampleBlocks > 0) && crossCheckIndexes && !probe)
+		elog(ERROR, "cross-check with indexes not possible when sampling blocks");
 
-	/* When cross-checking, a more restrictive lock mode is needed. */
-	if (crossCheckIndexes)
+	/* items of concurrently modified pages can't be tracked by fingerprints */
+	if (online && (pgcheck_cross_check_method == CROSS_CHECK_FINGERPRINT))
+		elog(ERROR, "online cross-check not possible with fingerprints");
+
+	/* probes don't need the stricter lock, so there's no online variant */
+	if (online && probe)
+		elog(ERROR, "online cross-check not possible with probes");
+
+	/*
+	 * When cross-checking, a more restrictive lock mode is needed (unless
+	 * in the online mode, which deals with concurrent changes, or when only
+	 * probing indexes with live tuples, which have to be indexed anyway).
+	 */
+	if (crossCheckIndexes && !online && !probe)
 		rel = relation_open(relid, ShareRowExclusiveLock);
 	else
 		rel = relation_open(relid, AccessShareLock);
@@ -232,50 +741,286 @@ check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
 		blockFrom = 0;
 		blockTo = RelationGetNumberOfBlocks(rel);
 	}
+	else
+	{
+		/* the last chunk may extend past the end of the table */
+		blockTo = Min(blockTo, RelationGetNumberOfBlocks(rel));
+		blockFrom = Min(blockFrom, blockTo);
+	}
+
+	/* build the bitmap only when we need to do the cross-check (for the range) */
+	if (probe)
+		probe_state = probe_init(pgcheck_probe_sample_rate);
+	else if (crossCheckIndexes &&
+			 (pgcheck_cross_check_method == CROSS_CHECK_FINGERPRINT))
+		bitmap_heap = bitmap_init_fingerprint(blockFrom, blockTo - blockFrom);
+	else if (crossCheckIndexes)
+		bitmap_heap = bitmap_init(blockFrom, blockTo - blockFrom);
+
+	/* the snapshot has to be registered before reading the heap */
+	if (crossCheckIndexes && online)
+		online_state = online_check_init(rel);
+
+	/* collect TOAST pointers only when requested (and there's TOAST table) */
+	memset(&state, 0, sizeof(heap_check_state));
+
+	/* buffers for decompressing values (shared by heap and TOAST checks) */
+	if (pgcheck_check_compression)
+		state.compress = compress_check_init();
+
+	/* attributes to validate in the database encoding */
+	if (pgcheck_check_encoding)
+		state.encoding = encoding_check_init(rel);
+
+	/* attributes with type-specific validators */
+	if (pgcheck_check_datums)
+		state.datums = datum_check_init(rel);
+
+	if (pgcheck_check_toast && OidIsValid(rel->rd_rel->reltoastrelid))
+		state.toast = toast_check_init(rel, state.compress);
+
+	/* the XID lookups are needed by other checks too, so always cache them */
+	state.xids = xid_check_init(rel);
+	state.check_xids = pgcheck_check_xids;
+
+#if (PG_VERSION_NUM >= 90500)
+
+	/*
+	 * Verify BRIN summaries using the heap pages we read anyway. This needs
+	 * the stricter lock, otherwise the summaries might change concurrently.
+	 */
+	if (checkIndexes && crossCheckIndexes && !online && !probe)
+	{
+		List	   *list_of_indexes = RelationGetIndexList(rel);
+
+		foreach(lc, list_of_indexes)
+		{
+			Relation	indexrel = index_open(lfirst_oid(lc), AccessShareLock);
+
+			if (indexrel->rd_rel->relam == BRIN_AM_OID)
+				brin_checks = lappend(brin_checks,
+									  brin_check_init(rel, indexrel));
+			else
+				index_close(indexrel, AccessShareLock);
+		}
+
+		list_free(list_of_indexes);
+	}
+#endif
+
+	/*
+	 * Partial indexes only contain items matching the predicate (and hash
+	 * indexes only items with non-NULL keys), so those need a separate heap
+	 * bitmap. We build all of them in the same pass, evaluating the
+	 * predicates on all tuples from a page at once.
+	 */
+	if (bitmap_heap)
+	{
+		List	   *list_of_indexes = RelationGetIndexList(rel);
+
+		foreach(lc, list_of_indexes)
+		{
+			Relation	indexrel = index_open(lfirst_oid(lc), AccessShareLock);
+			partial_index *partial;
+			bool		skip_nulls = false;
+
+#if (PG_VERSION_NUM >= 100000)
+			skip_nulls = (indexrel->rd_rel->relam == HASH_AM_OID);
+#endif
+
+			if ((RelationGetIndexPredicate(indexrel) == NIL) && !skip_nulls)
+			{
+				index_close(indexrel, AccessShareLock);
+				continue;
+			}
+
+			partial = (partial_index *) palloc0(sizeof(partial_index));
+
+			partial->indexOid = lfirst_oid(lc);
+			partial->indexrel = indexrel;
+			partial->expr = index_expr_init(rel, indexrel);
+
+			if (bitmap_heap->fingerprints)
+				partial->bitmap = bitmap_init_fingerprint(blockFrom,
+														  blockTo - blockFrom);
+			else
+				partial->bitmap = bitmap_init(blockFrom, blockTo - blockFrom);
+
+			partial_indexes = lappend(partial_indexes, partial);
+		}
+
+		list_free(list_of_indexes);
 
-	/* build the bitmap only when we need to do the cross-check */
-	if (crossCheckIndexes)
-		bitmap_heap = bitmap_init(blockFrom, blockTo);
+		/*
+		 * Dead items (without tuples) of partial indexes may or may not be
+		 * in the index, so we need to remember them. In the fingerprint mode
+		 * we leave them out, and let the exact check sort it out. The online
+		 * check needs this for concurrently modified tuples too.
+		 */
+		if (((partial_indexes != NIL) || online_state) &&
+			!bitmap_heap->fingerprints)
+			bitmap_unknown = bitmap_init(blockFrom, blockTo - blockFrom);
+	}
 
 	strategy = GetAccessStrategy(BAS_BULKREAD);
 
+	/* decide which blocks to check (all of them, or just a sample) */
+	samplesize = sampler_size(blockTo - blockFrom, sampleFraction, sampleBlocks);
+	sampler_init(&sampler, blockFrom, blockTo, samplesize);
+
+	if (sampler.sampling)
+		indexFraction = (double) samplesize / (blockTo - blockFrom);
+
+	prev_phase = instrument_phase(CHECK_PHASE_READ);
+
 	/* Take a verbatim copy of each page, and check it */
-	for (blkno = blockFrom; blkno < blockTo; blkno++)
+	while ((blkno = sampler_next(&sampler)) != InvalidBlockNumber)
 	{
+		uint32		page_nerrs = 0; /* errors found on this page */
+
+		CHECK_FOR_INTERRUPTS();
+
+		npages++;
+
+		if (pgcheck_instrument)
+			pgcheck_instr.heap_pages++;
+
+		instrument_phase(CHECK_PHASE_READ);
+
+		/*
+		 * In quick mode, look at the visibility map first, and only do the
+		 * cheap checks for all-frozen pages (unless sampled for full check).
+		 */
+		if (quick &&
+			(vm_get_status(rel, blkno, &vmbuffer) & VISIBILITYMAP_ALL_FROZEN) &&
+			(random() >= pgcheck_frozen_sample_rate * MAX_RANDOM_VALUE) &&
+			check_frozen_page(rel, blkno, strategy, &vmbuffer, raw_page,
+							  bitmap_heap, partial_indexes, bitmap_unknown,
+							  online_state, &state, &page_nerrs))
+		{
+			if (bitmap_heap && (page_nerrs > 0))
+				add_corrupted_block(&state, blkno);
+
+			sampler_report(&sampler, blkno, page_nerrs);
+			nerrs += page_nerrs;
+			nfrozen++;
+			continue;
+		}
+
 		buf = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL, strategy);
+
+		instrument_phase(CHECK_PHASE_LOCK);
 		LockBuffer(buf, BUFFER_LOCK_SHARE);
 
+		instrument_phase(CHECK_PHASE_COPY);
 		memcpy(raw_page, BufferGetPage(buf), BLCKSZ);
 
+		/* the VM bits only change while holding a lock on the heap page */
+		if (pgcheck_check_vm)
+			vmstatus = vm_get_status(rel, blkno, &vmbuffer);
+
 		LockBuffer(buf, BUFFER_LOCK_UNLOCK);
 		ReleaseBuffer(buf);
 
+		instrument_phase(CHECK_PHASE_HEAP);
+
 		/* Call the 'check' routines - first just the header, then the tuples */
 		header = (PageHeader) raw_page;
 
-		nerrs += check_page_header(header, blkno);
+		page_nerrs += check_page_header(header, blkno);
 
 		/*
 		 * FIXME Does that make sense to check the tuples if the page header
 		 * is corrupted?
 		 */
-		nerrs += check_heap_tuples(rel, header, raw_page, blkno);
+		page_nerrs += check_heap_tuples(rel, header, raw_page, blkno, &state);
+
+		if (pgcheck_check_vm)
+			page_nerrs += check_visibility_map(rel, header, raw_page, blkno,
+											   vmstatus, state.xids);
 
 		/* update the bitmap with items from this page (but only when needed) */
 		if (bitmap_heap)
-			bitmap_add_heap_items(bitmap_heap, header, raw_page, blkno);
+		{
+			instrument_phase(CHECK_PHASE_BITMAP);
+			add_heap_items(bitmap_heap, partial_indexes, bitmap_unknown,
+						   online_state, &state, header, raw_page, blkno,
+						   (page_nerrs > 0));
+
+			/* the exact checks must not evaluate predicates on it either */
+			if (page_nerrs > 0)
+				add_corrupted_block(&state, blkno);
+		}
+
+		/* sample tuples for the probes (only when the page seems fine) */
+		if (probe_state && (page_nerrs == 0))
+		{
+			instrument_phase(CHECK_PHASE_BITMAP);
+			probe_add_heap_items(probe_state, &state, header, raw_page, blkno);
+		}
+
+#if (PG_VERSION_NUM >= 90500)
+		/* verify BRIN summaries (only when the page itself seems fine) */
+		if ((page_nerrs == 0) && (brin_checks != NIL))
+		{
+			instrument_phase(CHECK_PHASE_INDEX);
+			foreach(lc, brin_checks)
+				page_nerrs += brin_check_heap_page((brin_check *) lfirst(lc),
+												   &state, blkno, raw_page);
+		}
+#endif
+
+		/* extend the sample if the page is corrupted */
+		sampler_report(&sampler, blkno, page_nerrs);
+
+		nerrs += page_nerrs;
 	}
 
-	if (pgcheck_debug)
-		bitmap_print(bitmap_heap, pgcheck_bitmap_format);
+	sampler_summary(&sampler, RelationGetRelationName(rel));
 
-	/* check indexes */
-	if (checkIndexes)
-	{
-		List	   *list_of_indexes;
-		ListCell   *index;
+	if (BufferIsValid(vmbuffer))
+		ReleaseBuffer(vmbuffer);
 
-		item_bitmap *bitmap_idx = NULL;
+	if (quick)
+		ereport(DEBUG1,
+				(errmsg("quick mode: %u of %u pages all-frozen, checked only the headers",
+						nfrozen, blockTo - blockFrom)));
+
+	if (pgcheck_debug && bitmap_heap)
+		bitmap_print(bitmap_heap, pgcheck_bitmap_format);
+
+	/* verify the TOAST pointers collected from the heap */
+	if (state.toast)
+	{
+		instrument_phase(CHECK_PHASE_TOAST);
+		nerrs += toast_check_values(state.toast);
+		toast_check_free(state.toast);
+	}
+
+	if (state.compress)
+		compress_check_free(state.compress);
+
+	if (state.encoding)
+		encoding_check_free(state.encoding);
+
+	if (state.datums)
+		datum_check_free(state.datums);
+
+#if (PG_VERSION_NUM >= 90500)
+	foreach(lc, brin_checks)
+		brin_check_free((brin_check *) lfirst(lc));
+	list_free(brin_checks);
+#endif
+
+	stats_record(relid, start, npages, nerrs);
+
+	/* check indexes */
+	if (checkIndexes)
+	{
+		List	   *list_of_indexes;
+		ListCell   *index;
+
+		item_bitmap *bitmap_idx = NULL;
 
 		/*
 		 * Create a bitmap with the same size as the heap bitmap, which we
@@ -285,7 +1030,24 @@ check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
 		 * necessary.
 		 */
 		if (bitmap_heap)
+		{
 			bitmap_idx = bitmap_copy(bitmap_heap);
+			bitmap_idx->concurrent = (online_state != NULL);
+		}
+
+		/* all the bitmaps are allocated at this point */
+		if (bitmap_heap && pgcheck_instrument)
+		{
+			Size		bytes = bitmap_size(bitmap_heap) + bitmap_size(bitmap_idx);
+
+			if (bitmap_unknown)
+				bytes += bitmap_size(bitmap_unknown);
+
+			foreach(lc, partial_indexes)
+				bytes += bitmap_size(((partial_index *) lfirst(lc))->bitmap);
+
+			instrument_bitmap_memory(bytes);
+		}
 
 		list_of_indexes = RelationGetIndexList(rel);
 
@@ -295,19 +1057,83 @@ check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
 		foreach(index, list_of_indexes)
 		{
 			bool		cross_check;
+			uint32		index_nerrs;
+			partial_index *partial = NULL;
+			item_bitmap *bitmap_expected = bitmap_heap;
+
+			/* partial indexes have their own heap bitmap */
+			foreach(lc, partial_indexes)
+			{
+				if (((partial_index *) lfirst(lc))->indexOid == lfirst_oid(index))
+				{
+					partial = (partial_index *) lfirst(lc);
+					bitmap_expected = partial->bitmap;
+				}
+			}
+
+			/*
+			 * Probe b-tree indexes with the sampled tuples, instead of a
+			 * full scan. Other indexes are checked as usual (without the
+			 * cross-check).
+			 */
+			if (probe_state)
+			{
+				instrument_phase(CHECK_PHASE_COMPARE);
+
+				if (probe_index(probe_state, rel, lfirst_oid(index),
+								&index_nerrs))
+				{
+					nerrs += index_nerrs;
+					continue;
+				}
+			}
 
 			/* reset the bitmap (if needed) */
 			if (bitmap_heap)
 				bitmap_reset(bitmap_idx);
 
-			nerrs += check_index(lfirst_oid(index), 0, 0, false,
-								 bitmap_idx, &cross_check);
+			/* indexes are sampled at the same rate as the table */
+			index_nerrs = check_index(lfirst_oid(index), 0, 0, false,
+									  indexFraction, 0, bitmap_idx,
+									  &cross_check, false);
+			nerrs += index_nerrs;
 
 			/* evaluate the bitmap difference (if needed) */
 			if (bitmap_heap && cross_check)
 			{
-				/* compare the bitmaps */
-				int			ndiffs = bitmap_compare(bitmap_heap, bitmap_idx);
+				int			ndiffs;
+
+				instrument_phase(CHECK_PHASE_COMPARE);
+
+				/* compare the bitmaps (or the fingerprints) */
+				if (bitmap_heap->fingerprints)
+					ndiffs = check_fingerprints(rel, lfirst_oid(index),
+												bitmap_expected, bitmap_idx,
+												partial, &state,
+												(index_nerrs == 0), strategy);
+				else if (online_state)
+				{
+					/*
+					 * Ignore the unknown items by copying them from the heap
+					 * bitmap to the index bitmap (the heap bitmap is shared
+					 * by all the indexes, so we must not modify it).
+					 */
+					bitmap_merge_unknown(bitmap_idx, bitmap_expected,
+										 bitmap_unknown);
+
+					ndiffs = check_online(rel, lfirst_oid(index),
+										  bitmap_expected, bitmap_idx,
+										  partial, online_state, &state,
+										  (index_nerrs == 0), strategy);
+				}
+				else
+				{
+					if (partial)
+						bitmap_merge_unknown(bitmap_expected, bitmap_idx,
+											 bitmap_unknown);
+
+					ndiffs = bitmap_compare(bitmap_expected, bitmap_idx);
+				}
 
 				if (pgcheck_debug)
 					bitmap_print(bitmap_idx, pgcheck_bitmap_format);
@@ -329,9 +1155,46 @@ check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
 	if (bitmap_heap)
 		bitmap_free(bitmap_heap);
 
+	foreach(lc, partial_indexes)
+	{
+		partial_index *partial = (partial_index *) lfirst(lc);
+
+		index_expr_free(partial->expr);
+		index_close(partial->indexrel, AccessShareLock);
+		bitmap_free(partial->bitmap);
+	}
+	list_free_deep(partial_indexes);
+
+	if (bitmap_unknown)
+		bitmap_free(bitmap_unknown);
+
+	if (online_state)
+		online_check_free(online_state);
+
+	if (probe_state)
+		probe_free(probe_state);
+
+	/* the exact checks of differences need the XID lookups too */
+	xid_check_free(state.xids);
+
+	if (state.corrupted)
+		pfree(state.corrupted);
+
 	FreeAccessStrategy(strategy);
 
-	if (crossCheckIndexes)
+	instrument_phase(prev_phase);
+
+	/*
+	 * Check the TOAST table too (and its index, if requested), but only when
+	 * checking the whole table - the block range applies to the main fork
+	 * of the table, not the TOAST relation.
+	 */
+	if (!blockRangeGiven && OidIsValid(rel->rd_rel->reltoastrelid))
+		nerrs += check_table(rel->rd_rel->reltoastrelid,
+							 checkIndexes, crossCheckIndexes, 0, 0, false,
+							 quick, sampleFraction, sampleBlocks, online);
+
+	if (crossCheckIndexes && !online && !probe)
 		relation_close(rel, ShareRowExclusiveLock);
 	else
 		relation_close(rel, AccessShareLock);
@@ -339,12 +1202,393 @@ check_table(Oid relid, bool checkIndexes, bool crossCheckIndexes,
 	return nerrs;
 }
 
+/*
+ * Compare per-block TID fingerprints of the heap and the index, and compute
+ * the exact differences for blocks where the fingerprints differ - by reading
+ * those heap pages again, and collecting TIDs pointing to them from another
+ * scan of the index (see recheck_blocks).
+ *
+ * The second index scan would report the same issues with the index pages
+ * again, so with exact=false (when the index check found issues) we only
+ * report the number of blocks with mismatched fingerprints.
+ *
+ * Partial (and hash) indexes leave dead tuples out of the fingerprints, as
+ * the predicate can't be evaluated on them, so for those the fingerprints
+ * may differ even if the TIDs match.
+ *
+ * Returns number of differences (or blocks with different fingerprints).
+ */
+static uint64
+check_fingerprints(Relation rel, Oid indexOid,
+				   item_bitmap * bitmap_heap, item_bitmap * bitmap_idx,
+				   partial_index * partial, heap_check_state * state,
+				   bool exact, BufferAccessStrategy strategy)
+{
+	BlockNumber *blocks;
+	BlockNumber nblocks;
+	uint64		ndiffs;
+
+	nblocks = bitmap_compare_fingerprints(bitmap_heap, bitmap_idx, &blocks);
+
+	if (nblocks == 0)
+		return 0;
+
+	if (!exact)
+	{
+		elog(WARNING, "TID fingerprints differ for %u blocks", nblocks);
+		pfree(blocks);
+		return nblocks;
+	}
+
+	ereport(DEBUG1,
+			(errmsg("TID fingerprints differ for %u blocks, re-checking them",
+					nblocks)));
+
+	ndiffs = recheck_blocks(rel, indexOid, blocks, nblocks, partial, NULL,
+							state, strategy);
+
+	/* same TIDs, but different counts - duplicate index entries */
+	if ((ndiffs == 0) && (partial == NULL))
+	{
+		elog(WARNING, "TID fingerprints differ, but the TIDs match (duplicate index entries?)");
+		ndiffs = nblocks;
+	}
+
+	pfree(blocks);
+
+	return ndiffs;
+}
+
+/*
+ * Evaluate differences found by the online cross-check (without the stricter
+ * lock). The differences may be caused by concurrent changes - tuples moved
+ * by index page splits, tuples inserted after the heap pages were read etc.
+ * So we take a new snapshot, scan the index again (collecting only TIDs
+ * pointing to blocks with differences), and read those heap blocks again.
+ * Only differences remaining after this second pass are reported.
+ *
+ * The second index scan would report the same issues with the index pages
+ * again, so with exact=false (when the index check found issues) we report
+ * all the differences found by the first pass.
+ *
+ * Returns number of differences.
+ */
+static uint64
+check_online(Relation rel, Oid indexOid,
+			 item_bitmap * bitmap_heap, item_bitmap * bitmap_idx,
+			 partial_index * partial, online_check * online,
+			 heap_check_state * state, bool exact,
+			 BufferAccessStrategy strategy)
+{
+	BlockNumber *blocks;
+	BlockNumber nblocks;
+	BlockNumber i;
+	uint64		ndiffs = 0;
+
+	nblocks = bitmap_diff_pages(bitmap_heap, bitmap_idx, &blocks);
+
+	if (nblocks == 0)
+		return 0;
+
+	if (!exact)
+	{
+		for (i = 0; i < nblocks; i++)
+			ndiffs += bitmap_compare_page(bitmap_heap, bitmap_idx, blocks[i]);
+
+		pfree(blocks);
+		return ndiffs;
+	}
+
+	ereport(DEBUG1,
+			(errmsg("re-checking %u blocks with differences (concurrent changes?)",
+					nblocks)));
+
+	ndiffs = recheck_blocks(rel, indexOid, blocks, nblocks, partial, online,
+							state, strategy);
+
+	pfree(blocks);
+
+	return ndiffs;
+}
+
+/*
+ * Compute exact differences between the heap and the index for the listed
+ * blocks (sorted), by scanning the index again (into a bitmap covering only
+ * the range of the blocks) and then reading the heap blocks again.
+ *
+ * The index is scanned first, so that in the online mode we can ignore heap
+ * tuples inserted after the recheck snapshot - those may or may not be in the
+ * index, depending on when the index pages got read. Index entries can only
+ * be added after the heap tuple, so for those we'll find the heap tuple.
+ *
+ * Blocks found corrupted by the heap pass are treated as unknown (just like
+ * in add_heap_items), so that we don't evaluate predicates or look up XIDs
+ * on them.
+ *
+ * Returns number of differences.
+ */
+static uint64
+recheck_blocks(Relation rel, Oid indexOid,
+			   BlockNumber *blocks, BlockNumber nblocks,
+			   partial_index * partial, online_check * online,
+			   heap_check_state * state, BufferAccessStrategy strategy)
+{
+	BlockNumber i;
+	BlockNumber j = 0;			/* next corrupted block (both are sorted) */
+	uint64		ndiffs = 0;
+	item_bitmap *exact_heap;
+	item_bitmap *exact_idx;
+	item_bitmap *exact_unknown = NULL;
+	char	   *raw_page = NULL;
+	bool		cross_check;
+
+	/* the blocks are sorted, so the bitmap only needs to cover this range */
+	exact_heap = bitmap_init(blocks[0], blocks[nblocks - 1] - blocks[0] + 1);
+
+	if (partial || online)
+	{
+		exact_unknown = bitmap_copy(exact_heap);
+		raw_page = (char *) palloc(BLCKSZ);
+	}
+
+	/* pointers to blocks outside the range are ignored by the bitmap */
+	exact_idx = bitmap_copy(exact_heap);
+
+	if (online)
+	{
+		exact_idx->concurrent = true;
+		online_recheck_begin(online);
+	}
+
+	(void) check_index(indexOid, 0, 0, false, 0, 0, exact_idx, &cross_check,
+					   true);
+
+	for (i = 0; i < nblocks; i++)
+	{
+		Buffer		buf;
+		Page		page;
+
+		CHECK_FOR_INTERRUPTS();
+
+		instrument_phase(CHECK_PHASE_READ);
+		buf = ReadBufferExtended(rel, MAIN_FORKNUM, blocks[i], RBM_NORMAL,
+								 strategy);
+
+		instrument_phase(CHECK_PHASE_LOCK);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+
+		/* building the exact bitmaps is part of the comparison */
+		instrument_phase(CHECK_PHASE_COMPARE);
+
+		page = BufferGetPage(buf);
+
+		/* don't evaluate the predicate (or look up XIDs) while holding the lock */
+		if (partial || online)
+		{
+			memcpy(raw_page, page, BLCKSZ);
+			UnlockReleaseBuffer(buf);
+
+			while ((j < state->ncorrupted) && (state->corrupted[j] < blocks[i]))
+				j++;
+
+			if ((j < state->ncorrupted) && (state->corrupted[j] == blocks[i]))
+			{
+				if (!partial)
+					bitmap_add_heap_items(exact_heap, (PageHeader) raw_page,
+										  raw_page, blocks[i]);
+
+				bitmap_add_heap_items(exact_unknown, (PageHeader) raw_page,
+									  raw_page, blocks[i]);
+				continue;
+			}
+
+			if (online)
+				online_add_heap_items(online, (partial) ? NULL : exact_heap,
+									  exact_unknown, (PageHeader) raw_page,
+									  raw_page, blocks[i]);
+
+			if (partial)
+				index_expr_add_heap_items(partial->expr, state, exact_heap,
+										  exact_unknown, (PageHeader) raw_page,
+										  raw_page, blocks[i]);
+			continue;
+		}
+
+		bitmap_add_heap_items(exact_heap, (PageHeader) page, (char *) page,
+							  blocks[i]);
+
+		UnlockReleaseBuffer(buf);
+	}
+
+	if (online)
+		online_recheck_end(online);
+
+	if (exact_unknown)
+	{
+		bitmap_merge_unknown(exact_heap, exact_idx, exact_unknown);
+		bitmap_free(exact_unknown);
+		pfree(raw_page);
+	}
+
+	for (i = 0; i < nblocks; i++)
+		ndiffs += bitmap_compare_page(exact_heap, exact_idx, blocks[i]);
+
+	bitmap_free(exact_heap);
+	bitmap_free(exact_idx);
+
+	return ndiffs;
+}
+
+/*
+ * Cheap check of a page marked as all-frozen in the visibility map.
+ *
+ * We don't copy the page, we just check the header (and that the page is
+ * marked as all-visible) directly in the shared buffer, while holding the
+ * lock. The tuples are only added to the bitmap, when cross-checking.
+ *
+ * The visibility map was read before locking the page, so it might have
+ * changed in the meantime - so read it again, and if the page is not
+ * all-frozen anymore, let the caller do the regular check.
+ *
+ * Returns true if the page was checked.
+ */
+static bool
+check_frozen_page(Relation rel, BlockNumber blkno,
+				  BufferAccessStrategy strategy, Buffer *vmbuffer,
+				  char *raw_page, item_bitmap * bitmap,
+				  List *partial_indexes, item_bitmap * unknown,
+				  online_check * online, heap_check_state * state,
+				  uint32 *nerrs)
+{
+	Buffer		buf;
+	PageHeader	header;
+
+	instrument_phase(CHECK_PHASE_READ);
+	buf = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL, strategy);
+
+	instrument_phase(CHECK_PHASE_LOCK);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+
+	instrument_phase(CHECK_PHASE_HEAP);
+
+	if (!(vm_get_status(rel, blkno, vmbuffer) & VISIBILITYMAP_ALL_FROZEN))
+	{
+		UnlockReleaseBuffer(buf);
+		return false;
+	}
+
+	header = (PageHeader) BufferGetPage(buf);
+
+	*nerrs += check_page_header(header, blkno);
+
+	if (pgcheck_check_vm && !PageIsAllVisible((Page) header))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] all-frozen bit is set, but the page is not marked all-visible",
+						blkno)));
+		(*nerrs)++;
+	}
+
+	/* don't evaluate predicates of partial indexes while holding the lock */
+	if (bitmap && (partial_indexes != NIL))
+	{
+		instrument_phase(CHECK_PHASE_COPY);
+		memcpy(raw_page, header, BLCKSZ);
+		UnlockReleaseBuffer(buf);
+
+		instrument_phase(CHECK_PHASE_BITMAP);
+
+		add_heap_items(bitmap, partial_indexes, unknown, online, state,
+					   (PageHeader) raw_page, raw_page, blkno, (*nerrs > 0));
+		return true;
+	}
+
+	/* all-frozen tuples are indexed for sure, even in the online mode */
+	if (bitmap)
+	{
+		instrument_phase(CHECK_PHASE_BITMAP);
+		bitmap_add_heap_items(bitmap, header, (char *) header, blkno);
+	}
+
+	UnlockReleaseBuffer(buf);
+
+	return true;
+}
+
+/*
+ * Add items from the heap page to the bitmap, and to the bitmaps of partial
+ * indexes (with the predicate evaluated on all the tuples at once).
+ *
+ * In the online mode, only items certainly referenced from indexes go to the
+ * heap bitmap, the rest (concurrently modified tuples) is treated as unknown.
+ *
+ * We don't want to evaluate predicates (or look up XIDs) on tuples from a
+ * corrupted page, so for those all the items are treated as unknown. The
+ * predicates are evaluated only on live tuples, the other ones are unknown
+ * too (see index_expr_add_heap_items).
+ */
+static void
+add_heap_items(item_bitmap * bitmap, List *partial_indexes,
+			   item_bitmap * unknown, online_check * online,
+			   heap_check_state * state, PageHeader header,
+			   char *raw_page, BlockNumber blkno, bool corrupted)
+{
+	ListCell   *lc;
+
+	if (online && !corrupted)
+		online_add_heap_items(online, bitmap, unknown, header, raw_page,
+							  blkno);
+	else
+		bitmap_add_heap_items(bitmap, header, raw_page, blkno);
+
+	if (corrupted && ((partial_indexes != NIL) || online))
+	{
+		if (unknown)
+			bitmap_add_heap_items(unknown, header, raw_page, blkno);
+
+		return;
+	}
+
+	foreach(lc, partial_indexes)
+	{
+		partial_index *partial = (partial_index *) lfirst(lc);
+
+		index_expr_add_heap_items(partial->expr, state, partial->bitmap,
+								  unknown, header, raw_page, blkno);
+	}
+}
+
+/*
+ * Remember a block with issues found by the heap pass (the blocks are added
+ * in increasing order, as the cross-check does not sample blocks).
+ */
+static void
+add_corrupted_block(heap_check_state * state, BlockNumber blkno)
+{
+	if (state->ncorrupted == state->maxcorrupted)
+	{
+		state->maxcorrupted = Max(64, 2 * state->maxcorrupted);
+
+		if (state->corrupted)
+			state->corrupted = (BlockNumber *) repalloc(state->corrupted,
+														sizeof(BlockNumber) * state->maxcorrupted);
+		else
+			state->corrupted = (BlockNumber *) palloc(sizeof(BlockNumber) * state->maxcorrupted);
+	}
+
+	state->corrupted[state->ncorrupted++] = blkno;
+}
+
 /*
  * check the index, acquires AccessShareLock
+ *
+ * Re-checks of blocks with differences (recheck=true) scan the index again,
+ * but are not recorded in the statistics.
  */
 static uint32
 check_index(Oid indexOid, BlockNumber blockFrom, BlockNumber blockTo,
-			bool blockRangeGiven, item_bitmap * bitmap, bool *crossCheck)
+			bool blockRangeGiven, double sampleFraction, int64 sampleBlocks,
+			item_bitmap * bitmap, bool *crossCheck, bool recheck)
 {
 	Relation	rel;			/* relation for the 'relname' */
 	char	   *raw_page;		/* raw data of the page */
@@ -354,15 +1598,25 @@ check_index(Oid indexOid, BlockNumber blockFrom, BlockNumber blockTo,
 	PageHeader	header;			/* page header */
 	int			lmode;			/* lock mode */
 	BufferAccessStrategy strategy;	/* bulk strategy to avoid polluting cache */
-	check_page_cb check_page;
+	const index_check_methods *methods;	/* check methods for the AM */
+	void	   *state = NULL;	/* state of the check methods */
+	item_bitmap *fingerprints = NULL;	/* fingerprints to add the TIDs to */
+	block_sampler sampler;		/* blocks to check (all or a sample) */
+	CheckPhase	prev_phase;		/* phase of the caller */
+	TimestampTz start = GetCurrentTimestamp();	/* for statistics */
+	int64		npages = 0;		/* pages checked */
 
 	if (!superuser())
 		ereport(ERROR,
 				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
 				 (errmsg("must be superuser to use pg_check functions"))));
 
-	/* when a bitmap is provided, use stricted lock mode */
-	lmode = (bitmap != NULL) ? ShareRowExclusiveLock : AccessShareLock;
+	/*
+	 * when a bitmap is provided, use stricted lock mode (unless the bitmap
+	 * is built while the index may change, in the online mode)
+	 */
+	lmode = (bitmap != NULL && !bitmap->concurrent) ?
+		ShareRowExclusiveLock : AccessShareLock;
 
 	rel = index_open(indexOid, lmode);
 
@@ -382,7 +1636,22 @@ check_index(Oid indexOid, BlockNumber blockFrom, BlockNumber blockTo,
 	 * am-specific check methods, we'll still do at least the basic checks of
 	 * page format.
 	 */
-	check_page = lookup_check_method(rel->rd_rel->relam, crossCheck);
+	methods = lookup_check_method(rel->rd_rel->relam);
+
+	if (crossCheck)
+		*crossCheck = methods->crosscheck;
+
+	/*
+	 * Indexes referencing a TID repeatedly (GIN has an entry for each key,
+	 * hash tuples moved by a split stay in the old bucket for a while) would
+	 * count it repeatedly in the fingerprints. So collect the TIDs in a
+	 * regular bitmap first, and add them to the fingerprints at the end.
+	 */
+	if (bitmap && bitmap->fingerprints && methods->repeated)
+	{
+		fingerprints = bitmap;
+		bitmap = bitmap_init(fingerprints->startpage, fingerprints->npages);
+	}
 
 	/* Initialize buffer to copy to */
 	raw_page = (char *) palloc(BLCKSZ);
@@ -396,27 +1665,74 @@ check_index(Oid indexOid, BlockNumber blockFrom, BlockNumber blockTo,
 
 	strategy = GetAccessStrategy(BAS_BULKREAD);
 
-	for (blkno = blockFrom; blkno < blockTo; blkno++)
+	sampler_init(&sampler, blockFrom, blockTo,
+				 sampler_size(blockTo - blockFrom, sampleFraction, sampleBlocks));
+
+	prev_phase = instrument_phase(CHECK_PHASE_INDEX);
+
+	/* some checks are only possible when checking all the pages, locked */
+	if (methods->begin)
+		state = methods->begin(rel, !blockRangeGiven && !sampler.sampling &&
+							   (lmode == ShareRowExclusiveLock));
+
+	while ((blkno = sampler_next(&sampler)) != InvalidBlockNumber)
 	{
+		uint32		page_nerrs;
+
+		CHECK_FOR_INTERRUPTS();
+
+		npages++;
+
+		if (pgcheck_instrument)
+			pgcheck_instr.index_pages++;
+
+		instrument_phase(CHECK_PHASE_READ);
 		buf = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL, strategy);
+
+		instrument_phase(CHECK_PHASE_LOCK);
 		LockBuffer(buf, BUFFER_LOCK_SHARE);
 
+		instrument_phase(CHECK_PHASE_COPY);
 		memcpy(raw_page, BufferGetPage(buf), BLCKSZ);
 
 		LockBuffer(buf, BUFFER_LOCK_UNLOCK);
 		ReleaseBuffer(buf);
 
+		instrument_phase(CHECK_PHASE_INDEX);
+
 		/*
 		 * Call the 'check' routines - first just the header, then the
 		 * contents of the page.
 		 */
 		header = (PageHeader) raw_page;
 
-		nerrs += check_page(rel, header, blkno, raw_page, bitmap);
+		page_nerrs = methods->check_page(rel, header, blkno, raw_page,
+										 bitmap, state);
+
+		/* extend the sample if the page is corrupted */
+		sampler_report(&sampler, blkno, page_nerrs);
+
+		nerrs += page_nerrs;
 	}
 
+	if (methods->end)
+		nerrs += methods->end(rel, state);
+
+	if (fingerprints)
+	{
+		bitmap_add_fingerprints(fingerprints, bitmap);
+		bitmap_free(bitmap);
+	}
+
+	sampler_summary(&sampler, RelationGetRelationName(rel));
+
 	FreeAccessStrategy(strategy);
 
+	instrument_phase(prev_phase);
+
+	if (!recheck)
+		stats_record(indexOid, start, npages, nerrs);
+
 	relation_close(rel, lmode);
 
 	return nerrs;
@@ -456,5 +1772,158 @@ _PG_init(void)
 							 NULL,
 							 NULL);
 
+	DefineCustomBoolVariable("pg_check.check_toast",
+							 "verify TOAST pointers against the TOAST table.",
+							 NULL,
+							 &pgcheck_check_toast,
+							 false,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_check.check_compression",
+							 "decompress compressed values (inline and TOAST).",
+							 NULL,
+							 &pgcheck_check_compression,
+							 false,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_check.check_encoding",
+							 "validate text values in the database encoding.",
+							 NULL,
+							 &pgcheck_check_encoding,
+							 false,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_check.check_datums",
+							 "validate structure of numeric, array, jsonb and range values.",
+							 NULL,
+							 &pgcheck_check_datums,
+							 false,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_check.check_visibility_map",
+							 "cross-check visibility map with the heap pages.",
+							 NULL,
+							 &pgcheck_check_vm,
+							 true,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_check.check_xids",
+							 "check XIDs and multixacts of tuples are sane.",
+							 NULL,
+							 &pgcheck_check_xids,
+							 true,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomRealVariable("pg_check.frozen_sample_rate",
+							 "fraction of all-frozen pages fully checked in quick mode.",
+							 NULL,
+							 &pgcheck_frozen_sample_rate,
+							 0.01,
+							 0.0,
+							 1.0,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomEnumVariable("pg_check.cross_check_method",
+							 "how to cross-check the table and indexes.",
+							 NULL,
+							 &pgcheck_cross_check_method,
+							 CROSS_CHECK_BITMAP,
+							 cross_check_options,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomRealVariable("pg_check.probe_sample_rate",
+							 "fraction of heap tuples looked up in b-tree indexes in the probe mode.",
+							 NULL,
+							 &pgcheck_probe_sample_rate,
+							 0.01,
+							 0.0,
+							 1.0,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("pg_check.max_parallel_workers",
+							"max number of parallel workers checking partitions.",
+							NULL,
+							&pgcheck_max_parallel_workers,
+							2,
+							0,
+							1024,	/* MAX_PARALLEL_WORKER_LIMIT */
+							PGC_SUSET,
+							0,
+#if (PG_VERSION_NUM >= 90100)
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("pg_check.instrument",
+							 "collect per-phase timing and I/O statistics of checks.",
+							 NULL,
+							 &pgcheck_instrument,
+							 false,
+							 PGC_SUSET,
+							 0,
+#if (PG_VERSION_NUM >= 90100)
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	/* shared statistics (pg_stat_check) */
+	stats_init();
+
 	EmitWarningsOnPlaceholders("pg_check");
 }
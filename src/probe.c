@@ -0,0 +1,337 @@
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/nbtree.h"
+#include "access/relscan.h"
+#include "access/skey.h"
+#include "catalog/index.h"
+#if (PG_VERSION_NUM >= 90600)
+#include "catalog/pg_am.h"
+#endif
+#include "miscadmin.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#include "index-expr.h"
+#include "item-bitmap.h"
+#include "probe.h"
+
+/* key of a sampled tuple in a particular index */
+typedef struct probe_key
+{
+	ItemPointerData tid;
+	Datum	   *values;
+	bool	   *isnull;
+}			probe_key;
+
+/* info needed to sort the keys in the index order */
+typedef struct probe_sort
+{
+	int			nkeys;
+	FmgrInfo  **cmp;			/* BTORDER_PROC of each key column */
+	Oid		   *collations;
+	int16	   *options;		/* DESC / NULLS FIRST */
+}			probe_sort;
+
+static int	probe_key_cmp(const void *a, const void *b, void *arg);
+
+probe_sample *
+probe_init(double rate)
+{
+	probe_sample *probe = (probe_sample *) palloc0(sizeof(probe_sample));
+
+	probe->cxt = AllocSetContextCreate(CurrentMemoryContext,
+									   "pg_check probes",
+									   ALLOCSET_DEFAULT_MINSIZE,
+									   ALLOCSET_DEFAULT_INITSIZE,
+									   ALLOCSET_DEFAULT_MAXSIZE);
+	probe->rate = rate;
+	probe->maxtuples = 1024;
+	probe->tuples = (HeapTuple *) MemoryContextAlloc(probe->cxt,
+													 probe->maxtuples * sizeof(HeapTuple));
+
+	return probe;
+}
+
+void
+probe_free(probe_sample * probe)
+{
+	MemoryContextDelete(probe->cxt);
+	pfree(probe);
+}
+
+/*
+ * Sample live tuples from the page. Indexes point to the root item of a HOT
+ * chain, while the indexed values are the same for all the tuples in the
+ * chain, so we use the first tuple of the chain (if it's live).
+ */
+void
+probe_add_heap_items(probe_sample * probe, heap_check_state * state,
+					 PageHeader header, char *raw_page, BlockNumber block)
+{
+	int			nitems;
+	int			i;
+	OffsetNumber items[MaxHeapTuplesPerPage];
+	OffsetNumber tuples[MaxHeapTuplesPerPage];
+
+	nitems = heap_page_index_items(header, raw_page, items, tuples);
+
+	for (i = 0; i < nitems; i++)
+	{
+		ItemId		lp;
+		HeapTupleData tuple;
+		MemoryContext oldcxt;
+
+		if (tuples[i] == InvalidOffsetNumber)
+			continue;
+
+		if (random() >= probe->rate * MAX_RANDOM_VALUE)
+			continue;
+
+		lp = PageGetItemId((Page) raw_page, tuples[i]);
+
+		tuple.t_data = (HeapTupleHeader) PageGetItem((Page) raw_page, lp);
+		tuple.t_len = ItemIdGetLength(lp);
+		tuple.t_tableOid = InvalidOid;
+		ItemPointerSet(&tuple.t_self, block, items[i]);
+
+		if (!heap_tuple_is_live(state, tuple.t_data))
+			continue;
+
+		oldcxt = MemoryContextSwitchTo(probe->cxt);
+
+		if (probe->ntuples == probe->maxtuples)
+		{
+			probe->maxtuples *= 2;
+			probe->tuples = (HeapTuple *) repalloc(probe->tuples,
+												   probe->maxtuples * sizeof(HeapTuple));
+		}
+
+		probe->tuples[probe->ntuples++] = heap_copytuple(&tuple);
+
+		MemoryContextSwitchTo(oldcxt);
+	}
+}
+
+/*
+ * Probe the index with the sampled tuples. For each tuple we compute the
+ * index keys (evaluating expressions and the predicate, just like when
+ * inserting into the index), and then scan the index for entries with equal
+ * keys, until we find one pointing to the tuple. The keys are sorted in the
+ * index order first, so that consecutive descents mostly walk through the
+ * same (cached) inner pages.
+ *
+ * Tuples with many duplicate keys make the probes more expensive, as all the
+ * index entries with the same key may need to be read.
+ */
+bool
+probe_index(probe_sample * probe, Relation heaprel, Oid indexOid,
+			uint32 *nerrs)
+{
+	Relation	indexrel;
+	index_expr_state *expr;
+	MemoryContext cxt;
+	MemoryContext oldcxt;
+	probe_key  *keys;
+	probe_sort	sort;
+	FmgrInfo   *eqprocs;
+	ScanKey		scankeys;
+	IndexScanDesc scan;
+	int			natts;
+	int			nkeys = 0;
+	int			i,
+				j;
+
+	indexrel = index_open(indexOid, AccessShareLock);
+
+	/* only valid b-tree indexes (others are scanned as usual) */
+	if ((indexrel->rd_rel->relam != BTREE_AM_OID) ||
+		!indexrel->rd_index->indisvalid)
+	{
+		index_close(indexrel, AccessShareLock);
+		return false;
+	}
+
+	*nerrs = 0;
+
+#if (PG_VERSION_NUM >= 110000)
+	natts = IndexRelationGetNumberOfKeyAttributes(indexrel);
+#else
+	natts = RelationGetNumberOfAttributes(indexrel);
+#endif
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"pg_check index probes",
+								ALLOCSET_DEFAULT_MINSIZE,
+								ALLOCSET_DEFAULT_INITSIZE,
+								ALLOCSET_DEFAULT_MAXSIZE);
+
+	expr = index_expr_init(heaprel, indexrel);
+
+	/* compute keys of the sampled tuples (skipping those not matching the predicate) */
+	keys = (probe_key *) MemoryContextAlloc(cxt, sizeof(probe_key) * Max(probe->ntuples, 1));
+
+	for (i = 0; i < probe->ntuples; i++)
+	{
+		Datum		values[INDEX_MAX_KEYS];
+		bool		isnull[INDEX_MAX_KEYS];
+		probe_key  *key = &keys[nkeys];
+
+		if (!index_expr_values(expr, probe->tuples[i], values, isnull))
+			continue;
+
+		key->tid = probe->tuples[i]->t_self;
+		key->values = (Datum *) MemoryContextAlloc(cxt, sizeof(Datum) * natts);
+		key->isnull = (bool *) MemoryContextAlloc(cxt, sizeof(bool) * natts);
+
+		/* the values are in a per-tuple context, so copy them */
+		oldcxt = MemoryContextSwitchTo(cxt);
+
+		for (j = 0; j < natts; j++)
+		{
+			Form_pg_attribute attr = indexrel->rd_att->attrs[j];
+
+			key->isnull[j] = isnull[j];
+			key->values[j] = (isnull[j]) ? (Datum) 0 :
+				datumCopy(values[j], attr->attbyval, attr->attlen);
+		}
+
+		MemoryContextSwitchTo(oldcxt);
+
+		nkeys++;
+	}
+
+	index_expr_free(expr);
+
+	/* sort the keys in the index order (ties by TID, like in 12+) */
+	sort.nkeys = natts;
+	sort.cmp = (FmgrInfo **) palloc(sizeof(FmgrInfo *) * natts);
+	sort.collations = indexrel->rd_indcollation;
+	sort.options = indexrel->rd_indoption;
+
+	eqprocs = (FmgrInfo *) palloc(sizeof(FmgrInfo) * natts);
+	scankeys = (ScanKey) palloc(sizeof(ScanKeyData) * natts);
+
+	for (j = 0; j < natts; j++)
+	{
+		Oid			opfamily = indexrel->rd_opfamily[j];
+		Oid			opcintype = indexrel->rd_opcintype[j];
+		Oid			eqop;
+
+		sort.cmp[j] = index_getprocinfo(indexrel, j + 1, BTORDER_PROC);
+
+		eqop = get_opfamily_member(opfamily, opcintype, opcintype,
+								   BTEqualStrategyNumber);
+		if (!OidIsValid(eqop))
+			elog(ERROR, "missing operator %d(%u,%u) in opfamily %u",
+				 BTEqualStrategyNumber, opcintype, opcintype, opfamily);
+
+		fmgr_info(get_opcode(eqop), &eqprocs[j]);
+	}
+
+	qsort_arg(keys, nkeys, sizeof(probe_key), probe_key_cmp, &sort);
+
+#if (PG_VERSION_NUM >= 180000)
+	scan = index_beginscan(heaprel, indexrel, GetActiveSnapshot(), NULL,
+						   natts, 0);
+#else
+	scan = index_beginscan(heaprel, indexrel, GetActiveSnapshot(), natts, 0);
+#endif
+
+	for (i = 0; i < nkeys; i++)
+	{
+		ItemPointer tid;
+		bool		found = false;
+
+		CHECK_FOR_INTERRUPTS();
+
+		for (j = 0; j < natts; j++)
+		{
+			if (keys[i].isnull[j])
+				ScanKeyEntryInitialize(&scankeys[j], SK_ISNULL | SK_SEARCHNULL,
+									   j + 1, InvalidStrategy, InvalidOid,
+									   InvalidOid, InvalidOid, (Datum) 0);
+			else
+				ScanKeyEntryInitializeWithInfo(&scankeys[j], 0, j + 1,
+											   BTEqualStrategyNumber,
+											   InvalidOid,
+											   indexrel->rd_indcollation[j],
+											   &eqprocs[j], keys[i].values[j]);
+		}
+
+		index_rescan(scan, scankeys, natts, NULL, 0);
+
+		while ((tid = index_getnext_tid(scan, ForwardScanDirection)) != NULL)
+		{
+			if (ItemPointerEquals(tid, &keys[i].tid))
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] heap tuple not found in index \"%s\"",
+							ItemPointerGetBlockNumber(&keys[i].tid),
+							ItemPointerGetOffsetNumber(&keys[i].tid),
+							RelationGetRelationName(indexrel))));
+			(*nerrs)++;
+		}
+	}
+
+	index_endscan(scan);
+
+	ereport(DEBUG1,
+			(errmsg("probed index \"%s\" with %d of %d sampled tuples, %u not found",
+					RelationGetRelationName(indexrel), nkeys, probe->ntuples,
+					*nerrs)));
+
+	pfree(sort.cmp);
+	pfree(eqprocs);
+	pfree(scankeys);
+	MemoryContextDelete(cxt);
+
+	index_close(indexrel, AccessShareLock);
+
+	return true;
+}
+
+/* compare keys in the index order (and then by TID) */
+static int
+probe_key_cmp(const void *a, const void *b, void *arg)
+{
+	const probe_key *ka = (const probe_key *) a;
+	const probe_key *kb = (const probe_key *) b;
+	probe_sort *sort = (probe_sort *) arg;
+	int			j;
+
+	for (j = 0; j < sort->nkeys; j++)
+	{
+		bool		nulls_first = (sort->options[j] & INDOPTION_NULLS_FIRST) != 0;
+		int32		cmp;
+
+		if (ka->isnull[j] && kb->isnull[j])
+			continue;
+		else if (ka->isnull[j])
+			return (nulls_first) ? -1 : 1;
+		else if (kb->isnull[j])
+			return (nulls_first) ? 1 : -1;
+
+		cmp = DatumGetInt32(FunctionCall2Coll(sort->cmp[j],
+											  sort->collations[j],
+											  ka->values[j], kb->values[j]));
+
+		if (sort->options[j] & INDOPTION_DESC)
+			cmp = -cmp;
+
+		if (cmp != 0)
+			return (cmp < 0) ? -1 : 1;
+	}
+
+	return ItemPointerCompare((ItemPointer) &ka->tid, (ItemPointer) &kb->tid);
+}
@@ -0,0 +1,43 @@
+#ifndef PROBE_CHECK_H
+#define PROBE_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "heap.h"
+
+/*
+ * Sample of heap tuples (collected during the heap pass), to be looked up in
+ * b-tree indexes. Only live tuples are sampled - those have to be in all the
+ * indexes (matching the predicate), even with concurrent changes.
+ */
+typedef struct probe_sample
+{
+	MemoryContext cxt;			/* copies of the sampled tuples */
+	double		rate;			/* fraction of tuples to sample */
+	int			ntuples;
+	int			maxtuples;
+	HeapTuple  *tuples;			/* t_self is the root item of the HOT chain */
+}			probe_sample;
+
+/* Prepares an empty sample (in a new memory context). */
+probe_sample *probe_init(double rate);
+
+/* Releases the sample (deletes the memory context). */
+void		probe_free(probe_sample * probe);
+
+/* Adds a random sample of live tuples from the heap page. */
+void		probe_add_heap_items(probe_sample * probe, heap_check_state * state,
+								 PageHeader header, char *raw_page,
+								 BlockNumber block);
+
+/* Looks up the sampled tuples in the index (a regular descent for each tuple,
+ * with the keys sorted in the index order), reports tuples not found.
+ *
+ * Returns false if the index can't be probed (not a valid b-tree index),
+ * otherwise sets the number of issues found.
+ */
+bool		probe_index(probe_sample * probe, Relation heaprel, Oid indexOid,
+						uint32 *nerrs);
+
+#endif							/* PROBE_CHECK_H */
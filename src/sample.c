@@ -0,0 +1,216 @@
+#include "postgres.h"
+
+#include <math.h>
+
+#include "sample.h"
+
+/* z-score for the 95% confidence bound */
+#define SAMPLER_Z	1.96
+
+/* compute the sample size (in blocks) */
+BlockNumber
+sampler_size(BlockNumber nblocks, double fraction, int64 blocks)
+{
+	if (fraction > 0)
+		return (BlockNumber) Min(ceil(fraction * nblocks), nblocks);
+
+	if (blocks > 0)
+		return (BlockNumber) Min(blocks, nblocks);
+
+	return nblocks;
+}
+
+/* initialize the sampler for a range of blocks */
+void
+sampler_init(block_sampler * sampler, BlockNumber blockFrom,
+			 BlockNumber blockTo, BlockNumber samplesize)
+{
+	Assert(blockFrom <= blockTo);
+
+	memset(sampler, 0, sizeof(block_sampler));
+
+	sampler->blockFrom = blockFrom;
+	sampler->blockTo = blockTo;
+	sampler->next = blockFrom;
+
+	sampler->phase = SAMPLER_SAMPLE;
+	sampler->backward = InvalidBlockNumber;
+	sampler->maxchecked = InvalidBlockNumber;
+	sampler->prevchecked = InvalidBlockNumber;
+
+	/* only sample when we're asked to check fewer blocks than available */
+	sampler->sampling = (samplesize < (blockTo - blockFrom));
+
+	/*
+	 * BlockSampler returns the blocks in increasing order, so the reads are
+	 * sequential, even if we skip most of the blocks.
+	 */
+	if (sampler->sampling)
+		BlockSampler_Init(&sampler->bs, blockTo - blockFrom, samplesize,
+						  random());
+}
+
+/*
+ * Returns the next block to check.
+ *
+ * After a corrupted block, we first walk backwards (towards the previous
+ * checked block) and then forwards, until we find a clean block in each
+ * direction. Then we continue with the regular sample, skipping blocks we
+ * have already checked.
+ */
+BlockNumber
+sampler_next(block_sampler * sampler)
+{
+	BlockNumber block;
+
+	if (sampler->phase == SAMPLER_BACKWARD)
+	{
+		sampler->extra = true;
+		return sampler->backward;
+	}
+
+	if (sampler->phase == SAMPLER_FORWARD)
+	{
+		if (sampler->maxchecked + 1 < sampler->blockTo)
+		{
+			sampler->extra = true;
+			sampler->prevchecked = sampler->maxchecked;
+			return ++sampler->maxchecked;
+		}
+
+		sampler->phase = SAMPLER_SAMPLE;
+	}
+
+	sampler->extra = false;
+
+	/* not sampling, just return blocks one by one */
+	if (!sampler->sampling)
+	{
+		if (sampler->next >= sampler->blockTo)
+			return InvalidBlockNumber;
+
+		block = sampler->next++;
+	}
+	else
+	{
+		block = InvalidBlockNumber;
+
+		while (BlockSampler_HasMore(&sampler->bs))
+		{
+			block = sampler->blockFrom + BlockSampler_Next(&sampler->bs);
+
+			/* skip blocks already checked while extending the sample */
+			if ((sampler->maxchecked == InvalidBlockNumber) ||
+				(block > sampler->maxchecked))
+				break;
+
+			block = InvalidBlockNumber;
+		}
+
+		if (block == InvalidBlockNumber)
+			return InvalidBlockNumber;
+	}
+
+	sampler->prevchecked = sampler->maxchecked;
+	sampler->maxchecked = block;
+
+	return block;
+}
+
+/* update statistics, and decide whether to extend the sample */
+void
+sampler_report(block_sampler * sampler, BlockNumber block, uint32 nerrs)
+{
+	/* lowest block we may extend the sample to (backwards) */
+	BlockNumber lowest;
+
+	if (!sampler->extra)
+	{
+		sampler->nsampled++;
+		sampler->ncorrupted += (nerrs > 0) ? 1 : 0;
+	}
+	else
+	{
+		sampler->nextra++;
+		sampler->nextra_corrupted += (nerrs > 0) ? 1 : 0;
+	}
+
+	/* when checking all the blocks, there's nothing to extend */
+	if (!sampler->sampling)
+		return;
+
+	lowest = (sampler->prevchecked == InvalidBlockNumber) ?
+		sampler->blockFrom : (sampler->prevchecked + 1);
+
+	switch (sampler->phase)
+	{
+		case SAMPLER_SAMPLE:
+			if (nerrs == 0)
+				break;
+
+			ereport(DEBUG1,
+					(errmsg("[%d] sampled block is corrupted, extending the sample",
+							block)));
+
+			/* walk backwards first (if there are unchecked blocks) */
+			if (block > lowest)
+			{
+				sampler->phase = SAMPLER_BACKWARD;
+				sampler->backward = block - 1;
+			}
+			else
+				sampler->phase = SAMPLER_FORWARD;
+			break;
+
+		case SAMPLER_BACKWARD:
+			/* continue until a clean block (or the previous checked one) */
+			if ((nerrs > 0) && (block > lowest))
+				sampler->backward = block - 1;
+			else
+			{
+				sampler->phase = SAMPLER_FORWARD;
+				sampler->backward = InvalidBlockNumber;
+			}
+			break;
+
+		case SAMPLER_FORWARD:
+			/* continue until a clean block */
+			if (nerrs == 0)
+				sampler->phase = SAMPLER_SAMPLE;
+			break;
+	}
+}
+
+/*
+ * Report the estimated corruption rate.
+ *
+ * We only use the regular sample for the estimate (the blocks added while
+ * extending the sample are not random). The confidence bound is the upper
+ * bound of the Wilson score interval, which behaves well even for rates
+ * close to 0 (which is the common case).
+ */
+void
+sampler_summary(block_sampler * sampler, const char *relname)
+{
+	double		n = sampler->nsampled;
+	double		p;
+	double		z2 = SAMPLER_Z * SAMPLER_Z;
+	double		upper;
+
+	if (!sampler->sampling || (sampler->nsampled == 0))
+		return;
+
+	p = sampler->ncorrupted / n;
+
+	upper = (p + z2 / (2 * n) +
+			 SAMPLER_Z * sqrt(p * (1 - p) / n + z2 / (4 * n * n))) / (1 + z2 / n);
+
+	ereport(NOTICE,
+			(errmsg("\"%s\": sampled %u of %u blocks, %u corrupted, estimated corruption rate %.4f%% (95%% upper bound %.4f%%)",
+					relname, sampler->nsampled,
+					sampler->blockTo - sampler->blockFrom,
+					sampler->ncorrupted, 100 * p, 100 * Min(upper, 1.0)),
+			 (sampler->nextra > 0) ?
+			 errdetail("Extended the sample by %u blocks around corrupted blocks, %u of them corrupted.",
+					   sampler->nextra, sampler->nextra_corrupted) : 0));
+}
@@ -0,0 +1,73 @@
+#ifndef SAMPLE_CHECK_H
+#define SAMPLE_CHECK_H
+
+#include "postgres.h"
+#include "utils/sampling.h"
+
+/* phase of the block sampler (see sampler_next) */
+typedef enum
+{
+	SAMPLER_SAMPLE,				/* regular sample (or all blocks) */
+	SAMPLER_BACKWARD,			/* extending the sample before a corrupted block */
+	SAMPLER_FORWARD				/* extending the sample after a corrupted block */
+}			SamplerPhase;
+
+/*
+ * Decides which blocks of a relation to check - either all blocks in the
+ * range, or a random sample of them (returned in increasing order, so that
+ * the reads are sequential).
+ *
+ * When a sampled block turns out to be corrupted, the sample is extended
+ * with the neighboring blocks (in both directions), until clean blocks are
+ * found, to determine the extent of the damage.
+ */
+typedef struct block_sampler
+{
+	BlockNumber blockFrom;		/* range of blocks [blockFrom, blockTo) */
+	BlockNumber blockTo;
+
+	bool		sampling;		/* checking just a sample of blocks? */
+	BlockSamplerData bs;		/* random sample (when sampling) */
+	BlockNumber next;			/* next block (when not sampling) */
+
+	SamplerPhase phase;
+	bool		extra;			/* last block extends the sample */
+	BlockNumber backward;		/* next block when extending backwards */
+	BlockNumber maxchecked;		/* highest block checked so far */
+	BlockNumber prevchecked;	/* highest block checked before maxchecked */
+
+	/* statistics */
+	BlockNumber nsampled;		/* sampled blocks */
+	BlockNumber ncorrupted;		/* sampled blocks with issues */
+	BlockNumber nextra;			/* blocks checked to extend the sample */
+	BlockNumber nextra_corrupted;	/* ... and how many had issues */
+}			block_sampler;
+
+/* Computes size of the sample for a relation with nblocks blocks.
+ *
+ * - fraction : fraction of blocks to sample (0 if not specified)
+ * - blocks : number of blocks to sample (0 if not specified)
+ *
+ * Returns number of blocks to check (nblocks when not sampling).
+ */
+BlockNumber sampler_size(BlockNumber nblocks, double fraction, int64 blocks);
+
+/* Initializes the sampler for a range of blocks [blockFrom, blockTo),
+ * checking samplesize blocks (all of them if samplesize >= range size).
+ */
+void		sampler_init(block_sampler * sampler, BlockNumber blockFrom,
+						 BlockNumber blockTo, BlockNumber samplesize);
+
+/* Returns the next block to check, or InvalidBlockNumber when done. */
+BlockNumber sampler_next(block_sampler * sampler);
+
+/* Reports the number of issues found in the last block (returned by
+ * sampler_next), so that the sample can be extended if needed. */
+void		sampler_report(block_sampler * sampler, BlockNumber block,
+						   uint32 nerrs);
+
+/* Reports the estimated corruption rate (with a confidence bound), if
+ * checking just a sample of the relation. */
+void		sampler_summary(block_sampler * sampler, const char *relname);
+
+#endif							/* SAMPLE_CHECK_H */
@@ -0,0 +1,379 @@
+#include "postgres.h"
+
+/* SP-GiST indexes store NULL values (in a separate tree) since 9.3 */
+#if (PG_VERSION_NUM >= 90300)
+
+#include "access/itup.h"
+#include "access/spgist_private.h"
+#include "catalog/pg_am.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+
+#include "common.h"
+#include "spgist.h"
+
+static uint32 spgist_check_metapage(Relation rel, char *raw_page,
+					  BlockNumber block);
+static uint32 spgist_check_tuple(Relation rel, PageHeader header,
+				   BlockNumber block, int item, bool isleaf,
+				   BlockNumber *nblocks, int *nredirect,
+				   int *nplaceholder, item_bitmap * bitmap);
+static uint32 spgist_check_inner_tuple(Relation rel, SpGistInnerTuple itup,
+						 BlockNumber block, int item,
+						 BlockNumber *nblocks);
+static uint32 spgist_check_pointer(Relation rel, BlockNumber *nblocks,
+					 ItemPointer ptr, const char *what,
+					 BlockNumber block, int item);
+
+/*
+ * spgist_check_page
+ *		Check a SP-GiST page, and optionally add the heap TIDs to the bitmap.
+ *
+ * The SP-GiST index has a metapage, and two fixed root pages (for regular
+ * and NULL values). Tuples on inner pages contain nodes pointing to inner
+ * tuples or chains of leaf tuples on other pages. Tuples are never removed
+ * directly, but replaced by redirect/placeholder tuples (counted in the
+ * special space), so that the offsets in the chains remain valid.
+ *
+ * FIXME This only checks individual pages, not the tree structure.
+ */
+uint32
+spgist_check_page(Relation rel, PageHeader header, BlockNumber block,
+				  char *raw_page, item_bitmap * bitmap, void *state)
+{
+	uint32		nerrs = 0;
+	SpGistPageOpaque opaque;
+	BlockNumber nblocks = 0;
+	bool		isleaf;
+	int			nredirect = 0;
+	int			nplaceholder = 0;
+	int			ntuples;
+	int			i;
+
+	/* make sure we only ever call this for SP-GiST indexes */
+	Assert(rel->rd_rel->relam == SPGIST_AM_OID);
+
+	/* check basic page header */
+	nerrs += check_page_header(header, block);
+
+	if (PageIsNew(raw_page))
+		return nerrs;
+
+	/* check there's enough space for index-relevant data */
+	if (PageGetSpecialSize(raw_page) != MAXALIGN(sizeof(SpGistPageOpaqueData)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] special space has unexpected size %d (expected %d)",
+						block, (int) PageGetSpecialSize(raw_page),
+						(int) MAXALIGN(sizeof(SpGistPageOpaqueData)))));
+		return ++nerrs;
+	}
+
+	opaque = SpGistPageGetOpaque(raw_page);
+
+	ereport(DEBUG2,
+			(errmsg("[%d] SP-GiST page [flags=%u, redirects=%u, placeholders=%u]",
+					block, opaque->flags, opaque->nRedirection,
+					opaque->nPlaceholder)));
+
+	if (opaque->spgist_page_id != SPGIST_PAGE_ID)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] invalid page id 0x%04X (should be 0x%04X)",
+						block, opaque->spgist_page_id, SPGIST_PAGE_ID)));
+		return ++nerrs;
+	}
+
+	/* the metapage is always the first block */
+	if (block == SPGIST_METAPAGE_BLKNO)
+		return nerrs + spgist_check_metapage(rel, raw_page, block);
+
+	if (SpGistPageIsMeta(raw_page))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] page is marked as metapage", block)));
+		return ++nerrs;
+	}
+
+	/* contents of deleted pages are irrelevant */
+	if (SpGistPageIsDeleted(raw_page))
+		return nerrs;
+
+	/* the two root pages are for regular and NULL values */
+	if (((block == SPGIST_ROOT_BLKNO) && SpGistPageStoresNulls(raw_page)) ||
+		((block == SPGIST_NULL_BLKNO) && !SpGistPageStoresNulls(raw_page)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] root page has incorrect flags %u",
+						block, opaque->flags)));
+		nerrs++;
+	}
+
+	isleaf = SpGistPageIsLeaf(raw_page);
+	ntuples = PageGetMaxOffsetNumber(raw_page);
+
+	for (i = 0; i < ntuples; i++)
+		nerrs += spgist_check_tuple(rel, header, block, i + 1, isleaf,
+									&nblocks, &nredirect, &nplaceholder,
+									bitmap);
+
+	if ((nredirect != opaque->nRedirection) ||
+		(nplaceholder != opaque->nPlaceholder))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] page has %d redirects and %d placeholders (expected %u and %u)",
+						block, nredirect, nplaceholder,
+						opaque->nRedirection, opaque->nPlaceholder)));
+		nerrs++;
+	}
+
+	return nerrs;
+}
+
+/* checks the metapage (magic number, cached pages) */
+static uint32
+spgist_check_metapage(Relation rel, char *raw_page, BlockNumber block)
+{
+	uint32		nerrs = 0;
+	SpGistMetaPageData *meta = SpGistPageGetMeta(raw_page);
+	BlockNumber nblocks = RelationGetNumberOfBlocks(rel);
+	int			i;
+
+	if (meta->magicNumber != SPGIST_MAGIC_NUMBER)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] metapage contains invalid magic number 0x%08X (should be 0x%08X)",
+						block, meta->magicNumber, SPGIST_MAGIC_NUMBER)));
+		return ++nerrs;
+	}
+
+	/* the cache of last-used pages is only a hint, but the pages have to exist */
+	for (i = 0; i < SPGIST_CACHED_PAGES; i++)
+	{
+		BlockNumber cached = meta->lastUsedPages.cachedPage[i].blkno;
+
+		if ((cached != InvalidBlockNumber) &&
+			((cached <= SPGIST_LAST_FIXED_BLKNO) || (cached >= nblocks)))
+		{
+			ereport(WARNING,
+					(errmsg("[%d] cached page %u not within [%u, %u)",
+							block, cached, SPGIST_LAST_FIXED_BLKNO + 1,
+							nblocks)));
+			nerrs++;
+		}
+	}
+
+	return nerrs;
+}
+
+/*
+ * Checks a single SP-GiST tuple. All tuples start with the same bitfield
+ * with the tuple state, so we can look at that before deciding how to
+ * interpret the rest of the tuple.
+ */
+static uint32
+spgist_check_tuple(Relation rel, PageHeader header, BlockNumber block,
+				   int item, bool isleaf, BlockNumber *nblocks,
+				   int *nredirect, int *nplaceholder, item_bitmap * bitmap)
+{
+	ItemId		lp = &header->pd_linp[item - 1];
+	char	   *tuple;
+	SpGistDeadTuple dt;
+	SpGistLeafTuple lt;
+	uint32		size;
+
+	/* SP-GiST uses placeholders instead of removing/killing items */
+	if (lp->lp_flags != LP_NORMAL)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] item is not LP_NORMAL (flag %u)",
+						block, item, lp->lp_flags)));
+		return 1;
+	}
+
+	if ((lp->lp_off < header->pd_upper) ||
+		(lp->lp_off + lp->lp_len > header->pd_special) ||
+		(lp->lp_len < Min(SGITHDRSZ, SGDTSIZE)))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] item (%d,%d) not within [upper %d, special %d]",
+						block, item, lp->lp_off, lp->lp_len,
+						header->pd_upper, header->pd_special)));
+		return 1;
+	}
+
+	tuple = (char *) header + lp->lp_off;
+	dt = (SpGistDeadTuple) tuple;
+
+	switch (dt->tupstate)
+	{
+		case SPGIST_REDIRECT:
+		case SPGIST_PLACEHOLDER:
+		case SPGIST_DEAD:
+			if ((lp->lp_len != SGDTSIZE) || (dt->size != SGDTSIZE))
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] dead tuple length %u / item length %d (expected %zu)",
+								block, item, dt->size, lp->lp_len,
+								(size_t) SGDTSIZE)));
+				return 1;
+			}
+
+			if (dt->tupstate == SPGIST_PLACEHOLDER)
+			{
+				(*nplaceholder)++;
+				return 0;
+			}
+
+			if (dt->tupstate == SPGIST_REDIRECT)
+			{
+				(*nredirect)++;
+				return spgist_check_pointer(rel, nblocks, &dt->pointer,
+											"redirect", block, item);
+			}
+
+			/* dead tuples only happen in leaf chains */
+			if (!isleaf)
+			{
+				ereport(WARNING,
+						(errmsg("[%d:%d] dead tuple on an inner page",
+								block, item)));
+				return 1;
+			}
+
+			return 0;
+	}
+
+	/* live tuple - inner or leaf, depending on the page */
+	if (!isleaf)
+	{
+		size = ((SpGistInnerTuple) tuple)->size;
+
+		if (size != lp->lp_len)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] inner tuple length %u does not match item length %d",
+							block, item, size, lp->lp_len)));
+			return 1;
+		}
+
+		return spgist_check_inner_tuple(rel, (SpGistInnerTuple) tuple,
+										block, item, nblocks);
+	}
+
+	lt = (SpGistLeafTuple) tuple;
+	size = lt->size;
+
+	if ((size < SGLTHDRSZ) || (size != lp->lp_len))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] leaf tuple length %u does not match item length %d",
+						block, item, size, lp->lp_len)));
+		return 1;
+	}
+
+	/* leaf tuples of the same parent node are chained on the page */
+	if (lt->nextOffset > PageGetMaxOffsetNumber((Page) header))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] next offset %u not within the page (max %u)",
+						block, item, lt->nextOffset,
+						PageGetMaxOffsetNumber((Page) header))));
+		return 1;
+	}
+
+	if ((ItemPointerGetOffsetNumber(&lt->heapPtr) < FirstOffsetNumber) ||
+		(ItemPointerGetOffsetNumber(&lt->heapPtr) > MaxHeapTuplesPerPage))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] heap pointer (%u,%u) has invalid offset",
+						block, item,
+						ItemPointerGetBlockNumber(&lt->heapPtr),
+						ItemPointerGetOffsetNumber(&lt->heapPtr))));
+		return 1;
+	}
+
+	if (bitmap)
+		bitmap_set(bitmap, ItemPointerGetBlockNumber(&lt->heapPtr),
+				   ItemPointerGetOffsetNumber(&lt->heapPtr) - 1);
+
+	return 0;
+}
+
+/*
+ * Checks an inner tuple - the prefix and the nodes have to fit into the
+ * tuple, and the nodes have to point to tuples on other non-root pages.
+ */
+static uint32
+spgist_check_inner_tuple(Relation rel, SpGistInnerTuple itup,
+						 BlockNumber block, int item, BlockNumber *nblocks)
+{
+	uint32		nerrs = 0;
+	char	   *ptr;
+	char	   *end = (char *) itup + itup->size;
+	int			i;
+
+	if ((itup->size < SGITHDRSZ + itup->prefixSize) || (itup->nNodes == 0))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] inner tuple length %u too short (prefix %u, %u nodes)",
+						block, item, itup->size, itup->prefixSize,
+						itup->nNodes)));
+		return ++nerrs;
+	}
+
+	ptr = (char *) SGITNODEPTR(itup);
+
+	for (i = 0; i < itup->nNodes; i++)
+	{
+		IndexTuple	node = (IndexTuple) ptr;
+
+		if ((ptr + sizeof(IndexTupleData) > end) ||
+			(ptr + IndexTupleSize(node) > end))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] node %d exceeds the inner tuple length %u",
+							block, item, i, itup->size)));
+			return ++nerrs;
+		}
+
+		/* nodes without downlink are allowed (no tuples for the node yet) */
+		if (ItemPointerIsValid(&node->t_tid))
+			nerrs += spgist_check_pointer(rel, nblocks, &node->t_tid,
+										  "downlink", block, item);
+
+		ptr += IndexTupleSize(node);
+	}
+
+	return nerrs;
+}
+
+/*
+ * Checks that a tuple pointer (downlink or redirect) points to a non-root
+ * page within the index. The index may be extended concurrently, so re-read
+ * the size when needed.
+ */
+static uint32
+spgist_check_pointer(Relation rel, BlockNumber *nblocks, ItemPointer ptr,
+					 const char *what, BlockNumber block, int item)
+{
+	BlockNumber target = ItemPointerGetBlockNumber(ptr);
+
+	if (target >= *nblocks)
+		*nblocks = RelationGetNumberOfBlocks(rel);
+
+	if ((target <= SPGIST_LAST_FIXED_BLKNO) || (target >= *nblocks) ||
+		(ItemPointerGetOffsetNumber(ptr) < FirstOffsetNumber))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] %s (%u,%u) not within [%u, %u)",
+						block, item, what, target,
+						ItemPointerGetOffsetNumber(ptr),
+						SPGIST_LAST_FIXED_BLKNO + 1, *nblocks)));
+		return 1;
+	}
+
+	return 0;
+}
+
+#endif							/* PG_VERSION_NUM >= 90300 */
@@ -0,0 +1,19 @@
+#ifndef SPGIST_CHECK_H
+#define SPGIST_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+
+#include "item-bitmap.h"
+
+/* Checks a SP-GiST index page (metapage, inner or leaf page). When a bitmap
+ * is supplied, the heap TIDs of live leaf tuples are added to it, for the
+ * cross-check with the table.
+ *
+ * Returns number of issues found.
+ */
+uint32		spgist_check_page(Relation rel, PageHeader header,
+							  BlockNumber block, char *raw_page,
+							  item_bitmap * bitmap, void *state);
+
+#endif							/* SPGIST_CHECK_H */
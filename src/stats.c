@@ -0,0 +1,417 @@
+#include "postgres.h"
+
+#include <limits.h>
+#include <unistd.h>
+
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+
+#include "stats.h"
+
+/* location of the statistics saved at shutdown */
+#define STATS_DUMP_FILE		PGSTAT_STAT_PERMANENT_DIRECTORY "/pg_check.stat"
+
+/* magic number of the file (changes when the entry format changes) */
+#define STATS_FILE_HEADER	0x50474301
+
+/* number of columns returned by pg_check_stats */
+#define STATS_COLUMNS		10
+
+int			pgcheck_max_stats = 1000;
+
+/* named LWLock tranches were introduced in 9.6 */
+#if (PG_VERSION_NUM >= 90600)
+
+/* shared state (the lock protects the hash table) */
+typedef struct check_stats_shared
+{
+	LWLock	   *lock;
+}			check_stats_shared;
+
+static check_stats_shared * stats_shared = NULL;
+static HTAB *stats_hash = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if (PG_VERSION_NUM >= 150000)
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+static Size stats_memsize(void);
+static void stats_shmem_request(void);
+static void stats_shmem_startup(void);
+static void stats_shmem_shutdown(int code, Datum arg);
+static void stats_load(void);
+static void stats_evict(void);
+
+#endif
+
+void
+stats_init(void)
+{
+	DefineCustomIntVariable("pg_check.max_stats",
+							"max number of relations tracked in pg_stat_check.",
+							NULL,
+							&pgcheck_max_stats,
+							1000,
+							100,
+							INT_MAX,
+							PGC_POSTMASTER,
+							0,
+#if (PG_VERSION_NUM >= 90100)
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+#if (PG_VERSION_NUM >= 90600)
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if (PG_VERSION_NUM >= 150000)
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = stats_shmem_request;
+#else
+	stats_shmem_request();
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = stats_shmem_startup;
+#endif
+}
+
+void
+stats_record(Oid relid, TimestampTz start, int64 npages, int64 nerrs)
+{
+#if (PG_VERSION_NUM >= 90600)
+	check_stats_key key;
+	check_stats_entry *entry;
+	TimestampTz now;
+	long		secs;
+	int			usecs;
+	double		duration;
+
+	if (!stats_hash)
+		return;
+
+	now = GetCurrentTimestamp();
+
+	TimestampDifference(start, now, &secs, &usecs);
+	duration = secs * 1000.0 + usecs / 1000.0;
+
+	memset(&key, 0, sizeof(check_stats_key));
+	key.dbid = MyDatabaseId;
+	key.relid = relid;
+
+	LWLockAcquire(stats_shared->lock, LW_EXCLUSIVE);
+
+	entry = (check_stats_entry *) hash_search(stats_hash, &key, HASH_FIND, NULL);
+
+	/* new relation - make room for it, if needed */
+	if (!entry)
+	{
+		if (hash_get_num_entries(stats_hash) >= pgcheck_max_stats)
+			stats_evict();
+
+		entry = (check_stats_entry *) hash_search(stats_hash, &key,
+												  HASH_ENTER, NULL);
+
+		memset(entry, 0, sizeof(check_stats_entry));
+		entry->key = key;
+	}
+
+	entry->checks++;
+	entry->last_check = now;
+	entry->last_time = duration;
+	entry->last_pages = npages;
+	entry->last_errors = nerrs;
+
+	entry->total_time += duration;
+	entry->total_pages += npages;
+	entry->total_errors += nerrs;
+
+	LWLockRelease(stats_shared->lock);
+#endif
+}
+
+void
+stats_report(Tuplestorestate *tupstore, TupleDesc tupdesc)
+{
+#if (PG_VERSION_NUM >= 90600)
+	HASH_SEQ_STATUS status;
+	check_stats_entry *entry;
+
+	if (!stats_hash)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pg_check must be loaded via shared_preload_libraries to collect statistics")));
+
+	LWLockAcquire(stats_shared->lock, LW_SHARED);
+
+	hash_seq_init(&status, stats_hash);
+	while ((entry = (check_stats_entry *) hash_seq_search(&status)) != NULL)
+	{
+		Datum		values[STATS_COLUMNS];
+		bool		nulls[STATS_COLUMNS];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(entry->key.dbid);
+		values[1] = ObjectIdGetDatum(entry->key.relid);
+		values[2] = Int64GetDatum(entry->checks);
+		values[3] = TimestampTzGetDatum(entry->last_check);
+		values[4] = Float8GetDatum(entry->last_time);
+		values[5] = Int64GetDatum(entry->last_pages);
+		values[6] = Int64GetDatum(entry->last_errors);
+		values[7] = Float8GetDatum(entry->total_time);
+		values[8] = Int64GetDatum(entry->total_pages);
+		values[9] = Int64GetDatum(entry->total_errors);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	LWLockRelease(stats_shared->lock);
+#else
+	elog(ERROR, "statistics require PostgreSQL 9.6 or newer");
+#endif
+}
+
+void
+stats_reset(void)
+{
+#if (PG_VERSION_NUM >= 90600)
+	HASH_SEQ_STATUS status;
+	check_stats_entry *entry;
+
+	if (!stats_hash)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pg_check must be loaded via shared_preload_libraries to collect statistics")));
+
+	LWLockAcquire(stats_shared->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, stats_hash);
+	while ((entry = (check_stats_entry *) hash_seq_search(&status)) != NULL)
+		hash_search(stats_hash, &entry->key, HASH_REMOVE, NULL);
+
+	LWLockRelease(stats_shared->lock);
+#else
+	elog(ERROR, "statistics require PostgreSQL 9.6 or newer");
+#endif
+}
+
+#if (PG_VERSION_NUM >= 90600)
+
+/* shared memory for the hash table (with max_stats entries) */
+static Size
+stats_memsize(void)
+{
+	return add_size(MAXALIGN(sizeof(check_stats_shared)),
+					hash_estimate_size(pgcheck_max_stats,
+									   sizeof(check_stats_entry)));
+}
+
+static void
+stats_shmem_request(void)
+{
+#if (PG_VERSION_NUM >= 150000)
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+#endif
+
+	RequestAddinShmemSpace(stats_memsize());
+	RequestNamedLWLockTranche("pg_check", 1);
+}
+
+/*
+ * Allocate the shared state, or attach to it. In the postmaster, also load
+ * the statistics saved by the last shutdown, and arrange for saving them at
+ * the next one.
+ */
+static void
+stats_shmem_startup(void)
+{
+	bool		found;
+	HASHCTL		info;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	stats_shared = ShmemInitStruct("pg_check stats",
+								   sizeof(check_stats_shared), &found);
+
+	if (!found)
+		stats_shared->lock = &(GetNamedLWLockTranche("pg_check"))->lock;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(check_stats_key);
+	info.entrysize = sizeof(check_stats_entry);
+
+	stats_hash = ShmemInitHash("pg_check stats hash",
+							   pgcheck_max_stats, pgcheck_max_stats,
+							   &info, HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (!IsUnderPostmaster)
+		on_shmem_exit(stats_shmem_shutdown, (Datum) 0);
+
+	/* someone else already initialized (and loaded) the statistics */
+	if (found)
+		return;
+
+	stats_load();
+}
+
+/* load statistics saved by the last shutdown (if any), remove the file */
+static void
+stats_load(void)
+{
+	FILE	   *file;
+	uint32		header;
+	int32		num;
+	int32		i;
+
+	file = AllocateFile(STATS_DUMP_FILE, PG_BINARY_R);
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m", STATS_DUMP_FILE)));
+		return;
+	}
+
+	if (fread(&header, sizeof(uint32), 1, file) != 1 ||
+		header != STATS_FILE_HEADER ||
+		fread(&num, sizeof(int32), 1, file) != 1)
+		goto error;
+
+	for (i = 0; i < num; i++)
+	{
+		check_stats_entry temp;
+		check_stats_entry *entry;
+
+		if (fread(&temp, sizeof(check_stats_entry), 1, file) != 1)
+			goto error;
+
+		/* max_stats may have been decreased since the shutdown */
+		if (hash_get_num_entries(stats_hash) >= pgcheck_max_stats)
+			break;
+
+		entry = (check_stats_entry *) hash_search(stats_hash, &temp.key,
+												  HASH_ENTER, NULL);
+		memcpy(entry, &temp, sizeof(check_stats_entry));
+	}
+
+	FreeFile(file);
+	unlink(STATS_DUMP_FILE);
+
+	return;
+
+error:
+	ereport(LOG,
+			(errcode_for_file_access(),
+			 errmsg("could not read file \"%s\": %m", STATS_DUMP_FILE)));
+
+	FreeFile(file);
+	unlink(STATS_DUMP_FILE);
+}
+
+/* save the statistics at shutdown (but not after a crash) */
+static void
+stats_shmem_shutdown(int code, Datum arg)
+{
+	FILE	   *file;
+	HASH_SEQ_STATUS status;
+	check_stats_entry *entry;
+	uint32		header = STATS_FILE_HEADER;
+	int32		num;
+
+	if (code)
+		return;
+
+	if (!stats_shared || !stats_hash)
+		return;
+
+	file = AllocateFile(STATS_DUMP_FILE ".tmp", PG_BINARY_W);
+	if (file == NULL)
+		goto error;
+
+	num = hash_get_num_entries(stats_hash);
+
+	if (fwrite(&header, sizeof(uint32), 1, file) != 1 ||
+		fwrite(&num, sizeof(int32), 1, file) != 1)
+		goto error;
+
+	hash_seq_init(&status, stats_hash);
+	while ((entry = (check_stats_entry *) hash_seq_search(&status)) != NULL)
+	{
+		if (fwrite(entry, sizeof(check_stats_entry), 1, file) != 1)
+		{
+			hash_seq_term(&status);
+			goto error;
+		}
+	}
+
+	if (FreeFile(file))
+	{
+		file = NULL;
+		goto error;
+	}
+
+#if (PG_VERSION_NUM >= 100000)
+	(void) durable_rename(STATS_DUMP_FILE ".tmp", STATS_DUMP_FILE, LOG);
+#else
+	if (rename(STATS_DUMP_FILE ".tmp", STATS_DUMP_FILE) != 0)
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not rename file \"%s\": %m",
+						STATS_DUMP_FILE ".tmp")));
+#endif
+
+	return;
+
+error:
+	ereport(LOG,
+			(errcode_for_file_access(),
+			 errmsg("could not write file \"%s\": %m", STATS_DUMP_FILE ".tmp")));
+
+	if (file)
+		FreeFile(file);
+	unlink(STATS_DUMP_FILE ".tmp");
+}
+
+/* remove the entry checked longest ago (the lock is held exclusively) */
+static void
+stats_evict(void)
+{
+	HASH_SEQ_STATUS status;
+	check_stats_entry *entry;
+	check_stats_key oldest;
+	TimestampTz oldest_check = 0;
+	bool		found = false;
+
+	hash_seq_init(&status, stats_hash);
+	while ((entry = (check_stats_entry *) hash_seq_search(&status)) != NULL)
+	{
+		if (!found || (entry->last_check < oldest_check))
+		{
+			oldest = entry->key;
+			oldest_check = entry->last_check;
+			found = true;
+		}
+	}
+
+	if (found)
+		hash_search(stats_hash, &oldest, HASH_REMOVE, NULL);
+}
+
+#endif
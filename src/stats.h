@@ -0,0 +1,52 @@
+#ifndef STATS_CHECK_H
+#define STATS_CHECK_H
+
+#include "postgres.h"
+#include "access/tupdesc.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+/*
+ * Cumulative statistics of checks of a relation (shared by all backends,
+ * only when loaded through shared_preload_libraries). Kept across restarts,
+ * by writing them into a file at shutdown.
+ */
+typedef struct check_stats_key
+{
+	Oid			dbid;
+	Oid			relid;
+}			check_stats_key;
+
+typedef struct check_stats_entry
+{
+	check_stats_key key;		/* hash key (has to be first) */
+
+	int64		checks;			/* number of checks */
+	TimestampTz last_check;		/* end of the last check */
+	double		last_time;		/* duration of the last check (ms) */
+	int64		last_pages;		/* pages checked by the last check */
+	int64		last_errors;	/* issues found by the last check */
+
+	double		total_time;		/* totals for all checks */
+	int64		total_pages;
+	int64		total_errors;
+}			check_stats_entry;
+
+extern int	pgcheck_max_stats;
+
+/* Defines the GUC, and requests the shared memory when loading through
+ * shared_preload_libraries (called from _PG_init). */
+void		stats_init(void);
+
+/* Records a check of the relation (in the current database), started at
+ * the given time. Does nothing if the statistics are not enabled. */
+void		stats_record(Oid relid, TimestampTz start, int64 npages,
+						 int64 nerrs);
+
+/* Adds all the entries into the tuplestore (for pg_check_stats). */
+void		stats_report(Tuplestorestate *tupstore, TupleDesc tupdesc);
+
+/* Removes all the entries. */
+void		stats_reset(void);
+
+#endif							/* STATS_CHECK_H */
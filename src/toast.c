@@ -0,0 +1,468 @@
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/htup.h"
+#if (PG_VERSION_NUM >= 90300)
+#include "access/htup_details.h"
+#endif
+#include "access/tuptoaster.h"
+#include "catalog/pg_index.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/tqual.h"
+
+#include "toast.h"
+
+/* initial number of TOAST pointers (grows as needed) */
+#define TOAST_VALUES_INITIAL	1024
+
+static int	toast_value_cmp(const void *a, const void *b);
+static uint32 toast_check_value(toast_check * toast, toast_value * value,
+								int32 nchunks, int32 size, bool assembled);
+static uint32 toast_check_decompress(toast_check * toast, toast_value * value);
+
+/* allocate state for TOAST pointers of the relation */
+toast_check *
+toast_check_init(Relation rel, compress_check * compress)
+{
+	toast_check *toast;
+
+	Assert(OidIsValid(rel->rd_rel->reltoastrelid));
+
+	toast = (toast_check *) palloc0(sizeof(toast_check));
+
+	toast->toastrelid = rel->rd_rel->reltoastrelid;
+	toast->compress = compress;
+	toast->maxvalues = TOAST_VALUES_INITIAL;
+	toast->values = (toast_value *) palloc(sizeof(toast_value) * toast->maxvalues);
+
+	return toast;
+}
+
+/* free the collected values */
+void
+toast_check_free(toast_check * toast)
+{
+	Assert(toast != NULL);
+
+	pfree(toast->values);
+	pfree(toast);
+}
+
+/* remember the TOAST pointer (the value is verified later) */
+uint32
+toast_check_add(toast_check * toast, struct varatt_external *pointer,
+				BlockNumber block, OffsetNumber offnum)
+{
+	uint32		nerrs = 0;
+	toast_value *value;
+
+	/* the pointer has to reference the TOAST table of this relation */
+	if (pointer->va_toastrelid != toast->toastrelid)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST pointer references relation %u (expected %u)",
+						block, offnum, pointer->va_toastrelid, toast->toastrelid)));
+		return 1;
+	}
+
+	/*
+	 * The external size determines the expected chunks, so without a sane
+	 * value there's nothing to check the chunks against.
+	 */
+	if ((pointer->va_extsize <= 0) ||
+		(pointer->va_extsize > MaxAllocSize - VARHDRSZ))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u has invalid external size %d",
+						block, offnum, pointer->va_valueid,
+						pointer->va_extsize)));
+		return 1;
+	}
+
+	/*
+	 * The raw size includes the header, and the external data can't be
+	 * larger than the raw data (it's the same for uncompressed values).
+	 * The chunks can still be checked, but the value is not decompressed,
+	 * as the raw size determines the size of the decompression buffer.
+	 */
+	if ((pointer->va_rawsize > MaxAllocSize) ||
+		(pointer->va_rawsize - VARHDRSZ < pointer->va_extsize))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u has invalid raw size %d (external size %d)",
+						block, offnum, pointer->va_valueid,
+						pointer->va_rawsize, pointer->va_extsize)));
+		++nerrs;
+	}
+
+	/*
+	 * There may be a lot of TOAST pointers in large tables, so allow the
+	 * array to exceed MaxAllocSize.
+	 */
+	if (toast->nvalues == toast->maxvalues)
+	{
+		toast->maxvalues *= 2;
+		toast->values = (toast_value *) repalloc_huge(toast->values,
+													  sizeof(toast_value) * toast->maxvalues);
+	}
+
+	value = &toast->values[toast->nvalues++];
+
+	value->valueid = pointer->va_valueid;
+	value->extsize = pointer->va_extsize;
+	value->rawsize = pointer->va_rawsize;
+	value->compressed = (nerrs == 0) &&
+		(pointer->va_extsize < pointer->va_rawsize - VARHDRSZ);
+	value->block = block;
+	value->offnum = offnum;
+
+	return nerrs;
+}
+
+/*
+ * Verify the collected TOAST pointers.
+ *
+ * Looking up the values one by one would mean a random index lookup for
+ * each pointer, which is prohibitively expensive for large tables. So we
+ * sort the values by chunk_id instead, and then walk the TOAST index
+ * in a single ordered scan, merging it with the sorted array.
+ *
+ * We use SnapshotAny, just like the heap checks do not care about tuple
+ * visibility. The pointers were only collected from live tuples, so their
+ * chunks can't be removed by a concurrent vacuum.
+ */
+uint32
+toast_check_values(toast_check * toast)
+{
+	uint32		nerrs = 0;
+	Relation	toastrel;
+	Relation	toastidx = NULL;
+	TupleDesc	toastdesc;
+	List	   *indexlist;
+	ListCell   *lc;
+	SysScanDesc scan;
+	HeapTuple	ttup;
+	Size		i,
+				n;
+
+	/* current value (in the sorted array) */
+	toast_value *value = NULL;
+	int32		nchunks = 0;	/* chunks seen for the current value */
+	int32		size = 0;		/* sum of chunk sizes for the current value */
+	char	   *data = NULL;	/* assembled value (when decompressing) */
+
+	if (toast->nvalues == 0)
+		return nerrs;
+
+	/* sort the values by chunk_id, and remove duplicates */
+	qsort(toast->values, toast->nvalues, sizeof(toast_value), toast_value_cmp);
+
+	/*
+	 * Updates that do not modify a TOASTed attribute reuse the pointer, so
+	 * there may be multiple tuples referencing the same value. All of them
+	 * need to agree on the value size, though.
+	 */
+	n = 1;
+	for (i = 1; i < toast->nvalues; i++)
+	{
+		toast_value *prev = &toast->values[n - 1];
+		toast_value *curr = &toast->values[i];
+
+		if (curr->valueid != prev->valueid)
+		{
+			toast->values[n++] = *curr;
+			continue;
+		}
+
+		if (curr->extsize != prev->extsize)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] TOAST value %u has size %d, but [%d:%d] says %d",
+							curr->block, curr->offnum, curr->valueid, curr->extsize,
+							prev->block, prev->offnum, prev->extsize)));
+			++nerrs;
+		}
+	}
+	toast->nvalues = n;
+
+	ereport(DEBUG1,
+			(errmsg("verifying %zu TOAST values in relation %u",
+					toast->nvalues, toast->toastrelid)));
+
+	toastrel = heap_open(toast->toastrelid, AccessShareLock);
+	toastdesc = RelationGetDescr(toastrel);
+
+	/* pick the valid index (there might be more, e.g. during reindex) */
+	indexlist = RelationGetIndexList(toastrel);
+	foreach(lc, indexlist)
+	{
+		Relation	idx = index_open(lfirst_oid(lc), AccessShareLock);
+
+		if (toastidx == NULL && IndexIsValid(idx->rd_index))
+		{
+			toastidx = idx;
+			continue;
+		}
+
+		index_close(idx, AccessShareLock);
+	}
+	list_free(indexlist);
+
+	if (toastidx == NULL)
+		elog(ERROR, "no valid index on TOAST relation \"%s\"",
+			 RelationGetRelationName(toastrel));
+
+	scan = systable_beginscan_ordered(toastrel, toastidx, SnapshotAny, 0, NULL);
+
+	i = 0;
+	while ((ttup = systable_getnext_ordered(scan, ForwardScanDirection)) != NULL)
+	{
+		Oid			chunk_id;
+		int32		chunk_seq;
+		int32		chunk_size;
+		int32		expected_chunks;
+		Pointer		chunk;
+		bool		isnull;
+
+		CHECK_FOR_INTERRUPTS();
+
+		chunk_id = DatumGetObjectId(fastgetattr(ttup, 1, toastdesc, &isnull));
+
+		/* finish values preceding this chunk */
+		while ((i < toast->nvalues) && (toast->values[i].valueid < chunk_id))
+		{
+			if (value == &toast->values[i])
+				nerrs += toast_check_value(toast, value, nchunks, size,
+										   (data != NULL));
+			else
+				nerrs += toast_check_value(toast, &toast->values[i], 0, 0, false);
+
+			value = NULL;
+			i++;
+		}
+
+		/* no more values to check */
+		if (i == toast->nvalues)
+			break;
+
+		/* chunk of a value we're not interested in */
+		if (toast->values[i].valueid != chunk_id)
+			continue;
+
+		/* first chunk of the value */
+		if (value != &toast->values[i])
+		{
+			value = &toast->values[i];
+			nchunks = 0;
+			size = 0;
+
+			/* compressed values get assembled (in the pooled buffer) */
+			data = NULL;
+			if (toast->compress && value->compressed)
+				data = compress_check_buffer(toast->compress, value->extsize);
+		}
+
+		chunk_seq = DatumGetInt32(fastgetattr(ttup, 2, toastdesc, &isnull));
+		chunk = DatumGetPointer(fastgetattr(ttup, 3, toastdesc, &isnull));
+
+		/* same as in toast_fetch_datum */
+		if (!VARATT_IS_EXTENDED(chunk))
+			chunk_size = VARSIZE(chunk) - VARHDRSZ;
+		else if (VARATT_IS_SHORT(chunk))
+			chunk_size = VARSIZE_SHORT(chunk) - VARHDRSZ_SHORT;
+		else
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] TOAST value %u chunk %d is itself toasted",
+							value->block, value->offnum, chunk_id, chunk_seq)));
+			++nerrs;
+			continue;
+		}
+
+		expected_chunks = ((value->extsize - 1) / TOAST_MAX_CHUNK_SIZE) + 1;
+
+		/*
+		 * The index is on (chunk_id, chunk_seq), so expect sequence. After a
+		 * gap (or a duplicate chunk) continue from the chunk we actually see,
+		 * so that a single missing chunk is not reported for all the chunks
+		 * after it. The total size won't match, and the value won't be
+		 * decompressed.
+		 */
+		if (chunk_seq != nchunks)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] TOAST value %u has chunk %d, expected %d",
+							value->block, value->offnum, chunk_id,
+							chunk_seq, nchunks)));
+			++nerrs;
+
+			nchunks = chunk_seq;
+			data = NULL;
+		}
+		else if (chunk_seq >= expected_chunks)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] TOAST value %u has chunk %d, but only %d chunks expected",
+							value->block, value->offnum, chunk_id,
+							chunk_seq, expected_chunks)));
+			++nerrs;
+		}
+		else if ((chunk_seq < expected_chunks - 1) &&
+				 (chunk_size != TOAST_MAX_CHUNK_SIZE))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] TOAST value %u chunk %d has size %d (expected %d)",
+							value->block, value->offnum, chunk_id,
+							chunk_seq, chunk_size, (int) TOAST_MAX_CHUNK_SIZE)));
+			++nerrs;
+		}
+
+		/* copy the chunk data (only if it fits, otherwise already reported) */
+		if (data && (size + chunk_size <= value->extsize))
+			memcpy(data + size,
+				   VARATT_IS_SHORT(chunk) ? VARDATA_SHORT(chunk) : VARDATA(chunk),
+				   chunk_size);
+
+		nchunks++;
+		size += chunk_size;
+	}
+
+	/* finish the remaining values (those past the last chunk are missing) */
+	for (; i < toast->nvalues; i++)
+	{
+		if (value == &toast->values[i])
+			nerrs += toast_check_value(toast, value, nchunks, size,
+									   (data != NULL));
+		else
+			nerrs += toast_check_value(toast, &toast->values[i], 0, 0, false);
+
+		value = NULL;
+	}
+
+	systable_endscan_ordered(scan);
+
+	index_close(toastidx, AccessShareLock);
+	heap_close(toastrel, AccessShareLock);
+
+	return nerrs;
+}
+
+/*
+ * check the number of chunks and total size of a value (and decompress it,
+ * if it was assembled from the chunks)
+ */
+static uint32
+toast_check_value(toast_check * toast, toast_value * value,
+				  int32 nchunks, int32 size, bool assembled)
+{
+	int32		expected_chunks = ((value->extsize - 1) / TOAST_MAX_CHUNK_SIZE) + 1;
+
+	if (nchunks == 0)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u not found in relation %u",
+						value->block, value->offnum, value->valueid,
+						toast->toastrelid)));
+		return 1;
+	}
+
+	if (nchunks != expected_chunks)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u has %d chunks (expected %d)",
+						value->block, value->offnum, value->valueid,
+						nchunks, expected_chunks)));
+		return 1;
+	}
+
+	if (size != value->extsize)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u has size %d (expected %d)",
+						value->block, value->offnum, value->valueid,
+						size, value->extsize)));
+		return 1;
+	}
+
+	/* decompress the assembled value (if compressed) */
+	if (assembled && (toast_check_decompress(toast, value) > 0))
+		return 1;
+
+	ereport(DEBUG3,
+			(errmsg("[%d:%d] TOAST value %u OK (chunks=%d size=%d)",
+					value->block, value->offnum, value->valueid,
+					nchunks, size)));
+
+	return 0;
+}
+
+/*
+ * Decompress the value assembled from the chunks - the chunks contain the
+ * raw size (int32) followed by the pglz data, the same as inline compressed
+ * values (just without the varlena header).
+ */
+static uint32
+toast_check_decompress(toast_check * toast, toast_value * value)
+{
+	int32		rawsize = value->rawsize - VARHDRSZ;
+	int32		rawlen;
+	int32		header;
+
+	/* only values with sizes validated by toast_check_add */
+	Assert(value->compressed);
+	Assert((value->extsize > 0) && (value->extsize < rawsize));
+	Assert(value->rawsize <= MaxAllocSize);
+
+	if (value->extsize < sizeof(int32))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u is compressed, but has only %d bytes",
+						value->block, value->offnum, value->valueid,
+						value->extsize)));
+		return 1;
+	}
+
+	memcpy(&header, toast->compress->data, sizeof(int32));
+
+	/* the size in the data should match the pointer */
+	if (header != rawsize)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u has raw size %d (pointer says %d)",
+						value->block, value->offnum, value->valueid,
+						header, rawsize)));
+		return 1;
+	}
+
+	rawlen = compress_check_decompress(toast->compress,
+									   toast->compress->data + sizeof(int32),
+									   value->extsize - sizeof(int32),
+									   rawsize);
+
+	if (rawlen != rawsize)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] TOAST value %u is corrupted, decompressed %d bytes (expected %d)",
+						value->block, value->offnum, value->valueid,
+						rawlen, rawsize)));
+		return 1;
+	}
+
+	return 0;
+}
+
+/* sort TOAST values by chunk_id (unsigned, to match the oid btree opclass) */
+static int
+toast_value_cmp(const void *a, const void *b)
+{
+	const toast_value *va = (const toast_value *) a;
+	const toast_value *vb = (const toast_value *) b;
+
+	if (va->valueid < vb->valueid)
+		return -1;
+	else if (va->valueid > vb->valueid)
+		return 1;
+
+	return 0;
+}
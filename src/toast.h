@@ -0,0 +1,60 @@
+#ifndef TOAST_CHECK_H
+#define TOAST_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+#include "access/tuptoaster.h"
+
+#include "compress.h"
+
+/* TOAST pointer found in the heap, to be verified against the TOAST table */
+typedef struct toast_value
+{
+	Oid			valueid;		/* va_valueid (chunk_id in the TOAST table) */
+	int32		extsize;		/* va_extsize (external size of the value) */
+	int32		rawsize;		/* va_rawsize (original size, with header) */
+	bool		compressed;		/* compressed (with valid sizes)? */
+	BlockNumber block;			/* heap tuple referencing the value */
+	OffsetNumber offnum;
+}			toast_value;
+
+/* TOAST pointers collected during the heap pass */
+typedef struct toast_check
+{
+	Oid			toastrelid;		/* TOAST relation the pointers should use */
+
+	/* buffers for decompressing the values (NULL when not decompressing) */
+	compress_check *compress;
+
+	Size		nvalues;		/* number of collected values */
+	Size		maxvalues;		/* allocated space */
+	toast_value *values;
+}			toast_check;
+
+/* Allocates state for collecting TOAST pointers of the relation. With the
+ * compress state, compressed values get decompressed when verified. */
+toast_check *toast_check_init(Relation rel, compress_check * compress);
+
+/* Releases the state, including the collected values. */
+void		toast_check_free(toast_check * toast);
+
+/* Remembers a TOAST pointer from a heap tuple (block, offnum).
+ *
+ * Returns number of issues (pointer to a different TOAST relation, sizes
+ * out of range). Values with invalid sizes are not decompressed, and when
+ * even the external size is bogus, the chunks are not checked at all.
+ */
+uint32		toast_check_add(toast_check * toast, struct varatt_external *pointer,
+							BlockNumber block, OffsetNumber offnum);
+
+/* Sorts the collected pointers by value ID, and verifies all of them in
+ * a single ordered pass over the TOAST table (through its index), i.e.
+ * that all the chunks exist, are numbered sequentially and that their
+ * sizes add up to the external size of the value. Compressed values are
+ * also assembled from the chunks and decompressed (if requested).
+ *
+ * Returns number of issues found.
+ */
+uint32		toast_check_values(toast_check * toast);
+
+#endif							/* TOAST_CHECK_H */
@@ -0,0 +1,237 @@
+#include "postgres.h"
+
+#include "access/htup.h"
+#if (PG_VERSION_NUM >= 90300)
+#include "access/htup_details.h"
+#endif
+#include "access/transam.h"
+#include "access/visibilitymap.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+
+#include "vm.h"
+
+static uint32 check_all_visible_tuple(xid_check * xids, HeapTupleHeader tupheader,
+						BlockNumber block, int i);
+static uint32 check_all_frozen_tuple(Relation rel, HeapTupleHeader tupheader,
+					   BlockNumber block, int i);
+
+/* read the visibility map bits for the block */
+uint8
+vm_get_status(Relation rel, BlockNumber block, Buffer *vmbuffer)
+{
+#if (PG_VERSION_NUM >= 90600)
+	return visibilitymap_get_status(rel, block, vmbuffer);
+#else
+	return visibilitymap_test(rel, block, vmbuffer) ? VISIBILITYMAP_ALL_VISIBLE : 0;
+#endif
+}
+
+/*
+ * check_visibility_map
+ *		Cross-check visibility map bits with the heap page.
+ *
+ * The bits have to be read while holding a lock on the heap buffer, as
+ * both setting and clearing the bits happens while holding an exclusive
+ * lock on the heap page (together with updating PD_ALL_VISIBLE).
+ *
+ * Corrupted visibility map does not cause any immediate errors, but it
+ * makes index-only scans return wrong results (and vacuum skip pages),
+ * so it's worth checking. We look at the tuples anyway, so the checks
+ * are fairly cheap.
+ *
+ * Note: PD_ALL_VISIBLE set without the visibility map bit is valid (e.g.
+ * after a crash, the next vacuum fixes that), the opposite is not.
+ */
+uint32
+check_visibility_map(Relation rel, PageHeader header, char *buffer,
+					 BlockNumber block, uint8 vmstatus, xid_check * xids)
+{
+	uint32		nerrs = 0;
+	int			ntuples = PageGetMaxOffsetNumber(buffer);
+	int			i;
+	bool		all_visible = (vmstatus & VISIBILITYMAP_ALL_VISIBLE);
+	bool		all_frozen = (vmstatus & VISIBILITYMAP_ALL_FROZEN);
+
+	ereport(DEBUG1,
+			(errmsg("[%d] visibility map [all-visible=%d, all-frozen=%d, page all-visible=%d]",
+					block, all_visible, all_frozen,
+					PageIsAllVisible(buffer) ? 1 : 0)));
+
+	/* nothing to check for new pages (can't have the bits set, though) */
+	if (PageIsNew(header))
+	{
+		if (vmstatus != 0)
+		{
+			ereport(WARNING,
+					(errmsg("[%d] page is new, but visibility map bits are set (%u)",
+							block, vmstatus)));
+			++nerrs;
+		}
+
+		return nerrs;
+	}
+
+	if (all_frozen && !all_visible)
+	{
+		ereport(WARNING,
+				(errmsg("[%d] all-frozen bit is set, but all-visible bit is not",
+						block)));
+		++nerrs;
+	}
+
+	if (all_visible && !PageIsAllVisible(buffer))
+	{
+		ereport(WARNING,
+				(errmsg("[%d] all-visible bit is set, but the page is not marked all-visible",
+						block)));
+		++nerrs;
+	}
+
+	/* the tuples only need to be checked if the page is all-visible */
+	if (!all_visible && !PageIsAllVisible(buffer))
+		return nerrs;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		ItemId		lp = &header->pd_linp[i];
+		HeapTupleHeader tupheader;
+
+		/* vacuum removes dead tuples before marking the page all-visible */
+		if (lp->lp_flags == LP_DEAD)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] page is all-visible, but the item is LP_DEAD",
+							block, (i + 1))));
+			++nerrs;
+			continue;
+		}
+
+		if (lp->lp_flags != LP_NORMAL)
+			continue;
+
+		/* items pointing outside the page were already reported */
+		if ((lp->lp_off < SizeOfPageHeaderData) ||
+			(lp->lp_len < SizeofHeapTupleHeader) ||
+			(lp->lp_off + lp->lp_len > BLCKSZ))
+			continue;
+
+		tupheader = (HeapTupleHeader) (buffer + lp->lp_off);
+
+		nerrs += check_all_visible_tuple(xids, tupheader, block, i);
+
+		if (all_frozen)
+			nerrs += check_all_frozen_tuple(rel, tupheader, block, i);
+	}
+
+	return nerrs;
+}
+
+/*
+ * Tuples on all-visible pages have to be inserted by a committed transaction,
+ * and either not deleted at all, or deleted by an aborted transaction (or
+ * only locked).
+ *
+ * We don't look up XIDs older than relfrozenxid (the CLOG may be truncated),
+ * the tuple is already corrupted anyway in that case. The lookups go through
+ * the per-scan cache, as all-visible pages are usually filled by only a few
+ * transactions.
+ */
+static uint32
+check_all_visible_tuple(xid_check * xids, HeapTupleHeader tupheader,
+						BlockNumber block, int i)
+{
+	uint32		nerrs = 0;
+	TransactionId xmin = HeapTupleHeaderGetRawXmin(tupheader);
+	TransactionId xmax = HeapTupleHeaderGetRawXmax(tupheader);
+
+	if (HeapTupleHeaderXminInvalid(tupheader))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] page is all-visible, but xmin %u is marked invalid",
+						block, (i + 1), xmin)));
+		++nerrs;
+	}
+	else if (!HeapTupleHeaderXminCommitted(tupheader) &&
+			 TransactionIdIsNormal(xmin))
+	{
+		if (TransactionIdPrecedes(xmin, xids->relfrozenxid))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] page is all-visible, but xmin %u precedes relfrozenxid %u",
+							block, (i + 1), xmin, xids->relfrozenxid)));
+			++nerrs;
+		}
+		else if (xid_get_status(xids, xmin) != CHECK_XID_COMMITTED)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] page is all-visible, but xmin %u is not committed",
+							block, (i + 1), xmin)));
+			++nerrs;
+		}
+	}
+
+	/* not deleted, or just locked */
+	if ((tupheader->t_infomask & HEAP_XMAX_INVALID) ||
+		!TransactionIdIsValid(xmax) ||
+		HEAP_XMAX_IS_LOCKED_ONLY(tupheader->t_infomask))
+		return nerrs;
+
+	/* deleted (or updated) by a committed transaction */
+	if (tupheader->t_infomask & HEAP_XMAX_COMMITTED)
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] page is all-visible, but the tuple is deleted by xmax %u",
+						block, (i + 1), xmax)));
+		++nerrs;
+	}
+
+	/*
+	 * XXX Updates with multixacts would require looking up the members, so
+	 * we don't check those for now.
+	 */
+	else if (!(tupheader->t_infomask & HEAP_XMAX_IS_MULTI) &&
+			 TransactionIdIsNormal(xmax) &&
+			 !TransactionIdPrecedes(xmax, xids->relfrozenxid) &&
+			 (xid_get_status(xids, xmax) != CHECK_XID_ABORTED))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] page is all-visible, but the tuple is deleted by xmax %u",
+						block, (i + 1), xmax)));
+		++nerrs;
+	}
+
+	return nerrs;
+}
+
+/*
+ * Tuples on all-frozen pages need to have xmin frozen, and there must not
+ * be any xmax (not even a locker), see heap_prepare_freeze_tuple.
+ */
+static uint32
+check_all_frozen_tuple(Relation rel, HeapTupleHeader tupheader,
+					   BlockNumber block, int i)
+{
+	uint32		nerrs = 0;
+	TransactionId xmin = HeapTupleHeaderGetRawXmin(tupheader);
+	TransactionId xmax = HeapTupleHeaderGetRawXmax(tupheader);
+
+	/* before 9.4 freezing replaced the xmin with FrozenTransactionId */
+	if (!HeapTupleHeaderXminFrozen(tupheader) && TransactionIdIsNormal(xmin))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] page is all-frozen, but xmin %u is not frozen",
+						block, (i + 1), xmin)));
+		++nerrs;
+	}
+
+	if (TransactionIdIsValid(xmax))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] page is all-frozen, but xmax %u is set (infomask %u)",
+						block, (i + 1), xmax, tupheader->t_infomask)));
+		++nerrs;
+	}
+
+	return nerrs;
+}
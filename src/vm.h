@@ -0,0 +1,33 @@
+#ifndef VM_CHECK_H
+#define VM_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+#include "access/visibilitymap.h"
+
+#include "xid.h"
+
+/* before 9.6 the visibility map tracked just the all-visible bit */
+#ifndef VISIBILITYMAP_ALL_VISIBLE
+#define VISIBILITYMAP_ALL_VISIBLE	0x01
+#define VISIBILITYMAP_ALL_FROZEN	0x02
+#endif
+
+/* Returns visibility map bits for the heap block (VISIBILITYMAP_ALL_*).
+ *
+ * The vmbuffer is kept pinned between calls (and needs to be released by
+ * the caller at the end), just like with visibilitymap_get_status.
+ */
+uint8		vm_get_status(Relation rel, BlockNumber block, Buffer *vmbuffer);
+
+/* Cross-checks the visibility map bits (as returned by vm_get_status) with
+ * the heap page, i.e. with PD_ALL_VISIBLE and the tuples on the page. The
+ * commit status of XIDs is looked up through the cache in xids.
+ *
+ * Returns number of issues found.
+ */
+uint32		check_visibility_map(Relation rel, PageHeader header, char *buffer,
+								 BlockNumber block, uint8 vmstatus,
+								 xid_check * xids);
+
+#endif							/* VM_CHECK_H */
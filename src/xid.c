@@ -0,0 +1,302 @@
+#include "postgres.h"
+
+#include "access/multixact.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "storage/procarray.h"
+#include "utils/rel.h"
+
+#include "xid.h"
+
+#define XidCacheIndex(xid)		((xid) % XID_CACHE_SIZE)
+#define MultiCacheIndex(multi)	((multi) % MULTI_CACHE_SIZE)
+
+static bool multi_in_range(xid_check * xids, MultiXactId multi);
+static uint32 check_multi_members(xid_check * xids, MultiXactId multi,
+					bool lockonly, BlockNumber block, int offnum);
+
+/* allocate the state, and determine the valid XID ranges */
+xid_check *
+xid_check_init(Relation rel)
+{
+	xid_check  *xids = (xid_check *) palloc0(sizeof(xid_check));
+
+	xids->relfrozenxid = rel->rd_rel->relfrozenxid;
+	xids->relminmxid = rel->rd_rel->relminmxid;
+	xids->nextxid = ReadNewTransactionId();
+	ReadMultiXactIdRange(&xids->oldestmulti, &xids->nextmulti);
+
+	/* InvalidTransactionId (0) is never cached */
+	Assert(InvalidTransactionId == 0);
+
+	return xids;
+}
+
+/* free the state */
+void
+xid_check_free(xid_check * xids)
+{
+	ereport(DEBUG1,
+			(errmsg("XID status lookups: " UINT64_FORMAT ", cache hits: " UINT64_FORMAT,
+					xids->nlookups, xids->nhits)));
+
+	pfree(xids);
+}
+
+/*
+ * Look up status of the transaction, using the cache.
+ *
+ * Tuples on a page are usually inserted by only a handful of transactions
+ * (often just one, e.g. for bulk loads), so even a tiny direct-mapped cache
+ * eliminates most of the CLOG lookups.
+ *
+ * Only final states (committed, aborted) are cached, as running transactions
+ * may finish before the end of the scan.
+ */
+CheckXidStatus
+xid_get_status(xid_check * xids, TransactionId xid)
+{
+	xid_cache_entry *entry = &xids->xids[XidCacheIndex(xid)];
+	CheckXidStatus status;
+
+	Assert(TransactionIdIsNormal(xid));
+
+	xids->nlookups++;
+
+	if (entry->xid == xid)
+	{
+		xids->nhits++;
+		return entry->status;
+	}
+
+	/* same order as in HeapTupleSatisfiesMVCC (see comments in tqual.c) */
+	if (TransactionIdIsCurrentTransactionId(xid) ||
+		TransactionIdIsInProgress(xid))
+		return CHECK_XID_IN_PROGRESS;
+
+	if (TransactionIdDidCommit(xid))
+		status = CHECK_XID_COMMITTED;
+	else
+		status = CHECK_XID_ABORTED;
+
+	entry->xid = xid;
+	entry->status = status;
+
+	return status;
+}
+
+/*
+ * Check the XID is in [relfrozenxid, nextxid). The next XID is read at the
+ * beginning of the scan, so refresh it before claiming the XID is from the
+ * future (new transactions might have modified the table since).
+ */
+bool
+xid_in_range(xid_check * xids, TransactionId xid)
+{
+	if (TransactionIdPrecedes(xid, xids->relfrozenxid))
+		return false;
+
+	if (!TransactionIdPrecedes(xid, xids->nextxid))
+		xids->nextxid = ReadNewTransactionId();
+
+	return TransactionIdPrecedes(xid, xids->nextxid);
+}
+
+/* check the MultiXactId is in [relminmxid, nextmulti) */
+static bool
+multi_in_range(xid_check * xids, MultiXactId multi)
+{
+	if (MultiXactIdPrecedes(multi, xids->relminmxid))
+		return false;
+
+	if (!MultiXactIdPrecedes(multi, xids->nextmulti))
+		xids->nextmulti = ReadNextMultiXactId();
+
+	return MultiXactIdPrecedes(multi, xids->nextmulti);
+}
+
+/*
+ * check_tuple_xids
+ *		Check XIDs of the tuple are sane.
+ *
+ * Tuples with XIDs older than relfrozenxid (or MultiXactIds older than
+ * relminmxid) may become visible/invisible after the CLOG gets truncated
+ * (or on XID wraparound). XIDs from the future are clearly bogus too.
+ *
+ * We only look up the commit status when a hint bit is set, as otherwise
+ * there's nothing to contradict (and the lookups are not free).
+ */
+uint32
+check_tuple_xids(xid_check * xids, HeapTupleHeader tupheader,
+				 BlockNumber block, int offnum)
+{
+	uint32		nerrs = 0;
+	uint16		infomask = tupheader->t_infomask;
+	TransactionId xmin = HeapTupleHeaderGetRawXmin(tupheader);
+	TransactionId xmax = HeapTupleHeaderGetRawXmax(tupheader);
+
+	/* xmin (frozen tuples may keep the original XID, but it's irrelevant) */
+	if (HeapTupleHeaderXminFrozen(tupheader))
+		;
+	else if (!TransactionIdIsValid(xmin))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] xmin is invalid", block, offnum)));
+		++nerrs;
+	}
+	else if (!TransactionIdIsNormal(xmin))
+		;						/* bootstrap/frozen XID */
+	else if (!xid_in_range(xids, xmin))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] xmin %u not within [relfrozenxid %u, next XID %u)",
+						block, offnum, xmin, xids->relfrozenxid, xids->nextxid)));
+		++nerrs;
+	}
+	else if (infomask & (HEAP_XMIN_COMMITTED | HEAP_XMIN_INVALID))
+	{
+		CheckXidStatus status = xid_get_status(xids, xmin);
+
+		if ((infomask & HEAP_XMIN_COMMITTED) && (status != CHECK_XID_COMMITTED))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] xmin %u marked as committed, but it's %s",
+							block, offnum, xmin,
+							(status == CHECK_XID_ABORTED) ? "aborted" : "in progress")));
+			++nerrs;
+		}
+		else if ((infomask & HEAP_XMIN_INVALID) && (status != CHECK_XID_ABORTED))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] xmin %u marked as invalid, but it's %s",
+							block, offnum, xmin,
+							(status == CHECK_XID_COMMITTED) ? "committed" : "in progress")));
+			++nerrs;
+		}
+	}
+
+	/* xmax */
+	if (infomask & HEAP_XMAX_IS_MULTI)
+	{
+		/* multixacts are never marked as committed */
+		if (infomask & HEAP_XMAX_COMMITTED)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] xmax %u is a multixact, but marked as committed",
+							block, offnum, xmax)));
+			++nerrs;
+		}
+
+		/* once marked invalid, the multixact may be long gone */
+		if (infomask & HEAP_XMAX_INVALID)
+			;
+		else if (!MultiXactIdIsValid(xmax))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] xmax is an invalid multixact", block, offnum)));
+			++nerrs;
+		}
+		else if (!multi_in_range(xids, xmax))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] xmax multixact %u not within [relminmxid %u, next multixact %u)",
+							block, offnum, xmax, xids->relminmxid, xids->nextmulti)));
+			++nerrs;
+		}
+		else
+			nerrs += check_multi_members(xids, xmax,
+										 HEAP_XMAX_IS_LOCKED_ONLY(infomask),
+										 block, offnum);
+	}
+	else if (!TransactionIdIsValid(xmax) || (infomask & HEAP_XMAX_INVALID))
+		;						/* no xmax, or aborted (may be very old) */
+	else if (!TransactionIdIsNormal(xmax))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] xmax %u is not a normal XID", block, offnum, xmax)));
+		++nerrs;
+	}
+	else if (!xid_in_range(xids, xmax))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] xmax %u not within [relfrozenxid %u, next XID %u)",
+						block, offnum, xmax, xids->relfrozenxid, xids->nextxid)));
+		++nerrs;
+	}
+	else if (infomask & HEAP_XMAX_COMMITTED)
+	{
+		CheckXidStatus status = xid_get_status(xids, xmax);
+
+		if (status != CHECK_XID_COMMITTED)
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] xmax %u marked as committed, but it's %s",
+							block, offnum, xmax,
+							(status == CHECK_XID_ABORTED) ? "aborted" : "in progress")));
+			++nerrs;
+		}
+	}
+
+	return nerrs;
+}
+
+/*
+ * Check that members of the multixact are within the valid XID range.
+ *
+ * Rows locked by many sessions (e.g. foreign keys to a popular row) share
+ * the same multixact, so cache the result of the check.
+ */
+static uint32
+check_multi_members(xid_check * xids, MultiXactId multi, bool lockonly,
+					BlockNumber block, int offnum)
+{
+	multi_cache_entry *entry = &xids->multis[MultiCacheIndex(multi)];
+	MultiXactMember *members;
+	int			nmembers;
+	int			i;
+	uint32		nerrs = 0;
+
+	if (entry->multi == multi)
+		return entry->nerrs;
+
+	/*
+	 * GetMultiXactIdMembers fails with an ERROR for multixacts that were
+	 * already truncated away or were not created yet, which would abort the
+	 * whole check. The caller checked relminmxid, but that comes from the
+	 * (possibly corrupted) catalog, so re-read the actual range right before
+	 * the lookup. Not cached, so that we report it for each tuple.
+	 */
+	ReadMultiXactIdRange(&xids->oldestmulti, &xids->nextmulti);
+
+	if (MultiXactIdPrecedes(multi, xids->oldestmulti) ||
+		!MultiXactIdPrecedes(multi, xids->nextmulti))
+	{
+		ereport(WARNING,
+				(errmsg("[%d:%d] multixact %u not within [oldest multixact %u, next multixact %u)",
+						block, offnum, multi, xids->oldestmulti, xids->nextmulti)));
+		return 1;
+	}
+
+	nmembers = GetMultiXactIdMembers(multi, &members, false, lockonly);
+
+	for (i = 0; i < nmembers; i++)
+	{
+		if (!TransactionIdIsNormal(members[i].xid) ||
+			!xid_in_range(xids, members[i].xid))
+		{
+			ereport(WARNING,
+					(errmsg("[%d:%d] multixact %u member %u not within [relfrozenxid %u, next XID %u)",
+							block, offnum, multi, members[i].xid,
+							xids->relfrozenxid, xids->nextxid)));
+			++nerrs;
+		}
+	}
+
+	if (nmembers > 0)
+		pfree(members);
+
+	entry->multi = multi;
+	entry->nerrs = nerrs;
+
+	return nerrs;
+}
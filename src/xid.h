@@ -0,0 +1,80 @@
+#ifndef XID_CHECK_H
+#define XID_CHECK_H
+
+#include "postgres.h"
+#include "access/heapam.h"
+#include "access/htup.h"
+#if (PG_VERSION_NUM >= 90300)
+#include "access/htup_details.h"
+#endif
+
+/* number of cached XID / MultiXactId lookups (direct-mapped) */
+#define XID_CACHE_SIZE		4096
+#define MULTI_CACHE_SIZE	1024
+
+/* status of a transaction, as seen by the checks */
+typedef enum
+{
+	CHECK_XID_IN_PROGRESS,		/* running (or our own) transaction */
+	CHECK_XID_COMMITTED,
+	CHECK_XID_ABORTED			/* aborted or crashed */
+}			CheckXidStatus;
+
+/* cached status of a transaction (only for committed/aborted ones) */
+typedef struct xid_cache_entry
+{
+	TransactionId xid;
+	CheckXidStatus status;
+}			xid_cache_entry;
+
+/* cached result of checking members of a multixact */
+typedef struct multi_cache_entry
+{
+	MultiXactId multi;
+	uint32		nerrs;
+}			multi_cache_entry;
+
+/* per-scan state for the XID checks, with cached lookups */
+typedef struct xid_check
+{
+	/* limits for XIDs / MultiXactIds in the relation */
+	TransactionId relfrozenxid;
+	MultiXactId relminmxid;
+	TransactionId nextxid;		/* refreshed when needed */
+	MultiXactId nextmulti;		/* refreshed when needed */
+	MultiXactId oldestmulti;	/* oldest multixact not truncated yet */
+
+	xid_cache_entry xids[XID_CACHE_SIZE];
+	multi_cache_entry multis[MULTI_CACHE_SIZE];
+
+	/* statistics */
+	uint64		nhits;
+	uint64		nlookups;
+}			xid_check;
+
+/* Allocates the XID check state for a relation. */
+xid_check  *xid_check_init(Relation rel);
+
+/* Releases the state (and reports cache statistics in debug output). */
+void		xid_check_free(xid_check * xids);
+
+/* Returns status of a transaction, using the per-scan cache.
+ *
+ * The caller has to make sure the XID is not older than relfrozenxid, as
+ * the CLOG for such transactions might be truncated already.
+ */
+CheckXidStatus xid_get_status(xid_check * xids, TransactionId xid);
+
+/* Is the XID within the range [relfrozenxid, nextxid) of the relation? */
+bool		xid_in_range(xid_check * xids, TransactionId xid);
+
+/* Checks xmin/xmax of a tuple - that the XIDs (and MultiXactIds) are
+ * within the valid range for the relation, and that the hint bits do not
+ * contradict the commit status.
+ *
+ * Returns number of issues found.
+ */
+uint32		check_tuple_xids(xid_check * xids, HeapTupleHeader tupheader,
+							 BlockNumber block, int offnum);
+
+#endif							/* XID_CHECK_H */
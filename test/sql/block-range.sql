@@ -0,0 +1,41 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    val     INT
+);
+
+INSERT INTO test_table SELECT i, mod(i, 100) FROM generate_series(1,100000) s(i);
+
+CREATE INDEX test_table_val_idx ON test_table (val);
+CREATE INDEX test_table_partial_idx ON test_table (id) WHERE val < 10;
+
+-- cross-check ranges of blocks (the last one extends past the end)
+SELECT pg_check_table('test_table', true, true, 0, 10);
+SELECT pg_check_table('test_table', true, true, 100, 200);
+SELECT pg_check_table('test_table', true, true, 400, 1000000);
+
+-- the whole table in chunks
+SELECT sum(pg_check_table('test_table', true, true, b, b + 100)) AS errors
+  FROM generate_series(0, 500, 100) b;
+
+-- fingerprints and online mode
+SET pg_check.cross_check_method = fingerprint;
+SELECT pg_check_table('test_table', true, true, 50, 150);
+RESET pg_check.cross_check_method;
+
+SELECT pg_check_table('test_table', true, true, 50, 150, online := true);
+
+-- range with deleted and updated rows
+DELETE FROM test_table WHERE id BETWEEN 10000 AND 20000;
+UPDATE test_table SET val = val + 1 WHERE id BETWEEN 30000 AND 40000;
+
+SELECT pg_check_table('test_table', true, true, 40, 200);
+
+DROP TABLE test_table;
+
+ROLLBACK;
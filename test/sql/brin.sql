@@ -0,0 +1,28 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     INT,
+    ts      TIMESTAMP
+);
+
+INSERT INTO test_table SELECT i, mod(i, 1000), '2020-01-01'::timestamp + i * interval '1 minute' FROM generate_series(1,100000) s(i);
+
+CREATE INDEX test_table_id_index ON test_table USING brin (id) WITH (pages_per_range = 16);
+CREATE INDEX test_table_ts_index ON test_table USING brin (ts, (val + 1));
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+SELECT pg_check_index('test_table_id_index');
+
+-- updates widen the summaries (new tuples may be in unsummarized ranges)
+UPDATE test_table SET id = -id WHERE mod(id, 1000) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
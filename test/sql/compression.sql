@@ -0,0 +1,35 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET pg_check.check_toast = on;
+SET pg_check.check_compression = on;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    val     TEXT
+);
+
+-- compressed inline (very repetitive)
+INSERT INTO test_table SELECT i, repeat(md5(i::text), 100 + mod(i, 100)) FROM generate_series(1,1000) s(i);
+
+-- compressed and TOASTed (repetitive, but still too large to fit inline)
+INSERT INTO test_table SELECT i, repeat((SELECT string_agg(md5((i + j)::text), '') FROM generate_series(1,100) s(j)), 10)
+  FROM generate_series(1001,1100) s(i);
+
+-- not compressed at all
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1101,2000) s(i);
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+-- updates not modifying the TOASTed column reuse the TOAST pointer
+UPDATE test_table SET id = -id;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
@@ -0,0 +1,49 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET pg_check.check_datums = on;
+SET pg_check.check_compression = on;
+
+SET client_min_messages = warning;
+
+CREATE DOMAIN test_domain AS NUMERIC(10,2);
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    n       NUMERIC,
+    d       test_domain,
+    a       INT[],
+    t       TEXT[],
+    j       JSONB,
+    r1      INT4RANGE,
+    r2      NUMRANGE,
+    r3      TSTZRANGE
+);
+
+-- all kinds of values (including NULLs, empty arrays and ranges, special values)
+INSERT INTO test_table SELECT
+    i,
+    (CASE mod(i, 5) WHEN 0 THEN NULL WHEN 1 THEN 'NaN'::numeric WHEN 2 THEN 0 ELSE (i * 12345.6789 - 1000000) END),
+    (i / 7.0)::numeric(10,2),
+    (CASE mod(i, 4) WHEN 0 THEN '{}'::int[] WHEN 1 THEN ARRAY[i, NULL, i + 1] WHEN 2 THEN ARRAY[[i, i], [i, i]] ELSE (SELECT array_agg(k) FROM generate_series(1, mod(i, 500)) s(k)) END),
+    (CASE mod(i, 3) WHEN 0 THEN ARRAY['a', NULL, md5(i::text)] WHEN 1 THEN ARRAY[repeat(md5(i::text), 50)] ELSE '{}'::text[] END),
+    (CASE mod(i, 4) WHEN 0 THEN '1'::jsonb WHEN 1 THEN '"abc"'::jsonb WHEN 2 THEN '[1, 2.5, null, true, false, "x", {"a": [1, {"b": 2}]}]'::jsonb
+                    ELSE jsonb_build_object('id', i, 'val', md5(i::text), 'n', i / 3.0, 'nested', jsonb_build_object('x', NULL, 'y', ARRAY[1,2,3])) END),
+    (CASE mod(i, 3) WHEN 0 THEN 'empty'::int4range WHEN 1 THEN int4range(i, i + 10) ELSE int4range(NULL, i) END),
+    (CASE mod(i, 3) WHEN 0 THEN numrange(i / 3.0, i / 2.0, '[]') WHEN 1 THEN numrange(NULL, NULL) ELSE numrange(i * 1000000.001, NULL) END),
+    tstzrange('2020-01-01'::timestamptz + i * interval '1 hour', '2021-01-01'::timestamptz + i * interval '1 hour')
+  FROM generate_series(1,2000) s(i);
+
+SELECT pg_check_table('test_table', false, false);
+
+-- updates (some values get compressed)
+UPDATE test_table SET j = jsonb_build_object('data', (SELECT jsonb_agg(k) FROM generate_series(1, 1000) s(k))) WHERE mod(id, 100) = 0;
+UPDATE test_table SET n = -n WHERE mod(id, 7) = 0;
+
+SELECT pg_check_table('test_table', true, false);
+
+DROP TABLE test_table;
+DROP DOMAIN test_domain;
+
+ROLLBACK;
@@ -29,3 +29,33 @@ SELECT pg_check_table('test_table', true, true);
 DROP TABLE test_table;
 
 ROLLBACK;
+
+-- entries killed by index scans are still expected (the heap items can't
+-- be removed before the index entries), killing them needs committed deletes
+CREATE EXTENSION pg_check;
+
+CREATE TABLE test_killed (
+    id      INT
+);
+
+INSERT INTO test_killed SELECT i FROM generate_series(1,10000) s(i);
+
+CREATE INDEX test_killed_index ON test_killed (id);
+
+DELETE FROM test_killed WHERE mod(id, 10) = 0;
+
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SET enable_indexonlyscan = off;
+
+SELECT count(*) FROM test_killed WHERE id > 0;
+
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+RESET enable_indexonlyscan;
+
+SELECT pg_check_table('test_killed', true, true);
+
+DROP TABLE test_killed;
+
+DROP EXTENSION pg_check;
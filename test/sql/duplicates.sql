@@ -0,0 +1,35 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    status  INT,
+    val     TEXT
+);
+
+-- low-cardinality columns (many index entries with the same key)
+INSERT INTO test_table SELECT i, mod(i, 5), md5(mod(i, 100)::text) FROM generate_series(1,100000) s(i);
+
+CREATE INDEX test_table_status_index ON test_table (status);
+CREATE INDEX test_table_val_index ON test_table (val);
+
+SELECT pg_check_table('test_table', true, true);
+
+SELECT pg_check_index('test_table_status_index');
+
+-- more duplicates, inserted after the index was built
+INSERT INTO test_table SELECT i, mod(i, 5), md5(mod(i, 100)::text) FROM generate_series(1,20000) s(i);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- deleted rows keep their index entries
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
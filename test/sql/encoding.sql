@@ -0,0 +1,42 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET pg_check.check_encoding = on;
+SET pg_check.check_compression = on;
+
+SET client_min_messages = warning;
+
+CREATE DOMAIN test_domain AS VARCHAR(100);
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    a       TEXT,
+    b       VARCHAR(200),
+    c       CHAR(10),
+    d       NAME,
+    e       test_domain,
+    f       BYTEA
+);
+
+-- short values, long values (compressed inline) and NULLs
+INSERT INTO test_table SELECT i, md5(i::text), repeat('x', mod(i, 200)), 'abc', 'name_' || i,
+                              (CASE WHEN mod(i, 3) = 0 THEN NULL ELSE i::text END), '\x00ff'::bytea
+  FROM generate_series(1,1000) s(i);
+
+INSERT INTO test_table SELECT i, repeat(md5(i::text), 100), NULL, NULL, NULL, NULL, NULL
+  FROM generate_series(1001,1100) s(i);
+
+SELECT pg_check_table('test_table', false, false);
+
+-- non-ASCII characters (if the database encoding supports them)
+INSERT INTO test_table SELECT i, repeat(convert_from('\xc5be'::bytea, 'UTF8') || md5(i::text), mod(i, 100))
+  FROM generate_series(2001,2100) s(i)
+ WHERE getdatabaseencoding() = 'UTF8';
+
+SELECT pg_check_table('test_table', true, false);
+
+DROP TABLE test_table;
+DROP DOMAIN test_domain;
+
+ROLLBACK;
@@ -0,0 +1,44 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+SET pg_check.cross_check_method = fingerprint;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT,
+    tags    INT[]
+);
+
+INSERT INTO test_table SELECT i, md5(i::text), ARRAY[mod(i, 10), i] FROM generate_series(1,50000) s(i);
+
+CREATE INDEX test_table_id_index ON test_table (id);
+CREATE INDEX test_table_val_index ON test_table (val);
+CREATE INDEX test_table_tags_index ON test_table USING gin (tags);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- HOT and non-HOT updates
+UPDATE test_table SET tags = ARRAY[i] FROM generate_series(1,1000) s(i) WHERE id = i;
+UPDATE test_table SET val = md5(val) WHERE mod(id, 100) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+-- deleted rows keep their index entries
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+-- rows with multiple GIN keys, and hash tuples moved by bucket splits (kept
+-- in the old buckets until cleanup) reference the same TID repeatedly
+CREATE INDEX test_table_id_hash_index ON test_table USING hash (id);
+INSERT INTO test_table SELECT i, md5(i::text), ARRAY[mod(i, 10), i, -i] FROM generate_series(50001,100000) s(i);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- the online cross-check needs bitmaps
+SELECT pg_check_table('test_table', true, true, online := true);
+
+ROLLBACK;
@@ -0,0 +1,68 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    tags    INT[],
+    doc     TSVECTOR
+);
+
+-- some keys are frequent enough to get a posting tree, some rows are NULL
+INSERT INTO test_table SELECT i, ARRAY[mod(i, 10), mod(i, 1000), i], to_tsvector('simple', md5(mod(i, 100)::text)) FROM generate_series(1,100000) s(i);
+INSERT INTO test_table SELECT i, NULL, NULL FROM generate_series(1,1000) s(i);
+
+CREATE INDEX test_table_tags_index ON test_table USING gin (tags);
+CREATE INDEX test_table_doc_index ON test_table USING gin (doc);
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+SELECT pg_check_index('test_table_tags_index');
+
+-- tuples in the pending list
+ALTER INDEX test_table_tags_index SET (fastupdate = on);
+INSERT INTO test_table SELECT i, ARRAY[i, -i] FROM generate_series(1,1000) s(i);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- deleted rows keep their index entries
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
+
+-- entries of deleted rows in the pending list, and then removed by VACUUM
+-- (from the pending list, posting lists and posting trees, followed by the
+-- heap items), which needs committed deletes
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_vacuum (
+    id      INT,
+    tags    INT[]
+) WITH (autovacuum_enabled = off);
+
+INSERT INTO test_vacuum SELECT i, ARRAY[mod(i, 10), i] FROM generate_series(1,10000) s(i);
+
+CREATE INDEX test_vacuum_index ON test_vacuum USING gin (tags) WITH (fastupdate = on);
+
+INSERT INTO test_vacuum SELECT i, ARRAY[mod(i, 10), i] FROM generate_series(10001,11000) s(i);
+
+DELETE FROM test_vacuum WHERE mod(id, 3) = 0;
+
+SELECT pg_check_table('test_vacuum', true, true);
+
+VACUUM test_vacuum;
+
+SELECT pg_check_table('test_vacuum', true, true);
+
+DROP TABLE test_vacuum;
+
+DROP EXTENSION pg_check;
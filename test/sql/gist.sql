@@ -0,0 +1,89 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    pt      POINT,
+    span    INT4RANGE,
+    val     TEXT
+);
+
+-- some rows are NULL (GiST and SP-GiST index those too)
+INSERT INTO test_table SELECT i, point(mod(i, 317), mod(i, 1013)), int4range(i, i + mod(i, 100)), md5(mod(i, 1000)::text) FROM generate_series(1,50000) s(i);
+INSERT INTO test_table SELECT i, NULL, NULL, NULL FROM generate_series(1,1000) s(i);
+
+CREATE INDEX test_table_pt_index ON test_table USING gist (pt);
+CREATE INDEX test_table_span_index ON test_table USING gist (span);
+CREATE INDEX test_table_pt_spgist_index ON test_table USING spgist (pt);
+CREATE INDEX test_table_val_index ON test_table USING spgist (val);
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+SELECT pg_check_index('test_table_pt_index');
+SELECT pg_check_index('test_table_val_index');
+
+-- page splits after the index was built
+INSERT INTO test_table SELECT i, point(i, -i), int4range(-i, i), md5(i::text) FROM generate_series(1,20000) s(i);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- deleted rows keep their index entries
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
+
+-- entries killed by index scans are still expected (the heap items can't
+-- be removed before the index entries), killing them needs committed deletes
+CREATE EXTENSION pg_check;
+
+CREATE TABLE test_killed (
+    id      INT,
+    pt      POINT
+);
+
+INSERT INTO test_killed SELECT i, point(mod(i, 100), i / 100) FROM generate_series(1,10000) s(i);
+
+CREATE INDEX test_killed_index ON test_killed USING gist (pt);
+
+DELETE FROM test_killed WHERE mod(id, 10) = 0;
+
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+
+SELECT count(*) FROM test_killed WHERE pt <@ box '((0,0),(100,100))';
+
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+
+SELECT pg_check_table('test_killed', true, true);
+
+DROP TABLE test_killed;
+
+-- VACUUM replaces removed SP-GiST leaf tuples with placeholder and dead
+-- tuples (the heap items are removed after that)
+CREATE TABLE test_vacuum (
+    id      INT,
+    pt      POINT
+) WITH (autovacuum_enabled = off);
+
+INSERT INTO test_vacuum SELECT i, point(mod(i, 100), i / 100) FROM generate_series(1,10000) s(i);
+
+CREATE INDEX test_vacuum_index ON test_vacuum USING spgist (pt);
+
+DELETE FROM test_vacuum WHERE mod(id, 3) > 0;
+
+VACUUM test_vacuum;
+
+SELECT pg_check_table('test_vacuum', true, true);
+
+DROP TABLE test_vacuum;
+
+DROP EXTENSION pg_check;
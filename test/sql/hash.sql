@@ -0,0 +1,91 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT
+);
+
+-- enough rows to split buckets, some keys with many duplicates (overflow pages)
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,50000) s(i);
+INSERT INTO test_table SELECT i, 'duplicate' FROM generate_series(1,5000) s(i);
+
+CREATE INDEX test_table_id_index ON test_table USING hash (id);
+CREATE INDEX test_table_val_index ON test_table USING hash (val);
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+SELECT pg_check_index('test_table_val_index');
+
+-- splits after the index was built
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(50001,100000) s(i);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- deleted rows keep their index entries
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+-- NULL keys are not stored in hash indexes
+INSERT INTO test_table SELECT NULL, NULL FROM generate_series(1,1000) s(i);
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+-- rows with a NULL key when the index was built, but not anymore (the
+-- function is not really immutable), are missing in the index
+SET pg_check_test.nulls = on;
+
+CREATE FUNCTION test_key(INT) RETURNS INT AS $$
+    SELECT CASE WHEN current_setting('pg_check_test.nulls')::bool THEN NULL ELSE $1 END
+$$ LANGUAGE sql IMMUTABLE;
+
+CREATE TABLE test_nulls (
+    id      INT
+);
+
+INSERT INTO test_nulls SELECT i FROM generate_series(1,3) s(i);
+
+CREATE INDEX test_nulls_index ON test_nulls USING hash (test_key(id));
+
+SET pg_check_test.nulls = off;
+
+SELECT pg_check_table('test_nulls', true, true);
+
+DROP TABLE test_nulls;
+
+ROLLBACK;
+
+-- entries killed by index scans are still expected (the heap items can't
+-- be removed before the index entries), killing them needs committed deletes
+CREATE EXTENSION pg_check;
+
+CREATE TABLE test_killed (
+    id      INT
+);
+
+INSERT INTO test_killed SELECT i FROM generate_series(1,10000) s(i);
+
+CREATE INDEX test_killed_index ON test_killed USING hash (id);
+
+DELETE FROM test_killed WHERE mod(id, 10) = 0;
+
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+
+DO $$ BEGIN FOR i IN 1..10000 LOOP PERFORM * FROM test_killed WHERE id = i; END LOOP; END $$;
+
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+
+SELECT pg_check_table('test_killed', true, true);
+
+DROP TABLE test_killed;
+
+DROP EXTENSION pg_check;
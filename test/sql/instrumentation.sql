@@ -0,0 +1,42 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    val     TEXT
+);
+
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,10000) s(i);
+
+-- nothing collected yet
+SELECT pg_check_instrumentation() IS NULL AS empty;
+
+SET pg_check.instrument = on;
+
+SELECT pg_check_table('test_table', true, true);
+
+SELECT heap_pages > 0 AS heap, index_pages > 0 AS index,
+       buffer_hits + buffer_reads >= heap_pages + index_pages AS buffers,
+       bytes_read = buffer_reads * current_setting('block_size')::int AS bytes,
+       bitmap_bytes > 0 AS bitmap, heap_time >= 0 AS time
+  FROM pg_check_instrumentation();
+
+-- index check (no heap pages, no bitmaps)
+SELECT pg_check_index('test_table_pkey');
+
+SELECT heap_pages = 0 AS heap, index_pages > 0 AS index, bitmap_bytes = 0 AS bitmap
+  FROM pg_check_instrumentation();
+
+-- a check without instrumentation discards results of the earlier one
+SET pg_check.instrument = off;
+
+SELECT pg_check_index('test_table_pkey');
+
+SELECT pg_check_instrumentation() IS NULL AS empty;
+
+DROP TABLE test_table;
+
+ROLLBACK;
@@ -0,0 +1,35 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT
+);
+
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,50000) s(i);
+
+CREATE INDEX test_table_id_index ON test_table (id);
+CREATE INDEX test_table_val_index ON test_table (val) WHERE mod(id, 3) = 0;
+
+SELECT pg_check_table('test_table', true, true, online := true);
+
+-- updated and deleted rows (by our own transaction)
+UPDATE test_table SET id = id + 1 WHERE mod(id, 7) = 0;
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true, online := true);
+
+-- rows inserted by an aborted subtransaction (the index entries remain)
+SAVEPOINT s;
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,1000) s(i);
+ROLLBACK TO SAVEPOINT s;
+
+SELECT pg_check_table('test_table', true, true, online := true);
+
+-- online mode only makes a difference for the cross-check
+SELECT pg_check_table('test_table', true, false, online := true);
+
+ROLLBACK;
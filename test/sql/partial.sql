@@ -0,0 +1,88 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT,
+    tags    INT[]
+);
+
+INSERT INTO test_table SELECT i, md5(i::text), ARRAY[mod(i, 10), i] FROM generate_series(1,50000) s(i);
+
+CREATE INDEX test_table_id_index ON test_table (id) WHERE mod(id, 3) = 0;
+CREATE INDEX test_table_val_index ON test_table (upper(val)) WHERE id > 10000;
+CREATE INDEX test_table_tags_index ON test_table USING gin (tags) WHERE mod(id, 2) = 1;
+CREATE INDEX test_table_expr_index ON test_table (lower(val));
+
+SELECT pg_check_table('test_table', true, true);
+
+-- rows moving in and out of the partial indexes (HOT and non-HOT)
+UPDATE test_table SET id = id + 1 WHERE mod(id, 7) = 0;
+UPDATE test_table SET tags = ARRAY[id] WHERE mod(id, 11) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+-- deleted rows keep their index entries
+DELETE FROM test_table WHERE mod(id, 10) = 0;
+
+SELECT pg_check_table('test_table', true, true);
+
+-- the same with fingerprints
+SET pg_check.cross_check_method = fingerprint;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+RESET pg_check.cross_check_method;
+
+-- rows not matching the predicate when the index was built, but matching
+-- it now (the function is not really immutable), are missing in the index
+SET pg_check_test.stale = off;
+
+CREATE FUNCTION test_pred(INT) RETURNS BOOL AS $$
+    SELECT $1 > 3 OR current_setting('pg_check_test.stale')::bool
+$$ LANGUAGE sql IMMUTABLE;
+
+CREATE TABLE test_stale (
+    id      INT
+);
+
+INSERT INTO test_stale SELECT i FROM generate_series(1,100) s(i);
+
+CREATE INDEX test_stale_index ON test_stale (id) WHERE test_pred(id);
+
+SET pg_check_test.stale = on;
+
+SELECT pg_check_table('test_stale', true, true);
+
+DROP TABLE test_stale;
+
+ROLLBACK;
+
+-- the predicate is only evaluated on live tuples (values of dead tuples may
+-- be vacuumed from TOAST already), which needs committed deletes and aborts
+CREATE EXTENSION pg_check;
+
+CREATE TABLE test_dead (
+    id      INT
+) WITH (autovacuum_enabled = off);
+
+INSERT INTO test_dead SELECT i FROM generate_series(1,10000) s(i);
+
+CREATE INDEX test_dead_index ON test_dead (id) WHERE mod(id, 3) = 0;
+
+DELETE FROM test_dead WHERE mod(id, 2) = 0;
+
+BEGIN;
+INSERT INTO test_dead SELECT i FROM generate_series(1,1000) s(i);
+ROLLBACK;
+
+SELECT pg_check_table('test_dead', true, true);
+
+DROP TABLE test_dead;
+
+DROP EXTENSION pg_check;
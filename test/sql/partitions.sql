@@ -0,0 +1,47 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+-- the index check notices include names of TOAST relations (with OIDs),
+-- and with parallel workers the partitions are checked in random order
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT
+) PARTITION BY RANGE (id);
+
+CREATE TABLE test_table_1 PARTITION OF test_table FOR VALUES FROM (0) TO (10000);
+CREATE TABLE test_table_2 PARTITION OF test_table FOR VALUES FROM (10000) TO (50000);
+CREATE TABLE test_table_3 PARTITION OF test_table FOR VALUES FROM (50000) TO (100000) PARTITION BY LIST ((mod(id, 2)));
+CREATE TABLE test_table_3_a PARTITION OF test_table_3 FOR VALUES IN (0);
+CREATE TABLE test_table_3_b PARTITION OF test_table_3 FOR VALUES IN (1);
+
+-- indexes on partitioned tables need 11+, so create them on each partition
+CREATE INDEX test_table_1_id_index ON test_table_1 (id);
+CREATE INDEX test_table_2_id_index ON test_table_2 (id);
+CREATE INDEX test_table_3_a_id_index ON test_table_3_a (id);
+CREATE INDEX test_table_3_b_id_index ON test_table_3_b (id);
+
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(0,99999) s(i);
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+-- per-partition results
+SELECT partition, errors FROM pg_check_partitions('test_table', true, true) ORDER BY 1::text;
+
+-- without parallel workers
+SET pg_check.max_parallel_workers = 0;
+
+SELECT partition, errors FROM pg_check_partitions('test_table', true, false) ORDER BY 1::text;
+
+-- block ranges apply to a single table, not to all the partitions
+SAVEPOINT s;
+SELECT pg_check_table('test_table', true, true, 0, 100);
+ROLLBACK TO SAVEPOINT s;
+
+-- per-partition results need a partitioned table
+SELECT partition, errors FROM pg_check_partitions('test_table_1', true, true);
+
+ROLLBACK;
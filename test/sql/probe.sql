@@ -0,0 +1,43 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET client_min_messages = warning;
+
+SET pg_check.cross_check_method = probe;
+
+-- look up all the tuples (the results need to be stable)
+SET pg_check.probe_sample_rate = 1.0;
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    a       INT,
+    b       TEXT,
+    c       INT
+);
+
+INSERT INTO test_table SELECT i, mod(i, 100), md5(i::text), (CASE WHEN mod(i, 7) = 0 THEN NULL ELSE mod(i, 13) END)
+  FROM generate_series(1,10000) s(i);
+
+-- expression, partial, multi-column (with NULLs and DESC) and hash indexes
+CREATE INDEX test_table_a_idx ON test_table (a);
+CREATE INDEX test_table_expr_idx ON test_table (lower(b));
+CREATE INDEX test_table_partial_idx ON test_table (id) WHERE a < 10;
+CREATE INDEX test_table_multi_idx ON test_table (c DESC NULLS LAST, a, b);
+CREATE INDEX test_table_hash_idx ON test_table USING hash (a);
+
+SELECT pg_check_table('test_table', true, true);
+
+-- sampling blocks is fine with probes
+SELECT pg_check_table('test_table', true, true, sample_fraction := 0.5);
+
+-- deleted and updated rows (HOT and non-HOT)
+DELETE FROM test_table WHERE id BETWEEN 1000 AND 2000;
+UPDATE test_table SET c = c + 1 WHERE id BETWEEN 3000 AND 4000;
+UPDATE test_table SET a = a + 1 WHERE id BETWEEN 5000 AND 6000;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
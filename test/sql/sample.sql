@@ -0,0 +1,23 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+-- the estimates include block counts
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    val     TEXT
+);
+
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,100000) s(i);
+
+SELECT pg_check_table('test_table', false, false, sample_fraction := 0.1);
+SELECT pg_check_table('test_table', true, false, sample_blocks := 10);
+SELECT pg_check_index('test_table_pkey', sample_fraction := 0.5);
+SELECT pg_check_index('test_table_pkey', sample_blocks := 1000000);
+
+-- sampling can't be combined with cross-check
+SELECT pg_check_table('test_table', true, true, sample_blocks := 10);
+
+ROLLBACK;
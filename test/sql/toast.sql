@@ -0,0 +1,30 @@
+BEGIN;
+
+CREATE EXTENSION pg_check;
+
+SET pg_check.check_toast = on;
+
+-- the index check notices include names of TOAST relations (with OIDs)
+SET client_min_messages = warning;
+
+CREATE TABLE test_table (
+    id      INT PRIMARY KEY,
+    val     TEXT
+);
+
+-- no compression, so that the values get TOASTed (multiple chunks)
+ALTER TABLE test_table ALTER COLUMN val SET STORAGE EXTERNAL;
+
+INSERT INTO test_table SELECT i, repeat(md5(i::text), 100 + mod(i, 300)) FROM generate_series(1,1000) s(i);
+
+SELECT pg_check_table('test_table', false, false);
+SELECT pg_check_table('test_table', true, true);
+
+-- updates not modifying the TOASTed column reuse the TOAST pointer
+UPDATE test_table SET id = -id;
+
+SELECT pg_check_table('test_table', true, true);
+
+DROP TABLE test_table;
+
+ROLLBACK;
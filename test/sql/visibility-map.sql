@@ -0,0 +1,31 @@
+-- VACUUM can't run in a transaction block
+CREATE EXTENSION pg_check;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT
+);
+
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,10000) s(i);
+
+-- all pages all-visible
+VACUUM test_table;
+
+SELECT pg_check_table('test_table', false, false);
+
+-- all pages all-frozen
+VACUUM FREEZE test_table;
+
+SELECT pg_check_table('test_table', false, false);
+
+-- quick mode (all-frozen pages checked only partially)
+SELECT pg_check_table('test_table', quick := true);
+
+-- some of the pages no longer all-visible
+DELETE FROM test_table WHERE MOD(id, 100) = 0;
+
+SELECT pg_check_table('test_table', false, false);
+
+DROP TABLE test_table;
+
+DROP EXTENSION pg_check;
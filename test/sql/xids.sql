@@ -0,0 +1,37 @@
+CREATE EXTENSION pg_check;
+
+SET pg_check.check_xids = on;
+
+CREATE TABLE test_table (
+    id      INT,
+    val     TEXT
+);
+
+INSERT INTO test_table SELECT i, md5(i::text) FROM generate_series(1,1000) s(i);
+
+-- committed tuples, with hint bits set by the scan
+SELECT COUNT(*) FROM test_table;
+SELECT pg_check_table('test_table', false, false);
+
+-- aborted deletes
+BEGIN;
+DELETE FROM test_table WHERE mod(id, 3) = 0;
+ROLLBACK;
+
+SELECT COUNT(*) FROM test_table;
+SELECT pg_check_table('test_table', false, false);
+
+-- locker and updater in different subtransactions produce a multixact
+BEGIN;
+SELECT COUNT(*) FROM (SELECT * FROM test_table WHERE id <= 10 FOR SHARE) foo;
+SAVEPOINT s;
+UPDATE test_table SET val = 'updated' WHERE id <= 10;
+RELEASE SAVEPOINT s;
+SELECT pg_check_table('test_table', false, false);
+COMMIT;
+
+SELECT pg_check_table('test_table', false, false);
+
+DROP TABLE test_table;
+
+DROP EXTENSION pg_check;